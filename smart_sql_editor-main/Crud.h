@@ -1,15 +1,257 @@
 #include <iostream>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <chrono>
 #include <pqxx/pqxx>
 #include "crow_all.h"
+#include "connection_pool.h"
+#include "metrics.h"
 
 // Forward declaration of your existing function.
 crow::json::wvalue get_table_details(const std::string& table_name,
-                                       const std::string& db_name, 
+                                       const std::string& schema_name,
+                                       const std::string& db_name,
                                        const std::string& db_user,
                                        const std::string& db_pass,
                                        const std::string& db_host,
                                        const std::string& db_port);
 
+// Persists metadata records off the request path. Records are queued per
+// database and one background thread drains the queues in batches,
+// bootstrapping a database's metadata table before its first batch. A
+// database only gets a queue once a record for it is queued, that is after
+// its catalog was read, and the queue is dropped after IDLE_TTL without new
+// records, so made-up connection parameters cost neither a thread nor a
+// lasting entry.
+class MetadataWriter {
+public:
+    // Upper bound on how many records one INSERT carries.
+    static constexpr size_t MAX_BATCH_SIZE = 500;
+    static constexpr std::chrono::minutes IDLE_TTL{10};
+
+    struct MetadataRecord {
+        std::string table_name;
+        std::string primary_key;
+        std::string search_key;
+        std::string table_comment;
+        int num_columns;
+    };
+
+    ~MetadataWriter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        writer_.join();
+    }
+
+    MetadataWriter(const MetadataWriter&) = delete;
+    MetadataWriter& operator=(const MetadataWriter&) = delete;
+
+    static MetadataWriter& instance() {
+        // Construct the pool first so it outlives the writer, which flushes
+        // its queues through it during shutdown.
+        ConnectionPool::instance();
+        static MetadataWriter writer;
+        return writer;
+    }
+
+    // Queues a record unless one for the same table is already stored or
+    // waiting. The metadata table never updates existing rows, so later
+    // records for the same table would be dropped by the INSERT anyway.
+    void enqueue(const std::string& db_name,
+                 const std::string& db_user,
+                 const std::string& db_pass,
+                 const std::string& db_host,
+                 const std::string& db_port,
+                 MetadataRecord record) {
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto inserted = databases_.try_emplace(key);
+            Database& database = inserted.first->second;
+            if (inserted.second) {
+                database.db_name = db_name;
+                database.db_user = db_user;
+                database.db_pass = db_pass;
+                database.db_host = db_host;
+                database.db_port = db_port;
+            }
+            database.last_used = std::chrono::steady_clock::now();
+            if (!database.known_tables.insert(record.table_name).second) {
+                return;
+            }
+            database.queue.push_back(std::move(record));
+        }
+        wake_.notify_one();
+    }
+
+private:
+    static constexpr const char* INSERT_METADATA = "crud_insert_metadata";
+    static constexpr const char* UNDEFINED_PREPARED_STATEMENT = "26000";  // SQLSTATE
+
+    struct Database {
+        std::string db_name;
+        std::string db_user;
+        std::string db_pass;
+        std::string db_host;
+        std::string db_port;
+        std::deque<MetadataRecord> queue;
+        std::unordered_set<std::string> known_tables;
+        std::chrono::steady_clock::time_point last_used;
+        bool table_bootstrapped = false;  // only touched by the writer thread
+    };
+
+    MetadataWriter() : writer_([this] { writeLoop(); }) {}
+
+    // This function creates the metadata table if it doesn't exist.
+    static void createMetadataTable(pqxx::connection& conn) {
+        pqxx::work txn(conn);
+
+        std::string sql =
+            "CREATE TABLE IF NOT EXISTS metadata_table ("
+            "  table_name TEXT PRIMARY KEY, "
+            "  primary_key TEXT, "
+            "  search_key TEXT, "
+            "  table_comment TEXT, "
+            "  num_columns INTEGER"
+            ");";
+        txn.exec(sql);
+        txn.commit();
+    }
+
+    // Writes one batch with a single prepared INSERT that takes each column as
+    // an array; rows for tables that are already in the metadata table are
+    // skipped by the primary key conflict.
+    static void insertBatch(pqxx::connection& conn, const std::vector<MetadataRecord>& batch) {
+        Metrics::ScopedTimer timer(Metrics::instance().metadata_write);
+        std::vector<std::string> table_names, primary_keys, search_keys, table_comments;
+        std::vector<int> num_columns;
+        for (const MetadataRecord& record : batch) {
+            table_names.push_back(record.table_name);
+            primary_keys.push_back(record.primary_key);
+            search_keys.push_back(record.search_key);
+            table_comments.push_back(record.table_comment);
+            num_columns.push_back(record.num_columns);
+        }
+
+        // The statement refers to metadata_table, so it cannot be prepared
+        // with the catalog statements when the connection opens. It is
+        // prepared the first time a connection lacks it instead.
+        for (int attempt = 0;; ++attempt) {
+            try {
+                pqxx::work txn(conn);
+                txn.exec_prepared(INSERT_METADATA, table_names, primary_keys, search_keys, table_comments, num_columns);
+                txn.commit();
+                return;
+            } catch (const pqxx::sql_error &e) {
+                const char* state = e.sqlstate();
+                if (attempt > 0 || state == nullptr || std::string(state) != UNDEFINED_PREPARED_STATEMENT) {
+                    throw;
+                }
+            }
+            conn.prepare(INSERT_METADATA,
+                "INSERT INTO metadata_table (table_name, primary_key, search_key, table_comment, num_columns) "
+                "SELECT * FROM unnest($1::text[], $2::text[], $3::text[], $4::text[], $5::integer[]) "
+                "ON CONFLICT (table_name) DO NOTHING");
+        }
+    }
+
+    bool hasPending() const {
+        for (const auto& entry : databases_) {
+            if (!entry.second.queue.empty()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Writes one batch of a database's queue, with mutex_ held on entry and
+    // exit but not while writing. Records of a failed batch are forgotten so
+    // the next request for those tables queues them again, and the table is
+    // created again before the next batch in case it was dropped. Only this
+    // thread erases databases, so the reference stays valid while unlocked.
+    void writeBatch(std::unique_lock<std::mutex>& lock, Database& database) {
+        std::vector<MetadataRecord> batch;
+        while (!database.queue.empty() && batch.size() < MAX_BATCH_SIZE) {
+            batch.push_back(std::move(database.queue.front()));
+            database.queue.pop_front();
+        }
+        lock.unlock();
+
+        bool stored = false;
+        try {
+            PooledConnection conn = ConnectionPool::instance().acquire(database.db_name, database.db_user, database.db_pass,
+                                                                       database.db_host, database.db_port);
+            if (!database.table_bootstrapped) {
+                createMetadataTable(*conn);
+                database.table_bootstrapped = true;
+            }
+            insertBatch(*conn, batch);
+            stored = true;
+        } catch (const std::exception &e) {
+            std::cerr << "Error storing table metadata: " << e.what() << std::endl;
+            database.table_bootstrapped = false;
+        }
+
+        lock.lock();
+        if (!stored) {
+            for (const MetadataRecord& record : batch) {
+                database.known_tables.erase(record.table_name);
+            }
+        }
+    }
+
+    // Background writer: takes one batch from every database with queued
+    // records per round, so a busy database does not starve the others, and
+    // drops databases that have been idle for IDLE_TTL. Queues are flushed
+    // before shutdown.
+    void writeLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait_for(lock, IDLE_TTL, [this] { return stopping_ || hasPending(); });
+            if (stopping_ && !hasPending()) {
+                return;
+            }
+
+            std::vector<Database*> pending;
+            for (auto& entry : databases_) {
+                if (!entry.second.queue.empty()) {
+                    pending.push_back(&entry.second);
+                }
+            }
+            for (Database* database : pending) {
+                writeBatch(lock, *database);
+            }
+
+            auto cutoff = std::chrono::steady_clock::now() - IDLE_TTL;
+            for (auto it = databases_.begin(); it != databases_.end();) {
+                if (it->second.queue.empty() && it->second.last_used < cutoff) {
+                    it = databases_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::unordered_map<ConnectionKey, Database, ConnectionKeyHash> databases_;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+// Reads table details for one database and hands what the metadata table
+// keeps to the MetadataWriter. Cheap to construct; it holds no thread or
+// connection of its own.
 class Crud {
 public:
     Crud(const std::string& db_name,
@@ -20,17 +262,19 @@ public:
          : db_name_(db_name), db_user_(db_user), db_pass_(db_pass),
            db_host_(db_host), db_port_(db_port)
     {
-        createMetadataTable();
     }
 
     // This function calls get_table_details, extracts the relevant fields, and
-    // appends the record into the metadata table if it does not already exist.
-    crow::json::wvalue getTableDetailsAndStore(const std::string& table_name) {
+    // queues the record for the metadata table if it is not stored yet.
+    // Tables outside the public schema are recorded as "schema.table".
+    crow::json::wvalue getTableDetailsAndStore(const std::string& table_name,
+                                               const std::string& schema_name = "public") {
         // Call the existing get_table_details function.
-        crow::json::wvalue details = get_table_details(table_name, db_name_, db_user_, db_pass_, db_host_, db_port_);
-        
-        // Check if the "error" key is set by testing its type.
-        if (details["error"].t() != crow::json::type::Null) {
+        crow::json::wvalue details = get_table_details(table_name, schema_name, db_name_, db_user_, db_pass_, db_host_, db_port_);
+        const std::string metadata_name = schema_name == "public" ? table_name : schema_name + "." + table_name;
+
+        // Check if the "error" key is set (count() avoids inserting it).
+        if (details.count("error") != 0) {
             return details;
         }
 
@@ -47,34 +291,8 @@ public:
         // Define search_key equal to the primary key.
         std::string search_key = primary_key;
 
-        try {
-            std::string conn_str = "dbname=" + db_name_ +
-                                   " user=" + db_user_ +
-                                   " password=" + db_pass_ +
-                                   " host=" + db_host_ +
-                                   " port=" + db_port_;
-            pqxx::connection conn(conn_str);
-            pqxx::work txn(conn);
-            
-            // Check if a record for this table already exists in the metadata table.
-            std::string check_sql = "SELECT 1 FROM metadata_table WHERE table_name = " + txn.quote(table_name) + ";";
-            pqxx::result res = txn.exec(check_sql);
-            
-            if (res.empty()) {
-                // Insert the new metadata record.
-                std::string insert_sql = "INSERT INTO metadata_table (table_name, primary_key, search_key, table_comment, num_columns) VALUES ("
-                                          + txn.quote(table_name) + ", "
-                                          + txn.quote(primary_key) + ", "
-                                          + txn.quote(search_key) + ", "
-                                          + txn.quote(table_comment) + ", "
-                                          + std::to_string(num_columns) + ");";
-                txn.exec(insert_sql);
-            }
-            txn.commit();
-        } catch (const std::exception &e) {
-            // In case of error, add an extra field in the returned JSON.
-            details["metadata_error"] = e.what();
-        }
+        MetadataWriter::instance().enqueue(db_name_, db_user_, db_pass_, db_host_, db_port_,
+                                           {metadata_name, primary_key, search_key, table_comment, num_columns});
         return details;
     }
 
@@ -101,32 +319,6 @@ private:
         return 0;
     }
 
-    // This function creates the metadata table if it doesn't exist.
-    void createMetadataTable() {
-        try {
-            std::string conn_str = "dbname=" + db_name_ +
-                                   " user=" + db_user_ +
-                                   " password=" + db_pass_ +
-                                   " host=" + db_host_ +
-                                   " port=" + db_port_;
-            pqxx::connection conn(conn_str);
-            pqxx::work txn(conn);
-            
-            std::string sql =
-                "CREATE TABLE IF NOT EXISTS metadata_table ("
-                "  table_name TEXT PRIMARY KEY, "
-                "  primary_key TEXT, "
-                "  search_key TEXT, "
-                "  table_comment TEXT, "
-                "  num_columns INTEGER"
-                ");";
-            txn.exec(sql);
-            txn.commit();
-        } catch (const std::exception &e) {
-            std::cerr << "Error creating metadata table: " << e.what() << std::endl;
-        }
-    }
-
     // Database connection parameters.
     std::string db_name_;
     std::string db_user_;
@@ -3,10 +3,28 @@
 #include "crow_all.h"
 #include "interface.h"
 #include "Crud.h"
+#include "connection_pool.h"
+#include "query_stream.h"
+#include "result_json.h"
+#include "schema_cache.h"
+#include "result_cache.h"
+#include "sql_classifier.h"
+#include "read_replicas.h"
+#include "schema_events.h"
+#include "async_query.h"
+#include "query_registry.h"
+#include "query_pager.h"
+#include "export_stream.h"
+#include "table_import.h"
+#include "script_runner.h"
+#include "explain_plan.h"
+#include "query_history.h"
+#include "metrics.h"
+#include "static_page.h"
 /*
 cd /usr/Fattah-01Jun025/nada/sql_simulator
 
-g++ api.cpp -o api -lpqxx -lpq
+g++ api.cpp -o api -lpqxx -lpq -lcrypto -lz -lbrotlienc -pthread
 
 ./api
 
@@ -26,17 +44,11 @@ crow::json::wvalue get_tables(const std::string& db_name,
                             const std::string& db_port) {
     crow::json::wvalue result;
     try {
-        std::string conn_str = "dbname=" + db_name + " user=" + db_user +
-                              " password=" + db_pass + " host=" + db_host +
-                              " port=" + db_port;
-        pqxx::connection conn(conn_str);
-        pqxx::work txn(conn);
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        pqxx::work txn(*conn);
         
         // Query to get all user tables
-        pqxx::result res = txn.exec(
-            "SELECT table_name FROM information_schema.tables "
-            "WHERE table_schema = 'public' AND table_type = 'BASE TABLE'"
-        );
+        pqxx::result res = txn.exec_prepared(PreparedStatements::TABLES, "public");
         txn.commit();
 
         crow::json::wvalue::list tables;
@@ -52,77 +64,37 @@ crow::json::wvalue get_tables(const std::string& db_name,
 }
 
 crow::json::wvalue get_table_details(const std::string& table_name,
-                                   const std::string& db_name, 
+                                   const std::string& schema_name,
+                                   const std::string& db_name,
                                    const std::string& db_user,
                                    const std::string& db_pass,
                                    const std::string& db_host,
                                    const std::string& db_port) {
     crow::json::wvalue result;
     try {
-        std::string conn_str = "dbname=" + db_name + " user=" + db_user +
-                              " password=" + db_pass + " host=" + db_host +
-                              " port=" + db_port;
-        pqxx::connection conn(conn_str);
-        pqxx::work txn(conn);
-        
-
-        pqxx::result pk_res = txn.exec(
-    "SELECT kcu.column_name "
-    "FROM information_schema.table_constraints tc "
-    "JOIN information_schema.key_column_usage kcu "
-    "  ON tc.constraint_name = kcu.constraint_name "
-    "WHERE tc.table_name = '" + txn.esc(table_name) + "' "
-    "AND tc.constraint_type = 'PRIMARY KEY'"
-);
-
-pqxx::result res = txn.exec(
-    "SELECT "
-    "    c.column_name, "
-    "    c.data_type, "
-    "    c.character_maximum_length, "
-    "    c.is_nullable, "
-    "    c.column_default, "
-    "    c.ordinal_position, "
-    "    CASE "
-    "        WHEN pk.constraint_type = 'PRIMARY KEY' THEN true "
-    "        ELSE false "
-    "    END as is_primary_key, "
-    "    pgd.description as column_comment "  // New field for column comment
-    "FROM information_schema.columns c "
-    "LEFT JOIN ("
-    "    SELECT kcu.column_name, tc.constraint_type "
-    "    FROM information_schema.table_constraints tc "
-    "    JOIN information_schema.key_column_usage kcu "
-    "        ON tc.constraint_name = kcu.constraint_name "
-    "        AND tc.table_schema = kcu.table_schema "
-    "    WHERE tc.table_name = '" + txn.esc(table_name) + "' "
-    "    AND tc.constraint_type = 'PRIMARY KEY'"
-    ") pk ON c.column_name = pk.column_name "
-    "LEFT JOIN pg_catalog.pg_statio_all_tables st ON st.relname = c.table_name "
-    "LEFT JOIN pg_catalog.pg_description pgd ON pgd.objoid = st.relid AND pgd.objsubid = c.ordinal_position "
-    "WHERE c.table_name = '" + txn.esc(table_name) + "' "
-    "ORDER BY c.ordinal_position"
-);
-        // Get table metadata
-        pqxx::result table_meta = txn.exec(
-            "SELECT "
-            "    (SELECT count(*) FROM information_schema.columns "
-            "     WHERE table_name = '" + txn.esc(table_name) + "') as column_count, "
-            "    obj_description(('public.' || '" + txn.esc(table_name) + "')::regclass::oid) as table_comment"
-        );
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        pqxx::work txn(*conn);
 
+        // One round trip against pg_catalog, prepared on every pooled connection.
+        pqxx::result res = txn.exec_prepared(PreparedStatements::TABLE_DETAILS, schema_name, table_name);
         txn.commit();
 
-         if (!pk_res.empty()) {
-            result["primary_key_name"] = pk_res[0][0].c_str();
+        if (res.empty()) {
+            throw std::runtime_error("relation \"" + schema_name + "." + table_name + "\" does not exist");
+        }
+
+        if (!res[0][9].is_null()) {
+            result["primary_key_name"] = res[0][9].c_str();
         } else {
             result["primary_key_name"] = nullptr;  // Will be omitted in JSON
         }
 
-
         // Process column information
         crow::json::wvalue::list columns;
         for (const auto& row : res) {
+            if (row[0].is_null()) {
+                continue;
+            }
             crow::json::wvalue column;
             column["name"] = row[0].c_str();
             column["type"] = row[1].c_str();
@@ -131,14 +103,14 @@ pqxx::result res = txn.exec(
             column["default"] = row[4].is_null() ? "NULL" : row[4].c_str();
             column["position"] = row[5].as<int>();
             column["is_primary_key"] = row[6].as<bool>();
-             column["comment"] = row[7].is_null() ? "" : row[7].c_str(); // New column for comment
-             columns.push_back(std::move(column));
+            column["comment"] = row[7].is_null() ? "" : row[7].c_str();
+            columns.push_back(std::move(column));
         }
-        
+
         // Add metadata
+        result["column_count"] = static_cast<int>(columns.size());
         result["columns"] = std::move(columns);
-        result["column_count"] = table_meta[0][0].as<int>();
-        result["table_comment"] = table_meta[0][1].is_null() ? "" : table_meta[0][1].c_str();
+        result["table_comment"] = res[0][8].is_null() ? "" : res[0][8].c_str();
         result["status"] = "success";
     } catch (const std::exception &e) {
         result["error"] = e.what();
@@ -146,20 +118,63 @@ pqxx::result res = txn.exec(
     return result;
 }
 
-std::string quote_identifier(const std::string& identifier) {
-    std::string quoted = "\"";
-    for (char c : identifier) {
-        if (c == '"') {
-            quoted += "\""; // double any double quotes
+// Drops cached schema responses and pushes the change to subscribed editor
+// pages after DDL run through the editor, without waiting for the DDL
+// notification.
+void schema_changed(const std::string& db_name,
+                    const std::string& db_user,
+                    const std::string& db_pass,
+                    const std::string& db_host,
+                    const std::string& db_port) {
+    if (auto db = SchemaCache::instance().find(db_name, db_user, db_pass, db_host, db_port)) {
+        db->invalidate();
+    }
+    SchemaEvents::instance().changed(ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port));
+}
+
+// Whether a statement run through the editor may have changed the schema. The
+// command tag of the last statement names most DDL; the classifier covers the
+// rest of a multi-statement text and SELECT INTO / CREATE TABLE AS, which
+// are tagged SELECT.
+bool changes_schema(const std::string& query, const char* command_tag) {
+    if (command_tag) {
+        std::string tag(command_tag);
+        std::string command = tag.substr(0, tag.find(' '));
+        for (const char* ddl : {"CREATE", "ALTER", "DROP", "COMMENT", "GRANT", "REVOKE", "SECURITY", "IMPORT",
+                                "DO", "CALL"}) {
+            if (command == ddl) {
+                return true;
+            }
         }
-        quoted.push_back(c);
     }
-    quoted += "\"";
-    return quoted;
+    return SqlClassifier::mayChangeSchema(query);
 }
 
+// After a write on the primary, makes later reads with the same credentials
+// wait for the replicas to catch up with it.
+void note_write(pqxx::connection& conn, const ConnectionKey& key, const std::string& db_host, const std::string& db_port) {
+    ReadReplicas& replicas = ReadReplicas::instance();
+    if (replicas.hasReplicas(db_host, db_port)) {
+        pqxx::nontransaction lsn(conn);
+        replicas.noteWrite(key, ReadReplicas::parseLsn(lsn.query_value<std::string>("SELECT pg_current_wal_lsn()::text")));
+    }
+}
+
+// Drops cached query results of the database after a statement run through
+// the editor that may have written to it.
+void invalidate_result_cache(const std::string& query,
+                             const std::string& db_name,
+                             const std::string& db_user,
+                             const std::string& db_pass,
+                             const std::string& db_host,
+                             const std::string& db_port) {
+    if (!SqlClassifier::isReadOnly(query)) {
+        ResultCache::instance().invalidate(ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port));
+    }
+}
 
 crow::json::wvalue update_column_comment(const std::string& table_name,
+                                          const std::string& schema_name,
                                           const std::string& column_name,
                                           const std::string& new_comment,
                                           const std::string& db_name, 
@@ -169,20 +184,21 @@ crow::json::wvalue update_column_comment(const std::string& table_name,
                                           const std::string& db_port) {
     crow::json::wvalue result;
     try {
-        std::string conn_str = "dbname=" + db_name + " user=" + db_user +
-                               " password=" + db_pass + " host=" + db_host +
-                               " port=" + db_port;
-        pqxx::connection conn(conn_str);
-        pqxx::work txn(conn);
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        pqxx::work txn(*conn);
 
         // If the new comment is empty, set it to NULL so that the comment is removed.
         std::string comment_value = new_comment.empty() ? "NULL" : ("'" + txn.esc(new_comment) + "'");
         std::string sql = "COMMENT ON COLUMN " +
-                          quote_identifier(table_name) + "." + quote_identifier(column_name) +
+                          SqlLexer::quoteIdentifier(schema_name) + "." +
+                          SqlLexer::quoteIdentifier(table_name) + "." +
+                          SqlLexer::quoteIdentifier(column_name) +
                           " IS " + comment_value + ";";
 
         txn.exec(sql);
         txn.commit();
+        schema_changed(db_name, db_user, db_pass, db_host, db_port);
+        invalidate_result_cache(sql, db_name, db_user, db_pass, db_host, db_port);
 
         result["status"] = "success";
     } catch (const std::exception &e) {
@@ -193,58 +209,558 @@ crow::json::wvalue update_column_comment(const std::string& table_name,
 
 
 
-crow::json::wvalue execute_query(const std::string& query, 
-                                 const std::string& db_name,
-                                 const std::string& db_user,
-                                 const std::string& db_pass,
-                                 const std::string& db_host,
-                                 const std::string& db_port) {
+// Serializes a complete result as the /query response.
+crow::response result_response(const pqxx::result& res, ResultFormat format, const QueryControl& control) {
+    // Serialize straight from the result instead of through a wvalue tree.
+    Metrics::ScopedTimer timer(Metrics::instance().serialization);
+    crow::response response;
+    if (format == ResultFormat::Arrow) {
+        response.body = ArrowIpc::stream(res);
+        response.set_header("Content-Type", ArrowIpc::CONTENT_TYPE);
+    } else {
+        response.body = ResultJson::document(res);
+        response.set_header("Content-Type", "application/json");
+    }
+    response.set_header("X-Request-Id", control.request_id);
+    response.set_header("X-Row-Count", std::to_string(res.size()));
+    return response;
+}
+
+// Whether a statement that failed on a replica or in a read-only transaction
+// should be retried on the primary: it wrote after all (25006), conflicted
+// with recovery (40001), or the replica went away.
+bool retry_on_primary(const std::exception& e) {
+    if (dynamic_cast<const pqxx::broken_connection*>(&e)) {
+        return true;
+    }
+    auto sql_error = dynamic_cast<const pqxx::sql_error*>(&e);
+    if (!sql_error || !sql_error->sqlstate()) {
+        return false;
+    }
+    std::string sqlstate = sql_error->sqlstate();
+    return sqlstate == "25006" || sqlstate == "40001";
+}
+
+crow::response execute_query(const std::string& query, 
+                             ResultFormat format,
+                             const QueryControl& control,
+                             const std::string& db_name,
+                             const std::string& db_user,
+                             const std::string& db_pass,
+                             const std::string& db_host,
+                             const std::string& db_port) {
     crow::json::wvalue result_json;
+    ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+    ReadReplicas& replicas = ReadReplicas::instance();
     try {
-        std::string conn_str = "dbname=" + db_name + " user=" + db_user +
-                               " password=" + db_pass + " host=" + db_host +
-                               " port=" + db_port;
-        pqxx::connection conn(conn_str);
-        pqxx::work txn(conn);
-        
+        // Read-only statements run in a read-only transaction, on a replica
+        // when one is fresh enough.
+        if (SqlClassifier::isReadOnly(query)) {
+            ReadReplicas::Target target = replicas.pick(db_name, db_user, db_pass, db_host, db_port,
+                                                        control.max_replica_lag_ms);
+            try {
+                PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, target.host, target.port);
+                conn.mark_dirty();  // arbitrary user SQL may change session state
+                // Registered under the request's credentials so /query/cancel finds it.
+                QueryRegistry::Registration registration = QueryRegistry::instance().add(control, key, *conn);
+                pqxx::read_transaction txn(*conn);
+                txn.exec(control.setLocalTimeoutSql());
+                if (format == ResultFormat::Arrow) {
+                    txn.exec(ArrowIpc::SET_DATESTYLE_SQL);
+                }
+                auto started = std::chrono::steady_clock::now();
+                pqxx::result res = txn.exec(query);
+                Metrics::instance().query_execution.observeSince(started);
+                txn.commit();
+
+                crow::response response = result_response(res, format, control);
+                if (target.replica) {
+                    response.set_header("X-Read-Replica", target.host + ":" + target.port);
+                }
+                return response;
+            } catch (const std::exception &e) {
+                if (!retry_on_primary(e)) {
+                    throw;
+                }
+                if (target.replica && dynamic_cast<const pqxx::broken_connection*>(&e)) {
+                    replicas.markDown(db_name, db_user, db_pass, target);
+                }
+            }
+        }
+
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        QueryRegistry::Registration registration = QueryRegistry::instance().add(control, key, *conn);
+        pqxx::work txn(*conn);
+        txn.exec(control.setLocalTimeoutSql());
+        if (format == ResultFormat::Arrow) {
+            txn.exec(ArrowIpc::SET_DATESTYLE_SQL);
+        }
+
+        auto started = std::chrono::steady_clock::now();
+        pqxx::result res = txn.exec(query);
+        Metrics::instance().query_execution.observeSince(started);
+        txn.commit();
+        if (changes_schema(query, res.cmd_status())) {
+            schema_changed(db_name, db_user, db_pass, db_host, db_port);
+        }
+        invalidate_result_cache(query, db_name, db_user, db_pass, db_host, db_port);
+        note_write(*conn, key, db_host, db_port);
+
+        return result_response(res, format, control);
+    } catch (const std::exception &e) {
+        result_json["error"] = e.what();
+    }
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    return response;
+}
+
+// Serves a read-only statement from the result cache, or runs it in a
+// read-only transaction and caches the response while the database's
+// SchemaCache listener runs. On a miss the plan is read first to learn which
+// tables the response depends on. Statements the cache
+// does not take, and ones the server refuses to run read-only, go through
+// execute_query.
+crow::response cached_query(const std::string& query,
+                            ResultFormat format,
+                            int ttl_ms,
+                            const QueryControl& control,
+                            const std::string& db_name,
+                            const std::string& db_user,
+                            const std::string& db_pass,
+                            const std::string& db_host,
+                            const std::string& db_port) {
+    ConnectionKey database = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+    std::optional<std::string> key =
+        ResultCache::keyFor(query, format == ResultFormat::Arrow ? "arrow" : "json", database);
+    if (!key) {
+        return execute_query(query, format, control, db_name, db_user, db_pass, db_host, db_port);
+    }
+
+    ResultCache& cache = ResultCache::instance();
+    if (std::optional<ResultCache::Hit> hit = cache.lookup(*key)) {
+        crow::response response;
+        response.body = *hit->body;
+        response.set_header("Content-Type", hit->content_type);
+        response.set_header("X-Cache", "hit");
+        response.set_header("X-Request-Id", control.request_id);
+        return response;
+    }
+
+    crow::json::wvalue result_json;
+    try {
+        uint64_t version = cache.version(database);
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        QueryRegistry::Registration registration = QueryRegistry::instance().add(control, database, *conn);
+        pqxx::read_transaction txn(*conn);
+        txn.exec(control.setLocalTimeoutSql());
+        if (format == ResultFormat::Arrow) {
+            txn.exec(ArrowIpc::SET_DATESTYLE_SQL);
+        }
+
+        pqxx::result plan = txn.exec("EXPLAIN (FORMAT JSON, VERBOSE) " + query);
+        auto started = std::chrono::steady_clock::now();
         pqxx::result res = txn.exec(query);
+        Metrics::instance().query_execution.observeSince(started);
         txn.commit();
 
-        crow::json::wvalue::list columns;
-        for (size_t j = 0; j < res.columns(); ++j) {
-            columns.push_back(res.column_name(j));
+        crow::response response = result_response(res, format, control);
+        // Writes by other sessions are only reported while the database's
+        // listener runs; the statement succeeded, so the credentials may
+        // start one.
+        std::shared_ptr<SchemaCache::Database> listener =
+            SchemaCache::instance().watch(db_name, db_user, db_pass, db_host, db_port);
+        if (listener && listener->isWatching()) {
+            cache.store(database, *key, response.body, response.get_header_value("Content-Type"),
+                        ResultCache::dependencies(plan[0][0].c_str()), version, ttl_ms);
+        }
+        response.set_header("X-Cache", "miss");
+        return response;
+    } catch (const pqxx::sql_error &e) {
+        // 25006: read_only_sql_transaction, e.g. a function that writes.
+        if (e.sqlstate() && std::string(e.sqlstate()) == "25006") {
+            return execute_query(query, format, control, db_name, db_user, db_pass, db_host, db_port);
         }
-        result_json["columns"] = std::move(columns);
+        result_json["error"] = e.what();
+    } catch (const std::exception &e) {
+        result_json["error"] = e.what();
+    }
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    return response;
+}
 
-        crow::json::wvalue::list rows;
-        for (size_t i = 0; i < res.size(); ++i) {
-            crow::json::wvalue::list row;
-            for (size_t j = 0; j < res.columns(); ++j) {
-                row.push_back(res[i][static_cast<int>(j)].is_null() ? "NULL" :
-                              std::string(res[i][static_cast<int>(j)].c_str()));
+// Runs a multi-statement script in one transaction and one round trip and
+// answers with every statement's outcome (see ScriptRunner).
+crow::response script_query(const std::string& script,
+                            const QueryControl& control,
+                            const std::string& db_name,
+                            const std::string& db_user,
+                            const std::string& db_pass,
+                            const std::string& db_host,
+                            const std::string& db_port) {
+    crow::json::wvalue result_json;
+    ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+    try {
+        std::vector<ScriptRunner::Outcome> outcomes = ScriptRunner::parse(script);
+        auto started = std::chrono::steady_clock::now();
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        QueryRegistry::Registration registration = QueryRegistry::instance().add(control, key, *conn);
+        bool committed = false;
+        {
+            pqxx::work txn(*conn);
+            if (ScriptRunner::run(txn, control.setLocalTimeoutSql(), outcomes)) {
+                txn.commit();
+                committed = true;
+            }
+        }
+
+        if (committed) {
+            bool schema = false;
+            for (const ScriptRunner::Outcome& outcome : outcomes) {
+                schema = schema || changes_schema(outcome.sql, outcome.result.cmd_status());
             }
-            rows.push_back(std::move(row));
+            if (schema) {
+                schema_changed(db_name, db_user, db_pass, db_host, db_port);
+            }
+            invalidate_result_cache(script, db_name, db_user, db_pass, db_host, db_port);
+            if (!SqlClassifier::isReadOnly(script)) {
+                note_write(*conn, key, db_host, db_port);
+            }
+        }
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;
+        crow::response response;
+        response.body = ScriptRunner::document(outcomes, committed, elapsed.count());
+        response.set_header("Content-Type", "application/json");
+        response.set_header("X-Request-Id", control.request_id);
+        return response;
+    } catch (const std::exception &e) {
+        result_json["error"] = e.what();
+    }
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    return response;
+}
+
+// Runs EXPLAIN (FORMAT JSON[, ANALYZE, BUFFERS]) on a single statement and
+// answers with the analyzed plan (see ExplainPlan). ANALYZE executes the
+// statement, so it runs in a transaction that is always rolled back.
+crow::response explain_query(const std::string& query,
+                             bool analyze,
+                             const QueryControl& control,
+                             const std::string& db_name,
+                             const std::string& db_user,
+                             const std::string& db_pass,
+                             const std::string& db_host,
+                             const std::string& db_port) {
+    crow::json::wvalue result_json;
+    try {
+        if (SqlLexer::splitStatements(query).size() != 1) {
+            throw std::invalid_argument("EXPLAIN takes exactly one statement");
+        }
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        QueryRegistry::Registration registration = QueryRegistry::instance().add(control, key, *conn);
+        pqxx::work txn(*conn);
+        txn.exec(control.setLocalTimeoutSql());
+        pqxx::result plan = txn.exec(std::string(analyze ? "EXPLAIN (FORMAT JSON, ANALYZE, BUFFERS) "
+                                                         : "EXPLAIN (FORMAT JSON) ") + query);
+        txn.abort();
+        result_json = ExplainPlan::analyze(plan[0][0].c_str());
+    } catch (const std::exception &e) {
+        result_json["error"] = e.what();
+    }
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    return response;
+}
+
+// Streams the result of a row-returning query in batches through a cursor.
+// Scripts, statements that may write and statements that cannot run through
+// a cursor fall back to execute_query.
+crow::response stream_query(const std::string& query,
+                            size_t batch_size,
+                            ResultFormat format,
+                            const QueryControl& control,
+                            QueryHistory::Recording recording,
+                            const std::string& db_name,
+                            const std::string& db_user,
+                            const std::string& db_pass,
+                            const std::string& db_host,
+                            const std::string& db_port) {
+    if (!QueryStream::canStream(query)) {
+        crow::response response = execute_query(query, format, control, db_name, db_user, db_pass, db_host, db_port);
+        recording.finish(response);
+        return response;
+    }
+
+    crow::json::wvalue result_json;
+    try {
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        QueryRegistry::Registration registration = QueryRegistry::instance().add(
+            control, ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port), *conn);
+        std::shared_ptr<QueryStream> stream =
+            QueryStream::open(std::move(conn), query, batch_size, format, control, std::move(registration));
+        if (!stream) {
+            crow::response response = execute_query(query, format, control, db_name, db_user, db_pass, db_host, db_port);
+            recording.finish(response);
+            return response;
         }
-        result_json["rows"] = std::move(rows);
-        result_json["status"] = "success";
+        crow::response res;
+        res.set_header("Content-Type", format == ResultFormat::Arrow ? ArrowIpc::CONTENT_TYPE : "application/json");
+        res.set_header("X-Request-Id", control.request_id);
+        // The execution is recorded once the last part has been written.
+        res.set_body_generator([stream, recording = std::make_shared<QueryHistory::Recording>(std::move(recording)),
+                                bytes = size_t{0}](std::string& out) mutable {
+            bool more;
+            try {
+                more = stream->next(out);
+            } catch (...) {
+                // A failed Arrow stream; Crow drops the connection.
+                recording->finish(static_cast<int64_t>(stream->rowsWritten()), bytes, true);
+                throw;
+            }
+            bytes += out.size();
+            if (!more) {
+                recording->finish(static_cast<int64_t>(stream->rowsWritten()), bytes, stream->failed());
+            }
+            return more;
+        });
+        return res;
     } catch (const std::exception &e) {
         result_json["error"] = e.what();
     }
-    return result_json;
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    recording.finish(response);
+    return response;
+}
+
+// Streams a query's result as a CSV or NDJSON download, optionally gzipped.
+crow::response export_query(const std::string& query,
+                            ExportStream::Format format,
+                            bool header,
+                            bool gzip,
+                            const QueryControl& control,
+                            const std::string& db_name,
+                            const std::string& db_user,
+                            const std::string& db_pass,
+                            const std::string& db_host,
+                            const std::string& db_port) {
+    crow::json::wvalue result_json;
+    try {
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        QueryRegistry::Registration registration = QueryRegistry::instance().add(
+            control, ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port), *conn);
+        std::shared_ptr<ExportStream> stream =
+            ExportStream::open(std::move(conn), query, format, header, gzip, control, std::move(registration));
+        crow::response res;
+        res.set_header("Content-Type", ExportStream::contentType(format));
+        res.set_header("Content-Disposition",
+                       std::string("attachment; filename=\"export.") + ExportStream::extension(format) + "\"");
+        if (gzip) {
+            res.set_header("Content-Encoding", "gzip");
+        }
+        res.set_header("X-Request-Id", control.request_id);
+        res.set_body_generator([stream](std::string& out) {
+            return stream->next(out);
+        });
+        return res;
+    } catch (const std::exception &e) {
+        result_json["error"] = e.what();
+    }
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    return response;
+}
+
+// Returns the first page of a read-only query and keeps its cursor open for
+// /query/next, on a replica when one is fresh enough. Scripts and anything
+// that may write go through execute_query: a held cursor's transaction is
+// rolled back when the cursor is released, which would silently drop the
+// write, and a script's last result is the one execute_query returns.
+// Statements that cannot run through a read-only cursor fall back to
+// execute_query too.
+crow::response paged_query(const std::string& query,
+                           size_t page_size,
+                           const QueryControl& control,
+                           const std::string& db_name,
+                           const std::string& db_user,
+                           const std::string& db_pass,
+                           const std::string& db_host,
+                           const std::string& db_port) {
+    if (!QueryPager::canPage(query)) {
+        return execute_query(query, ResultFormat::Json, control, db_name, db_user, db_pass, db_host, db_port);
+    }
+
+    crow::json::wvalue result_json;
+    ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+    try {
+        ReadReplicas::Target target = ReadReplicas::instance().pick(db_name, db_user, db_pass, db_host, db_port,
+                                                                    control.max_replica_lag_ms);
+        std::optional<std::string> page;
+        try {
+            page = QueryPager::instance().open(query, page_size, control, key,
+                                               db_name, db_user, db_pass, target.host, target.port);
+        } catch (const std::exception &e) {
+            if (!retry_on_primary(e)) {
+                throw;
+            }
+            if (target.replica && dynamic_cast<const pqxx::broken_connection*>(&e)) {
+                ReadReplicas::instance().markDown(db_name, db_user, db_pass, target);
+            }
+        }
+        if (!page) {
+            return execute_query(query, ResultFormat::Json, control, db_name, db_user, db_pass, db_host, db_port);
+        }
+        crow::response res(std::move(*page));
+        res.set_header("Content-Type", "application/json");
+        res.set_header("X-Request-Id", control.request_id);
+        return res;
+    } catch (const std::exception &e) {
+        result_json["error"] = e.what();
+    }
+    crow::response response(result_json);
+    response.set_header("X-Request-Id", control.request_id);
+    return response;
+}
+
+// Whether a request's request_id, if it has one, may be used. Routes answer
+// 400 before calling query_control when it may not.
+bool valid_request_id(const crow::json::rvalue& body) {
+    return !body.has("request_id") || (body["request_id"].t() == crow::json::type::String &&
+                                       QueryControl::isValidRequestId(body["request_id"].s()));
+}
+
+// Reads the request ID, statement timeout and replica lag limit of a /query
+// request. A request without an ID gets a generated one, returned in the
+// X-Request-Id header.
+QueryControl query_control(const crow::json::rvalue& body) {
+    QueryControl control;
+    control.request_id = body.has("request_id") ? std::string(body["request_id"].s())
+                                                : QueryRegistry::newRequestId();
+    if (body.has("statement_timeout_ms")) {
+        control.statement_timeout_ms = static_cast<int>(std::clamp<int64_t>(
+            body["statement_timeout_ms"].i(), 1, QueryControl::MAX_STATEMENT_TIMEOUT_MS));
+    }
+    if (body.has("max_replica_lag_ms")) {
+        control.max_replica_lag_ms = static_cast<int>(std::clamp<int64_t>(
+            body["max_replica_lag_ms"].i(), 0, QueryControl::MAX_STATEMENT_TIMEOUT_MS));
+    }
+    return control;
+}
+
+// Serves a schema browsing response from the schema cache, computing and
+// caching it on a miss. Error responses are never cached.
+template <typename Compute>
+crow::response cached_schema_response(const std::string& entry,
+                                      const std::string& db_name,
+                                      const std::string& db_user,
+                                      const std::string& db_pass,
+                                      const std::string& db_host,
+                                      const std::string& db_port,
+                                      Compute compute) {
+    SchemaCache& cache = SchemaCache::instance();
+    std::shared_ptr<SchemaCache::Database> db = cache.find(db_name, db_user, db_pass, db_host, db_port);
+    if (db) {
+        if (std::optional<std::string> body = db->lookup(entry)) {
+            crow::response res(std::move(*body));
+            res.set_header("Content-Type", "application/json");
+            return res;
+        }
+    }
+
+    uint64_t generation = db ? db->generation() : 0;
+    crow::json::wvalue result = compute();
+    if (result.count("error") == 0 && result.count("metadata_error") == 0) {
+        if (db) {
+            db->store(entry, result.dump(), generation);
+        } else {
+            cache.watch(db_name, db_user, db_pass, db_host, db_port);
+        }
+    }
+    return crow::response(result);
+}
+
+// The /table_details response for a table, from the schema cache when possible.
+crow::response table_details_response(const std::string& table_name,
+                                      const std::string& schema_name,
+                                      const std::string& db_name,
+                                      const std::string& db_user,
+                                      const std::string& db_pass,
+                                      const std::string& db_host,
+                                      const std::string& db_port) {
+    return cached_schema_response("table:" + schema_name + "." + table_name, db_name, db_user, db_pass, db_host, db_port, [&] {
+        Crud crud(db_name, db_user, db_pass, db_host, db_port);
+        return crud.getTableDetailsAndStore(table_name, schema_name);
+    });
+}
+
+// Loads a CSV or NDJSON upload into an existing table. The table's columns
+// come from the (cached) table details, so unknown columns are rejected
+// before any data is sent.
+crow::json::wvalue import_table(const std::string& table_name,
+                                const std::string& schema_name,
+                                const std::string& format,
+                                bool header,
+                                const std::string& data,
+                                const std::string& db_name,
+                                const std::string& db_user,
+                                const std::string& db_pass,
+                                const std::string& db_host,
+                                const std::string& db_port) {
+    crow::json::wvalue result;
+    try {
+        crow::response details_response = table_details_response(table_name, schema_name, db_name, db_user, db_pass, db_host, db_port);
+        crow::json::rvalue details = crow::json::load(details_response.body);
+        if (!details || details.has("error")) {
+            throw std::runtime_error(details ? std::string(details["error"].s()) : "Failed to read table details");
+        }
+        std::vector<std::string> table_columns;
+        for (const auto& column : details["columns"]) {
+            table_columns.push_back(column["name"].s());
+        }
+
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // the NDJSON path creates a temporary table
+        pqxx::work txn(*conn);
+        size_t rows = format == "ndjson"
+            ? TableImport::copyNdjson(txn, schema_name, table_name, data, table_columns)
+            : TableImport::copyCsv(txn, schema_name, table_name, data, header, table_columns);
+        txn.commit();
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        ResultCache::instance().invalidate(key);
+        note_write(*conn, key, db_host, db_port);
+
+        result["rows"] = static_cast<uint64_t>(rows);
+        result["status"] = "success";
+    } catch (const std::exception &e) {
+        result["error"] = e.what();
+    }
+    return result;
 }
 
 int main() {
     crow::SimpleApp app;
 
+    // Pages are compressed once here; see StaticPage and PageTemplate.
+    const StaticPage connect_form(Interface::getConnectForm(), "text/html");
+    const PageTemplate editor(Interface::getEditorTemplate(), Interface::DB_PARAMS_PLACEHOLDER, "text/html");
+
     // Serve the connection form.
-    CROW_ROUTE(app, "/")([](){
-        crow::response res(Interface::getConnectForm());
-        res.set_header("Content-Type", "text/html");
-        return res;
+    CROW_ROUTE(app, "/")([&connect_form](const crow::request& req) {
+        return connect_form.respond(req);
     });
 
     // Handle connection form submissions.
-    CROW_ROUTE(app, "/connect").methods("POST"_method)([](const crow::request& req) {
+    CROW_ROUTE(app, "/connect").methods("POST"_method)([&editor](const crow::request& req) {
         auto params = req.get_body_params();
         crow::json::wvalue db_params;
         db_params["dbname"] = params.get("dbname");
@@ -254,42 +770,356 @@ int main() {
         db_params["port"] = params.get("port");
 
         // Embed DB parameters into the SQL editor template.
-        std::string html = Interface::embedDBParams(db_params);
-        crow::response res(html);
-        res.set_header("Content-Type", "text/html");
+        return editor.respond(req, Interface::dbParamsScript(db_params));
+    });
+
+    // Prometheus metrics of this process.
+    Metrics::instance().addGauge("sql_editor_task_queue_length",
+                                 "Requests queued or running on each Crow worker thread.", [&app] {
+        Metrics::GaugeSamples samples;
+        std::vector<unsigned int> lengths = app.task_queue_lengths();
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            samples.emplace_back("thread=\"" + std::to_string(i) + "\"", lengths[i]);
+        }
+        return samples;
+    });
+    CROW_ROUTE(app, "/metrics")([] {
+        crow::response res(Metrics::instance().render());
+        res.set_header("Content-Type", Metrics::CONTENT_TYPE);
         return res;
     });
 
     // Execute SQL queries.
-    CROW_ROUTE(app, "/query").methods("POST"_method)([](const crow::request& req) {
+    CROW_ROUTE(app, "/query").methods("POST"_method)([](const crow::request& req, crow::response& res) {
         auto body = crow::json::load(req.body);
         if (!body || !body.has("query") || !body.has("dbname") ||
+            !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            res = crow::response(400, "Invalid request");
+            res.end();
+            return;
+        }
+        if (!valid_request_id(body)) {
+            res = crow::response(400, "Invalid request_id");
+            res.end();
+            return;
+        }
+
+        std::string query = body["query"].s();
+        std::string db_name = body["dbname"].s();
+        std::string db_user = body["user"].s();
+        std::string db_pass = body["password"].s();
+        std::string db_host = body["host"].s();
+        std::string db_port = body["port"].s();
+
+        // The running query is cancelled if this client disconnects.
+        QueryControl control = query_control(body);
+        control.client_alive = res.alive_check();
+        QueryHistory::Recording recording =
+            QueryHistory::instance().start(query, db_name, db_user, db_pass, db_host, db_port);
+
+        // format=arrow answers with an Arrow IPC stream instead of JSON; it is
+        // always produced batch by batch through the streaming path.
+        ResultFormat format = body.has("format") && body["format"].s() == "arrow" ? ResultFormat::Arrow
+                                                                                  : ResultFormat::Json;
+
+        // script=true runs every statement of the text and reports each one.
+        if (body.has("script") && body["script"].b()) {
+            res = script_query(query, control, db_name, db_user, db_pass, db_host, db_port);
+            recording.finish(res);
+            res.end();
+            return;
+        }
+
+        // cache=true serves repeated read-only statements from the result
+        // cache; cache_ttl_ms bounds how long a response may be reused.
+        if (body.has("cache") && body["cache"].b()) {
+            int ttl_ms = body.has("cache_ttl_ms")
+                ? static_cast<int>(std::clamp<int64_t>(body["cache_ttl_ms"].i(), 1, ResultCache::MAX_TTL_MS))
+                : ResultCache::DEFAULT_TTL_MS;
+            res = cached_query(query, format, ttl_ms, control, db_name, db_user, db_pass, db_host, db_port);
+            recording.finish(res);
+            res.end();
+            return;
+        }
+
+        // Async mode: the statement runs while this thread serves other
+        // connections; the response is completed from the io_service.
+        // Scripts run the regular way (see AsyncQuery::accepts).
+        if (format == ResultFormat::Json && body.has("async") && body["async"].b() && AsyncQuery::accepts(query)) {
+            AsyncQuery::start(*req.io_service, query, db_name, db_user, db_pass, db_host, db_port, std::move(control),
+                [&res, query, db_name, db_user, db_pass, db_host, db_port,
+                 recording = std::make_shared<QueryHistory::Recording>(std::move(recording))](crow::response result) {
+                    // A failed statement changed nothing.
+                    if (result.body.compare(0, 9, "{\"error\":") != 0) {
+                        if (changes_schema(query, nullptr)) {
+                            schema_changed(db_name, db_user, db_pass, db_host, db_port);
+                        }
+                        invalidate_result_cache(query, db_name, db_user, db_pass, db_host, db_port);
+                    }
+                    recording->finish(result);
+                    res = std::move(result);
+                    res.end();
+                });
+            return;
+        }
+
+        if (format == ResultFormat::Json && body.has("page_size")) {
+            res = paged_query(query, static_cast<size_t>(body["page_size"].u()), control,
+                              db_name, db_user, db_pass, db_host, db_port);
+        } else if (format == ResultFormat::Arrow || (body.has("stream") && body["stream"].b())) {
+            size_t batch_size = body.has("batch_size") ? static_cast<size_t>(body["batch_size"].u())
+                                                       : QueryStream::DEFAULT_BATCH_SIZE;
+            res = stream_query(query, batch_size, format, control, std::move(recording),
+                               db_name, db_user, db_pass, db_host, db_port);
+        } else {
+            res = execute_query(query, format, control, db_name, db_user, db_pass, db_host, db_port);
+        }
+        recording.finish(res);  // streamed results finish their own recording
+        res.end();
+    });
+
+    // Per-fingerprint latency percentiles of the statements run through /query.
+    CROW_ROUTE(app, "/query_history/stats").methods("POST"_method)([](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("dbname") ||
             !body.has("user") || !body.has("password") ||
             !body.has("host") || !body.has("port")) {
             return crow::response(400, "Invalid request");
         }
 
-        return crow::response(execute_query(
-            body["query"].s(),
-            body["dbname"].s(),
-            body["user"].s(),
-            body["password"].s(),
-            body["host"].s(),
-            body["port"].s()
-        ));
+        size_t limit = body.has("limit") ? static_cast<size_t>(std::clamp<int64_t>(body["limit"].i(), 1, 1000)) : 50;
+        return crow::response(QueryHistory::instance().stats(body["dbname"].s(), body["user"].s(),
+                                                             body["password"].s(), body["host"].s(),
+                                                             body["port"].s(), limit));
+    });
+
+    // Plan a statement, by default also running it, and point out slow nodes.
+    CROW_ROUTE(app, "/explain").methods("POST"_method)([](const crow::request& req, crow::response& res) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("query") || !body.has("dbname") ||
+            !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            res = crow::response(400, "Invalid request");
+            res.end();
+            return;
+        }
+        if (!valid_request_id(body)) {
+            res = crow::response(400, "Invalid request_id");
+            res.end();
+            return;
+        }
+
+        QueryControl control = query_control(body);
+        control.client_alive = res.alive_check();
+        bool analyze = !body.has("analyze") || body["analyze"].b();
+        res = explain_query(body["query"].s(), analyze, control, body["dbname"].s(), body["user"].s(),
+                            body["password"].s(), body["host"].s(), body["port"].s());
+        res.end();
+    });
+
+    // Export a query's result as CSV (via COPY) or NDJSON (via a cursor).
+    CROW_ROUTE(app, "/export").methods("POST"_method)([](const crow::request& req, crow::response& res) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("query") || !body.has("dbname") ||
+            !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            res = crow::response(400, "Invalid request");
+            res.end();
+            return;
+        }
+        if (!valid_request_id(body)) {
+            res = crow::response(400, "Invalid request_id");
+            res.end();
+            return;
+        }
+
+        std::string format_name = body.has("format") ? std::string(body["format"].s()) : "csv";
+        std::string compression = body.has("compression") ? std::string(body["compression"].s()) : "";
+        if ((format_name != "csv" && format_name != "ndjson") || (!compression.empty() && compression != "gzip")) {
+            res = crow::response(400, "Unsupported format or compression");
+            res.end();
+            return;
+        }
+
+        QueryControl control = query_control(body);
+        // Downloads may legitimately run for a long time; they only get a
+        // statement timeout when the request asks for one.
+        if (!body.has("statement_timeout_ms")) {
+            control.statement_timeout_ms = 0;
+        }
+        control.client_alive = res.alive_check();
+
+        res = export_query(body["query"].s(),
+                           format_name == "csv" ? ExportStream::Format::Csv : ExportStream::Format::Ndjson,
+                           !body.has("header") || body["header"].b(),
+                           compression == "gzip",
+                           control,
+                           body["dbname"].s(), body["user"].s(), body["password"].s(),
+                           body["host"].s(), body["port"].s());
+        res.end();
+    });
+
+    // Import a CSV or NDJSON file into a table. The request body is the file
+    // itself; the target and format are URL parameters and the connection
+    // parameters travel in X-DB-* headers, keeping the password out of URLs
+    // and logs.
+    CROW_ROUTE(app, "/import").methods("POST"_method)([](const crow::request& req) {
+        const char* table_name = req.url_params.get("table");
+        std::string db_name = req.get_header_value("X-DB-Name");
+        std::string db_user = req.get_header_value("X-DB-User");
+        std::string db_pass = req.get_header_value("X-DB-Password");
+        std::string db_host = req.get_header_value("X-DB-Host");
+        std::string db_port = req.get_header_value("X-DB-Port");
+        if (!table_name || db_name.empty() || db_user.empty() || db_host.empty() || db_port.empty()) {
+            return crow::response(400, "Invalid request");
+        }
+
+        const char* schema_name = req.url_params.get("schema");
+        const char* format = req.url_params.get("format");
+        const char* header = req.url_params.get("header");
+        std::string format_name = format ? format : "csv";
+        if (format_name != "csv" && format_name != "ndjson") {
+            return crow::response(400, "Unsupported format");
+        }
+
+        return crow::response(import_table(table_name,
+                                           schema_name ? schema_name : "public",
+                                           format_name,
+                                           !header || std::string(header) != "false",
+                                           req.body,
+                                           db_name, db_user, db_pass, db_host, db_port));
+    });
+
+    // Fetch the next page of a paginated /query.
+    CROW_ROUTE(app, "/query/next").methods("POST"_method)([](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("cursor_id") || !body.has("dbname") ||
+            !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            return crow::response(400, "Invalid request");
+        }
+        if (!valid_request_id(body)) {
+            return crow::response(400, "Invalid request_id");
+        }
+
+        ConnectionKey key = ConnectionPool::makeKey(body["dbname"].s(), body["user"].s(), body["password"].s(),
+                                                    body["host"].s(), body["port"].s());
+        QueryControl control = query_control(body);
+        crow::json::wvalue result_json;
+        try {
+            crow::response res(QueryPager::instance().next(body["cursor_id"].s(), key, control));
+            res.set_header("Content-Type", "application/json");
+            res.set_header("X-Request-Id", control.request_id);
+            return res;
+        } catch (const std::exception &e) {
+            result_json["error"] = e.what();
+        }
+        return crow::response(result_json);
+    });
+
+    // Release a paginated query's cursor before its last page.
+    CROW_ROUTE(app, "/query/close").methods("POST"_method)([](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("cursor_id") || !body.has("dbname") ||
+            !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            return crow::response(400, "Invalid request");
+        }
+
+        ConnectionKey key = ConnectionPool::makeKey(body["dbname"].s(), body["user"].s(), body["password"].s(),
+                                                    body["host"].s(), body["port"].s());
+        crow::json::wvalue result;
+        if (QueryPager::instance().close(body["cursor_id"].s(), key)) {
+            result["status"] = "closed";
+        } else {
+            result["error"] = "Unknown or expired cursor";
+        }
+        return crow::response(result);
+    });
+
+    // Cancel a running query by the request ID it was started with. The
+    // connection parameters must match the ones the query runs under.
+    CROW_ROUTE(app, "/query/cancel").methods("POST"_method)([](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("request_id") || !body.has("dbname") ||
+            !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            return crow::response(400, "Invalid request");
+        }
+        if (!valid_request_id(body)) {
+            return crow::response(400, "Invalid request_id");
+        }
+
+        ConnectionKey key = ConnectionPool::makeKey(body["dbname"].s(), body["user"].s(), body["password"].s(),
+                                                    body["host"].s(), body["port"].s());
+        crow::json::wvalue result;
+        if (QueryRegistry::instance().cancel(body["request_id"].s(), key)) {
+            result["status"] = "cancelled";
+        } else {
+            result["error"] = "No running query with this request_id";
+        }
+        return crow::response(result);
+    });
+
+    // Schema change notifications for the editor page. The page sends its
+    // connection parameters as the first message, so they stay out of the URL.
+    CROW_WEBSOCKET_ROUTE(app, "/schema_events")
+        .onmessage([](crow::websocket::connection& conn, const std::string& data, bool is_binary) {
+            auto body = crow::json::load(data);
+            if (is_binary || !body || !body.has("dbname") || !body.has("user") || !body.has("password") ||
+                !body.has("host") || !body.has("port")) {
+                conn.close("Invalid subscription");
+                return;
+            }
+            SchemaEvents::instance().subscribe(conn, body["dbname"].s(), body["user"].s(), body["password"].s(),
+                                               body["host"].s(), body["port"].s());
+        })
+        .onerror([](crow::websocket::connection& conn, const std::string&) {
+            SchemaEvents::instance().unsubscribe(conn);
+        })
+        .onclose([](crow::websocket::connection& conn, const std::string&) {
+            SchemaEvents::instance().unsubscribe(conn);
+        });
+
+    // Admin step: installs the event trigger the schema cache needs in a
+    // database. Creating it needs a superuser; nothing else installs it.
+    CROW_ROUTE(app, "/schema_cache/install").methods("POST"_method)([](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body || !body.has("dbname") || !body.has("user") || !body.has("password") ||
+            !body.has("host") || !body.has("port")) {
+            return crow::response(400, "Invalid request");
+        }
+        std::string db_name = body["dbname"].s();
+        std::string db_user = body["user"].s();
+        std::string db_pass = body["password"].s();
+        std::string db_host = body["host"].s();
+        std::string db_port = body["port"].s();
+
+        crow::json::wvalue result;
+        try {
+            PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+            SchemaCache::install(*conn);
+            SchemaCache::instance().retry(ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port));
+            result["status"] = "installed";
+        } catch (const std::exception& e) {
+            result["error"] = e.what();
+        }
+        return crow::response(result);
     });
 
      CROW_ROUTE(app, "/tables").methods("POST"_method)([](const crow::request& req) {
         auto body = crow::json::load(req.body);
         if (!body) return crow::response(400, "Invalid request");
 
-        return crow::response(get_tables(
-            body["dbname"].s(),
-            body["user"].s(),
-            body["password"].s(),
-            body["host"].s(),
-            body["port"].s()
-        ));
+        std::string db_name = body["dbname"].s();
+        std::string db_user = body["user"].s();
+        std::string db_pass = body["password"].s();
+        std::string db_host = body["host"].s();
+        std::string db_port = body["port"].s();
+        return cached_schema_response("tables", db_name, db_user, db_pass, db_host, db_port, [&] {
+            return get_tables(db_name, db_user, db_pass, db_host, db_port);
+        });
     });
 
 
@@ -301,15 +1131,14 @@ int main() {
     {
         return crow::response(400, "Invalid request");
     }
-    // Create a Crud instance with the provided DB parameters.
-    Crud crud(
-        body["dbname"].s(),
-        body["user"].s(),
-        body["password"].s(),
-        body["host"].s(),
-        body["port"].s()
-    );
-    return crow::response(crud.getTableDetailsAndStore(body["table_name"].s()));
+    std::string table_name = body["table_name"].s();
+    std::string schema_name = body.has("schema") ? std::string(body["schema"].s()) : "public";
+    std::string db_name = body["dbname"].s();
+    std::string db_user = body["user"].s();
+    std::string db_pass = body["password"].s();
+    std::string db_host = body["host"].s();
+    std::string db_port = body["port"].s();
+    return table_details_response(table_name, schema_name, db_name, db_user, db_pass, db_host, db_port);
 });
 
 
@@ -322,6 +1151,7 @@ int main() {
     }
     return crow::response(update_column_comment(
         body["table_name"].s(),
+        body.has("schema") ? std::string(body["schema"].s()) : "public",
         body["column_name"].s(),
         body["comment"].s(),
         body["dbname"].s(),
@@ -0,0 +1,411 @@
+#ifndef ARROW_IPC_H
+#define ARROW_IPC_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <limits>
+#include <algorithm>
+#include <type_traits>
+#include <stdexcept>
+#include <pqxx/pqxx>
+#include "result_json.h"
+
+namespace arrow_ipc_detail {
+    // Minimal FlatBuffers writer, just enough for Arrow's Message, Schema and
+    // RecordBatch tables. Objects are laid out front to back: a parent is
+    // written first and its offset fields are patched once a child has been
+    // written after it, which keeps every offset pointing forward as the
+    // format requires. All values are little-endian.
+    class FlatBuffer {
+    public:
+        // A table field: an inline scalar of 1, 2, 4 or 8 bytes, or an offset
+        // to patch later.
+        struct Slot {
+            uint16_t id;
+            uint8_t size;
+            uint64_t value;
+        };
+
+        static Slot scalar(uint16_t id, uint8_t size, uint64_t value) { return {id, size, value}; }
+        static Slot offset(uint16_t id) { return {id, 4, 0}; }
+
+        struct Table {
+            size_t pos;
+            std::vector<size_t> slots;  // position of each slot, in the order given
+        };
+
+        FlatBuffer() { put(0, 4); }  // root offset, patched by finish()
+
+        Table table(const std::vector<Slot>& slots) {
+            size_t fields = 0;
+            size_t table_align = 4;
+            for (const Slot& slot : slots) {
+                fields = std::max<size_t>(fields, slot.id + 1);
+                table_align = std::max<size_t>(table_align, slot.size);
+            }
+
+            align(2);
+            size_t vtable = buf_.size();
+            put(4 + 2 * fields, 2);
+            put(0, 2);  // inline table size, patched below
+            for (size_t i = 0; i < fields; ++i) put(0, 2);
+
+            align(table_align);
+            Table table{buf_.size(), {}};
+            put(table.pos - vtable, 4);  // soffset to the vtable, which precedes the table
+            for (const Slot& slot : slots) {
+                align(slot.size);
+                table.slots.push_back(buf_.size());
+                patch(vtable + 4 + 2 * slot.id, buf_.size() - table.pos, 2);
+                put(slot.value, slot.size);
+            }
+            patch(vtable + 2, buf_.size() - table.pos, 2);
+            return table;
+        }
+
+        size_t string(const char* data, size_t size) {
+            align(4);
+            size_t pos = buf_.size();
+            put(size, 4);
+            buf_.append(data, size);
+            buf_ += '\0';
+            return pos;
+        }
+
+        // A vector of n table offsets; returns its position and the position
+        // of each element, to be patched with patchOffset().
+        Table offsetVector(size_t n) {
+            align(4);
+            Table vec{buf_.size(), {}};
+            put(n, 4);
+            for (size_t i = 0; i < n; ++i) {
+                vec.slots.push_back(buf_.size());
+                put(0, 4);
+            }
+            return vec;
+        }
+
+        // A vector of structs made of 64-bit words (FieldNode, Buffer).
+        size_t structVector(const std::vector<int64_t>& words, size_t words_per_struct) {
+            while ((buf_.size() + 4) % 8 != 0) buf_ += '\0';
+            size_t pos = buf_.size();
+            put(words_per_struct ? words.size() / words_per_struct : 0, 4);
+            for (int64_t word : words) put(static_cast<uint64_t>(word), 8);
+            return pos;
+        }
+
+        void patchOffset(size_t at, size_t target) { patch(at, target - at, 4); }
+
+        std::string finish(size_t root) {
+            patchOffset(0, root);
+            align(8);
+            return std::move(buf_);
+        }
+
+    private:
+        void align(size_t n) {
+            while (buf_.size() % n != 0) buf_ += '\0';
+        }
+
+        void put(uint64_t value, size_t size) {
+            for (size_t i = 0; i < size; ++i) buf_ += static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+
+        void patch(size_t at, uint64_t value, size_t size) {
+            for (size_t i = 0; i < size; ++i) buf_[at + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+        }
+
+        std::string buf_;
+    };
+}
+
+// Encodes pqxx results as an Arrow IPC stream: a Schema message, one
+// RecordBatch message per result batch, and the end-of-stream marker.
+// Columns get typed buffers and validity bitmaps based on their type OID;
+// types without a native mapping are sent as UTF-8 text.
+class ArrowIpc {
+public:
+    static constexpr const char* CONTENT_TYPE = "application/vnd.apache.arrow.stream";
+
+    enum class Type { Bool, Int16, Int32, Int64, Float32, Float64, Date32, Utf8 };
+
+    static constexpr pqxx::oid DATEOID = 1082;
+
+    // Dates are parsed as ISO text, so transactions whose results are encoded
+    // here run this first; other DateStyles would turn every date into null.
+    static constexpr const char* SET_DATESTYLE_SQL = "SET LOCAL DateStyle = ISO";
+
+    static Type typeFor(pqxx::oid type) {
+        switch (type) {
+            case ResultJson::BOOLOID: return Type::Bool;
+            case ResultJson::INT2OID: return Type::Int16;
+            case ResultJson::INT4OID: return Type::Int32;
+            case ResultJson::INT8OID: case ResultJson::OIDOID: return Type::Int64;
+            case ResultJson::FLOAT4OID: return Type::Float32;
+            case ResultJson::FLOAT8OID: return Type::Float64;
+            case DATEOID: return Type::Date32;
+            default: return Type::Utf8;  // numeric keeps its precision as text
+        }
+    }
+
+    static std::vector<Type> typesFor(const pqxx::result& res) {
+        std::vector<Type> types(res.columns());
+        for (int j = 0; j < res.columns(); ++j) {
+            types[j] = typeFor(res.column_type(j));
+        }
+        return types;
+    }
+
+    // The whole result as a single-batch stream.
+    static std::string stream(const pqxx::result& res) {
+        std::vector<Type> types = typesFor(res);
+        std::string out;
+        appendSchema(out, res, types);
+        appendRecordBatch(out, res, types);
+        appendEndOfStream(out);
+        return out;
+    }
+
+    static void appendSchema(std::string& out, const pqxx::result& res, const std::vector<Type>& types) {
+        using arrow_ipc_detail::FlatBuffer;
+        FlatBuffer fb;
+        FlatBuffer::Table message = fb.table({
+            FlatBuffer::scalar(0, 2, METADATA_V5),
+            FlatBuffer::scalar(1, 1, HEADER_SCHEMA),
+            FlatBuffer::offset(2),
+            FlatBuffer::scalar(3, 8, 0),
+        });
+        FlatBuffer::Table schema = fb.table({FlatBuffer::offset(1)});  // little-endian by default
+        fb.patchOffset(message.slots[2], schema.pos);
+
+        FlatBuffer::Table fields = fb.offsetVector(types.size());
+        fb.patchOffset(schema.slots[0], fields.pos);
+        for (size_t j = 0; j < types.size(); ++j) {
+            FlatBuffer::Table field = fb.table({
+                FlatBuffer::offset(0),                           // name
+                FlatBuffer::scalar(1, 1, 1),                     // nullable
+                FlatBuffer::scalar(2, 1, typeTag(types[j])),     // type_type
+                FlatBuffer::offset(3),                           // type
+                FlatBuffer::offset(5),                           // children
+            });
+            fb.patchOffset(fields.slots[j], field.pos);
+            const char* name = res.column_name(static_cast<int>(j));
+            fb.patchOffset(field.slots[0], fb.string(name, std::strlen(name)));
+            fb.patchOffset(field.slots[3], typeTable(fb, types[j]));
+            fb.patchOffset(field.slots[4], fb.offsetVector(0).pos);
+        }
+        appendMessage(out, fb.finish(message.pos), std::string());
+    }
+
+    static void appendRecordBatch(std::string& out, const pqxx::result& res, const std::vector<Type>& types) {
+        const size_t rows = res.size();
+        std::string body;
+        std::vector<int64_t> nodes;    // length, null_count per column
+        std::vector<int64_t> buffers;  // offset, length per buffer
+
+        for (size_t j = 0; j < types.size(); ++j) {
+            ColumnBuffers column = encodeColumn(res, static_cast<int>(j), types[j]);
+            nodes.push_back(static_cast<int64_t>(rows));
+            nodes.push_back(static_cast<int64_t>(column.null_count));
+            addBuffer(body, buffers, column.validity);
+            if (types[j] == Type::Utf8) {
+                addBuffer(body, buffers, column.offsets);
+            }
+            addBuffer(body, buffers, column.values);
+        }
+
+        using arrow_ipc_detail::FlatBuffer;
+        FlatBuffer fb;
+        FlatBuffer::Table message = fb.table({
+            FlatBuffer::scalar(0, 2, METADATA_V5),
+            FlatBuffer::scalar(1, 1, HEADER_RECORD_BATCH),
+            FlatBuffer::offset(2),
+            FlatBuffer::scalar(3, 8, body.size()),
+        });
+        FlatBuffer::Table batch = fb.table({
+            FlatBuffer::scalar(0, 8, rows),
+            FlatBuffer::offset(1),
+            FlatBuffer::offset(2),
+        });
+        fb.patchOffset(message.slots[2], batch.pos);
+        fb.patchOffset(batch.slots[1], fb.structVector(nodes, 2));
+        fb.patchOffset(batch.slots[2], fb.structVector(buffers, 2));
+        appendMessage(out, fb.finish(message.pos), body);
+    }
+
+    static void appendEndOfStream(std::string& out) {
+        appendInt32(out, CONTINUATION);
+        appendInt32(out, 0);
+    }
+
+private:
+    static constexpr uint64_t METADATA_V5 = 4;
+    static constexpr uint64_t HEADER_SCHEMA = 1;
+    static constexpr uint64_t HEADER_RECORD_BATCH = 3;
+    static constexpr uint32_t CONTINUATION = 0xffffffff;
+
+    struct ColumnBuffers {
+        std::string validity;
+        std::string offsets;  // Utf8 only
+        std::string values;
+        size_t null_count = 0;
+    };
+
+    // Type union tags from Schema.fbs.
+    static uint64_t typeTag(Type type) {
+        switch (type) {
+            case Type::Int16: case Type::Int32: case Type::Int64: return 2;
+            case Type::Float32: case Type::Float64: return 3;
+            case Type::Utf8: return 5;
+            case Type::Bool: return 6;
+            case Type::Date32: return 8;
+        }
+        return 5;
+    }
+
+    static size_t typeTable(arrow_ipc_detail::FlatBuffer& fb, Type type) {
+        using arrow_ipc_detail::FlatBuffer;
+        switch (type) {
+            case Type::Int16: return fb.table({FlatBuffer::scalar(0, 4, 16), FlatBuffer::scalar(1, 1, 1)}).pos;
+            case Type::Int32: return fb.table({FlatBuffer::scalar(0, 4, 32), FlatBuffer::scalar(1, 1, 1)}).pos;
+            case Type::Int64: return fb.table({FlatBuffer::scalar(0, 4, 64), FlatBuffer::scalar(1, 1, 1)}).pos;
+            case Type::Float32: return fb.table({FlatBuffer::scalar(0, 2, 1)}).pos;  // SINGLE
+            case Type::Float64: return fb.table({FlatBuffer::scalar(0, 2, 2)}).pos;  // DOUBLE
+            case Type::Date32: return fb.table({FlatBuffer::scalar(0, 2, 0)}).pos;   // DAY
+            case Type::Bool: case Type::Utf8: break;
+        }
+        return fb.table({}).pos;
+    }
+
+    static ColumnBuffers encodeColumn(const pqxx::result& res, int column, Type type) {
+        const size_t rows = res.size();
+        ColumnBuffers out;
+        out.validity.assign((rows + 7) / 8, '\0');
+        if (type == Type::Bool) {
+            out.values.assign((rows + 7) / 8, '\0');
+        } else if (type == Type::Utf8) {
+            out.offsets.reserve((rows + 1) * 4);
+            appendInt32(out.offsets, 0);
+        }
+
+        for (size_t i = 0; i < rows; ++i) {
+            const pqxx::field field = res[static_cast<int>(i)][column];
+            const char* data = field.is_null() ? nullptr : field.c_str();
+            const size_t size = data ? field.size() : 0;
+            bool valid = data != nullptr;
+
+            switch (type) {
+                case Type::Bool:
+                    if (valid && data[0] == 't') setBit(out.values, i);
+                    break;
+                case Type::Int16: valid = appendParsed<int16_t>(out.values, data, size) && valid; break;
+                case Type::Int32: valid = appendParsed<int32_t>(out.values, data, size) && valid; break;
+                case Type::Int64: valid = appendParsed<int64_t>(out.values, data, size) && valid; break;
+                case Type::Float32: valid = appendParsed<float>(out.values, data, size) && valid; break;
+                case Type::Float64: valid = appendParsed<double>(out.values, data, size) && valid; break;
+                case Type::Date32: {
+                    int32_t days = 0;
+                    valid = valid && parseDate(data, size, days);
+                    appendRaw(out.values, days);
+                    break;
+                }
+                case Type::Utf8:
+                    out.values.append(data ? data : "", size);
+                    if (out.values.size() > INT32_MAX) {
+                        throw std::runtime_error("Arrow batch exceeds 2 GiB of text; use a smaller batch_size");
+                    }
+                    appendInt32(out.offsets, static_cast<uint32_t>(out.values.size()));
+                    break;
+            }
+
+            if (valid) {
+                setBit(out.validity, i);
+            } else {
+                ++out.null_count;
+            }
+        }
+        return out;
+    }
+
+    // Appends the parsed value, or zero when the field is NULL or does not
+    // parse; returns false in that case so the caller marks the slot null.
+    template <typename T>
+    static bool appendParsed(std::string& out, const char* data, size_t size) {
+        T value{};
+        bool parsed = data != nullptr && parseNumber(data, size, value);
+        appendRaw(out, parsed ? value : T{});
+        return parsed;
+    }
+
+    template <typename T>
+    static bool parseNumber(const char* data, size_t size, T& value) {
+        if constexpr (std::is_floating_point_v<T>) {
+            // PostgreSQL spells the special values NaN, Infinity and -Infinity.
+            if (size > 0 && (data[0] == 'N' || data[0] == 'I' || (data[0] == '-' && size > 1 && data[1] == 'I'))) {
+                value = data[0] == 'N' ? std::numeric_limits<T>::quiet_NaN()
+                      : data[0] == '-' ? -std::numeric_limits<T>::infinity()
+                                       : std::numeric_limits<T>::infinity();
+                return true;
+            }
+        }
+        auto [end, ec] = std::from_chars(data, data + size, value);
+        return ec == std::errc() && end == data + size;
+    }
+
+    // Days since 1970-01-01 for "YYYY-MM-DD". Dates before year 1 ("... BC")
+    // and +/-infinity have no Date32 value here and come out as null.
+    static bool parseDate(const char* data, size_t size, int32_t& days) {
+        int y = 0, m = 0, d = 0;
+        if (size != 10 || data[4] != '-' || data[7] != '-' ||
+            std::from_chars(data, data + 4, y).ptr != data + 4 ||
+            std::from_chars(data + 5, data + 7, m).ptr != data + 7 ||
+            std::from_chars(data + 8, data + 10, d).ptr != data + 10) {
+            return false;
+        }
+        // Howard Hinnant's days_from_civil.
+        y -= m <= 2;
+        const int era = y / 400;
+        const int yoe = y - era * 400;
+        const int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+        const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        days = era * 146097 + doe - 719468;
+        return true;
+    }
+
+    template <typename T>
+    static void appendRaw(std::string& out, T value) {
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));  // Arrow buffers are little-endian, as is the host
+        out.append(bytes, sizeof(T));
+    }
+
+    static void appendInt32(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) out += static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+
+    static void setBit(std::string& bitmap, size_t i) {
+        bitmap[i / 8] = static_cast<char>(bitmap[i / 8] | (1 << (i % 8)));
+    }
+
+    // Appends a buffer to the body at the next 8-byte boundary.
+    static void addBuffer(std::string& body, std::vector<int64_t>& buffers, const std::string& data) {
+        buffers.push_back(static_cast<int64_t>(body.size()));
+        buffers.push_back(static_cast<int64_t>(data.size()));
+        body += data;
+        body.append((8 - body.size() % 8) % 8, '\0');
+    }
+
+    // Encapsulated message: continuation marker, metadata length, metadata
+    // padded to 8 bytes, then the body.
+    static void appendMessage(std::string& out, const std::string& metadata, const std::string& body) {
+        appendInt32(out, CONTINUATION);
+        appendInt32(out, static_cast<uint32_t>(metadata.size()));
+        out += metadata;
+        out += body;
+    }
+};
+
+#endif // ARROW_IPC_H
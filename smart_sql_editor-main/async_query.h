@@ -0,0 +1,209 @@
+#ifndef ASYNC_QUERY_H
+#define ASYNC_QUERY_H
+
+#include <string>
+#include <memory>
+#include <optional>
+#include <chrono>
+#include <functional>
+#include <pqxx/pqxx>
+#include "crow_all.h"
+#include "connection_pool.h"
+#include "result_json.h"
+#include "query_registry.h"
+#include "read_replicas.h"
+#include "sql_lexer.h"
+#include "sql_classifier.h"
+
+// Runs one statement without holding a Crow worker thread while PostgreSQL
+// works on it. The statement is sent through a pqxx::pipeline, which issues
+// it with libpq's asynchronous API, and the connection's socket is watched by
+// the request's io_service; results are collected when it becomes readable.
+// Completion is delivered on that io_service.
+class AsyncQuery : public std::enable_shared_from_this<AsyncQuery> {
+public:
+    using Completion = std::function<void(crow::response)>;
+
+    // How long to wait between attempts when the pool has no free connection.
+    static constexpr std::chrono::milliseconds CHECKOUT_RETRY{5};
+
+    // Whether start() takes the text: exactly one statement. The pipeline
+    // expects one result per query it sends, which a script would break.
+    static bool accepts(const std::string& query) {
+        return SqlLexer::splitStatements(query).size() == 1;
+    }
+
+    // Starts the query and returns immediately; done is called exactly once.
+    // Texts accepts() refuses are answered with an error.
+    static void start(asio::io_service& io,
+                      std::string query,
+                      std::string db_name,
+                      std::string db_user,
+                      std::string db_pass,
+                      std::string db_host,
+                      std::string db_port,
+                      QueryControl control,
+                      Completion done) {
+        if (!accepts(query)) {
+            crow::json::wvalue result_json;
+            result_json["error"] = "Async queries take exactly one statement";
+            crow::response response(result_json);
+            response.set_header("X-Request-Id", control.request_id);
+            done(std::move(response));
+            return;
+        }
+        std::shared_ptr<AsyncQuery> self(new AsyncQuery(io, std::move(query), std::move(done)));
+        self->control_ = std::move(control);
+        self->db_name_ = std::move(db_name);
+        self->db_user_ = std::move(db_user);
+        self->db_pass_ = std::move(db_pass);
+        self->db_host_ = std::move(db_host);
+        self->db_port_ = std::move(db_port);
+        self->checkout_deadline_ = std::chrono::steady_clock::now() +
+                                   ConnectionPool::instance().options().checkout_timeout;
+        self->checkout();
+    }
+
+    ~AsyncQuery() {
+        // The descriptor only borrows libpq's socket; libpq closes it.
+        if (socket_ && socket_->is_open()) {
+            socket_->release();
+        }
+    }
+
+private:
+    AsyncQuery(asio::io_service& io, std::string query, Completion done)
+        : io_(io), retry_timer_(io), query_(std::move(query)), done_(std::move(done)) {}
+
+    // Takes a pooled connection without blocking; retries on a timer while
+    // the pool is exhausted, up to the pool's checkout_timeout.
+    void checkout() {
+        try {
+            std::optional<PooledConnection> conn =
+                ConnectionPool::instance().tryAcquire(db_name_, db_user_, db_pass_, db_host_, db_port_);
+            if (!conn) {
+                if (std::chrono::steady_clock::now() >= checkout_deadline_) {
+                    throw std::runtime_error("Timed out waiting for a database connection");
+                }
+                auto self = shared_from_this();
+                retry_timer_.expires_after(CHECKOUT_RETRY);
+                retry_timer_.async_wait([self](const asio::error_code& ec) {
+                    if (!ec) self->checkout();
+                });
+                return;
+            }
+            conn_.emplace(std::move(*conn));
+            send();
+        } catch (const std::exception& e) {
+            fail(e.what());
+        }
+    }
+
+    void send() {
+        conn_->mark_dirty();  // arbitrary user SQL may change session state
+        registration_ = QueryRegistry::instance().add(
+            control_, ConnectionPool::makeKey(db_name_, db_user_, db_pass_, db_host_, db_port_), **conn_);
+        // Autocommit, so finishing does not need another round trip for COMMIT.
+        // The timeout is set for the session; releasing the connection resets it.
+        txn_.emplace(**conn_);
+        pipeline_.emplace(*txn_);
+        pipeline_->retain(0);
+        pipeline_->insert(control_.setTimeoutSql());
+        query_id_ = pipeline_->insert(query_);
+        // A write's WAL position makes later reads with these credentials
+        // wait for the replicas, as execute_query does.
+        if (!SqlClassifier::isReadOnly(query_) && ReadReplicas::instance().hasReplicas(db_host_, db_port_)) {
+            lsn_id_ = pipeline_->insert("SELECT pg_current_wal_lsn()::text");
+        }
+        pipeline_->resume();
+
+        socket_.emplace(io_, (*conn_)->sock());
+        poll();
+    }
+
+    // Collects the result if it is complete, otherwise waits for the socket.
+    void poll() {
+        try {
+            pipeline_->resume();
+            // A failed statement throws here, and its LSN is never read.
+            if (!result_ && pipeline_->is_finished(query_id_)) {
+                result_ = pipeline_->retrieve(query_id_);
+            }
+            if (result_ && lsn_id_ && pipeline_->is_finished(*lsn_id_)) {
+                pqxx::result lsn = pipeline_->retrieve(*lsn_id_);
+                ReadReplicas::instance().noteWrite(
+                    ConnectionPool::makeKey(db_name_, db_user_, db_pass_, db_host_, db_port_),
+                    ReadReplicas::parseLsn(lsn[0][0].c_str()));
+                lsn_id_.reset();
+            }
+            if (result_ && !lsn_id_) {
+                crow::response response(ResultJson::document(*result_));
+                response.set_header("Content-Type", "application/json");
+                finish(std::move(response));
+                return;
+            }
+        } catch (const std::exception& e) {
+            fail(e.what());
+            return;
+        }
+
+        auto self = shared_from_this();
+        socket_->async_wait(asio::posix::stream_descriptor::wait_read,
+                            [self](const asio::error_code& ec) {
+                                if (ec) {
+                                    self->fail(ec.message());
+                                } else {
+                                    self->poll();
+                                }
+                            });
+    }
+
+    void fail(const std::string& message) {
+        crow::json::wvalue result_json;
+        result_json["error"] = message;
+        finish(crow::response(result_json));
+    }
+
+    void finish(crow::response response) {
+        if (!done_) {
+            return;
+        }
+        // Hand the connection back before the response is written. The
+        // registration goes first: the client check refers to the response.
+        registration_ = QueryRegistry::Registration();
+        response.set_header("X-Request-Id", control_.request_id);
+        pipeline_.reset();
+        txn_.reset();
+        if (socket_ && socket_->is_open()) {
+            socket_->release();
+        }
+        conn_.reset();
+
+        Completion done = std::move(done_);
+        done_ = nullptr;
+        done(std::move(response));
+    }
+
+    asio::io_service& io_;
+    asio::steady_timer retry_timer_;
+    std::string query_;
+    Completion done_;
+    std::string db_name_;
+    std::string db_user_;
+    std::string db_pass_;
+    std::string db_host_;
+    std::string db_port_;
+    std::chrono::steady_clock::time_point checkout_deadline_;
+    QueryControl control_;
+
+    std::optional<PooledConnection> conn_;
+    std::optional<pqxx::nontransaction> txn_;
+    std::optional<pqxx::pipeline> pipeline_;
+    QueryRegistry::Registration registration_;
+    std::optional<asio::posix::stream_descriptor> socket_;
+    pqxx::pipeline::query_id query_id_ = 0;
+    std::optional<pqxx::pipeline::query_id> lsn_id_;  // pending WAL position after a write
+    std::optional<pqxx::result> result_;
+};
+
+#endif // ASYNC_QUERY_H
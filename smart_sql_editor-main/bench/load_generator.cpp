@@ -0,0 +1,409 @@
+// End-to-end load generator for the API server.
+//
+// Keeps --concurrency keep-alive connections busy with one endpoint for
+// --duration seconds, after --warmup seconds that are not counted, and
+// reports throughput and latency percentiles. Every worker waits for a
+// response before sending the next request, so this measures a closed
+// system: latency includes the queueing the server does.
+//
+//   ./load_generator --endpoint query --query "SELECT * FROM rows_100000" --concurrency 32
+//   ./load_generator --endpoint table_details --db bench_10k --tables 10000
+
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "crow_all.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::string api_host = "127.0.0.1";
+    std::string api_port = "9999";
+    std::string pg_host = "127.0.0.1";
+    std::string pg_port = "55432";
+    std::string pg_user = "postgres";
+    std::string pg_password = "";
+    std::string db = "bench_1k";
+    std::string endpoint = "query";
+    std::string query = "SELECT * FROM rows_1000";
+    std::string format = "json";
+    bool stream = false;     // /query streams the JSON result instead of buffering it
+    std::string table = "";  // table_details; empty picks t_NNNNN at random
+    int tables = 1000;       // how many t_NNNNN tables the database has
+    int concurrency = 8;
+    double duration = 10;
+    double warmup = 2;
+};
+
+void usage() {
+    std::cerr <<
+        "usage: load_generator [options]\n"
+        "  --api HOST:PORT        API server (127.0.0.1:9999)\n"
+        "  --pg-host HOST         PostgreSQL host the API connects to (127.0.0.1)\n"
+        "  --pg-port PORT         (55432)\n"
+        "  --pg-user USER         (postgres)\n"
+        "  --pg-password PASS     ('')\n"
+        "  --db NAME              database (bench_1k)\n"
+        "  --endpoint NAME        query | tables | table_details (query)\n"
+        "  --query SQL            statement for /query (SELECT * FROM rows_1000)\n"
+        "  --format json|arrow    result format for /query (json)\n"
+        "  --stream 0|1           stream the JSON result of /query (0)\n"
+        "  --table NAME           table for /table_details (random t_NNNNN)\n"
+        "  --tables N             tables to pick from (1000)\n"
+        "  --concurrency N        connections, one request in flight each (8)\n"
+        "  --duration SECONDS     measured time (10)\n"
+        "  --warmup SECONDS       unmeasured time before it (2)\n";
+}
+
+Options parseOptions(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            usage();
+            std::exit(0);
+        }
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for " + arg);
+        }
+        std::string value = argv[++i];
+        if (arg == "--api") {
+            size_t colon = value.rfind(':');
+            if (colon == std::string::npos) {
+                throw std::invalid_argument("--api takes HOST:PORT");
+            }
+            options.api_host = value.substr(0, colon);
+            options.api_port = value.substr(colon + 1);
+        } else if (arg == "--pg-host") {
+            options.pg_host = value;
+        } else if (arg == "--pg-port") {
+            options.pg_port = value;
+        } else if (arg == "--pg-user") {
+            options.pg_user = value;
+        } else if (arg == "--pg-password") {
+            options.pg_password = value;
+        } else if (arg == "--db") {
+            options.db = value;
+        } else if (arg == "--endpoint") {
+            options.endpoint = value;
+        } else if (arg == "--query") {
+            options.query = value;
+        } else if (arg == "--format") {
+            options.format = value;
+        } else if (arg == "--stream") {
+            options.stream = value == "1";
+        } else if (arg == "--table") {
+            options.table = value;
+        } else if (arg == "--tables") {
+            options.tables = std::stoi(value);
+        } else if (arg == "--concurrency") {
+            options.concurrency = std::stoi(value);
+        } else if (arg == "--duration") {
+            options.duration = std::stod(value);
+        } else if (arg == "--warmup") {
+            options.warmup = std::stod(value);
+        } else {
+            throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    if (options.endpoint != "query" && options.endpoint != "tables" && options.endpoint != "table_details") {
+        throw std::invalid_argument("Unknown endpoint " + options.endpoint);
+    }
+    if (options.concurrency < 1 || options.tables < 1) {
+        throw std::invalid_argument("--concurrency and --tables must be positive");
+    }
+    return options;
+}
+
+// The JSON body of the next request.
+std::string requestBody(const Options& options, std::mt19937& random) {
+    crow::json::wvalue body;
+    body["dbname"] = options.db;
+    body["user"] = options.pg_user;
+    body["password"] = options.pg_password;
+    body["host"] = options.pg_host;
+    body["port"] = options.pg_port;
+    if (options.endpoint == "query") {
+        body["query"] = options.query;
+        body["format"] = options.format;
+        if (options.stream) {
+            body["stream"] = true;
+        }
+    } else if (options.endpoint == "table_details") {
+        if (!options.table.empty()) {
+            body["table_name"] = options.table;
+        } else {
+            char name[16];
+            std::snprintf(name, sizeof(name), "t_%05d",
+                          std::uniform_int_distribution<int>(1, options.tables)(random));
+            body["table_name"] = name;
+        }
+    }
+    return body.dump();
+}
+
+// One keep-alive HTTP/1.1 connection, used by one worker at a time.
+class HttpConnection {
+public:
+    HttpConnection(const std::string& host, const std::string& port)
+        : host_(host), port_(port), socket_(io_) {}
+
+    // Sends a POST and reads the whole response; returns its status and adds
+    // the body size to bytes. error_body is set when the body is an API error
+    // object, which the endpoints answer with status 200. Reconnects when the
+    // server closed the connection.
+    int post(const std::string& target, const std::string& body, uint64_t& bytes, bool& error_body) {
+        if (!socket_.is_open()) {
+            connect();
+        }
+        std::string request = "POST " + target + " HTTP/1.1\r\n"
+                               "Host: " + host_ + "\r\n"
+                               "Content-Type: application/json\r\n"
+                               "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                               "\r\n" + body;
+        asio::error_code error;
+        asio::write(socket_, asio::buffer(request), error);
+        if (error) {
+            // The server may have dropped an idle keep-alive connection.
+            reconnect();
+            asio::write(socket_, asio::buffer(request));
+        }
+        return readResponse(bytes, error_body);
+    }
+
+    // Drops the connection, e.g. after a response could not be read; the
+    // next post() opens a new one.
+    void reset() {
+        asio::error_code ignored;
+        socket_.close(ignored);
+        buffer_.clear();
+    }
+
+private:
+    void connect() {
+        asio::ip::tcp::resolver resolver(io_);
+        asio::connect(socket_, resolver.resolve(host_, port_));
+        socket_.set_option(asio::ip::tcp::no_delay(true));
+        buffer_.clear();
+    }
+
+    void reconnect() {
+        reset();
+        connect();
+    }
+
+    // Reads into buffer_ until it holds at least size bytes.
+    void fill(size_t size) {
+        char chunk[65536];
+        while (buffer_.size() < size) {
+            size_t n = socket_.read_some(asio::buffer(chunk));
+            buffer_.append(chunk, n);
+        }
+    }
+
+    // Reads up to and including the next CRLF and returns the line without it.
+    std::string readLine() {
+        size_t end;
+        char chunk[65536];
+        while ((end = buffer_.find("\r\n")) == std::string::npos) {
+            size_t n = socket_.read_some(asio::buffer(chunk));
+            buffer_.append(chunk, n);
+        }
+        std::string line = buffer_.substr(0, end);
+        buffer_.erase(0, end + 2);
+        return line;
+    }
+
+    void skip(size_t size) {
+        fill(size);
+        buffer_.erase(0, size);
+    }
+
+    // Whether the body part of the given size that starts buffer_ begins
+    // with the API's error object.
+    bool startsWithError(size_t size) {
+        static const std::string ERROR_PREFIX = "{\"error\"";
+        if (size < ERROR_PREFIX.size()) {
+            return false;
+        }
+        fill(ERROR_PREFIX.size());
+        return buffer_.compare(0, ERROR_PREFIX.size(), ERROR_PREFIX) == 0;
+    }
+
+    int readResponse(uint64_t& bytes, bool& error_body) {
+        std::string status_line = readLine();
+        size_t space = status_line.find(' ');
+        if (status_line.compare(0, 5, "HTTP/") != 0 || space == std::string::npos) {
+            throw std::runtime_error("Malformed status line: " + status_line);
+        }
+        int status = std::atoi(status_line.c_str() + space + 1);
+
+        size_t content_length = 0;
+        bool chunked = false;
+        bool close = false;
+        for (std::string line = readLine(); !line.empty(); line = readLine()) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = line.substr(0, colon);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            std::string value = line.substr(colon + 1);
+            value.erase(0, value.find_first_not_of(' '));
+            if (name == "content-length") {
+                content_length = std::stoull(value);
+            } else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos) {
+                chunked = true;
+            } else if (name == "connection" && value.find("close") != std::string::npos) {
+                close = true;
+            }
+        }
+
+        error_body = false;
+        if (chunked) {
+            for (bool first = true;; first = false) {
+                size_t size = std::stoull(readLine(), nullptr, 16);
+                if (first) {
+                    error_body = startsWithError(size);
+                }
+                if (size == 0) {
+                    // Trailers end with an empty line.
+                    while (!readLine().empty()) {
+                    }
+                    break;
+                }
+                skip(size);
+                readLine();
+                bytes += size;
+            }
+        } else {
+            error_body = startsWithError(content_length);
+            skip(content_length);
+            bytes += content_length;
+        }
+
+        if (close) {
+            reset();
+        }
+        return status;
+    }
+
+    std::string host_;
+    std::string port_;
+    asio::io_context io_;
+    asio::ip::tcp::socket socket_;
+    std::string buffer_;  // read but not yet consumed
+};
+
+struct WorkerStats {
+    std::vector<double> latencies_ms;
+    uint64_t requests = 0;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    std::string last_error;
+};
+
+void work(const Options& options, unsigned seed, Clock::time_point measure_from, Clock::time_point until,
+          WorkerStats& stats) {
+    std::mt19937 random(seed);
+    HttpConnection connection(options.api_host, options.api_port);
+    const std::string target = "/" + options.endpoint;
+    while (Clock::now() < until) {
+        std::string body = requestBody(options, random);
+        uint64_t bytes = 0;
+        bool failed = false;
+        auto started = Clock::now();
+        try {
+            bool error_body = false;
+            failed = connection.post(target, body, bytes, error_body) != 200 || error_body;
+        } catch (const std::exception& e) {
+            failed = true;
+            stats.last_error = e.what();
+            connection.reset();
+        }
+        auto finished = Clock::now();
+        if (started < measure_from) {
+            continue;
+        }
+        ++stats.requests;
+        stats.bytes += bytes;
+        if (failed) {
+            ++stats.errors;
+        }
+        stats.latencies_ms.push_back(std::chrono::duration<double, std::milli>(finished - started).count());
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1));
+    return sorted[rank];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        usage();
+        return 2;
+    }
+
+    auto start = Clock::now();
+    auto measure_from = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup));
+    auto until = measure_from + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+
+    std::vector<WorkerStats> stats(static_cast<size_t>(options.concurrency));
+    std::vector<std::thread> workers;
+    for (int i = 0; i < options.concurrency; ++i) {
+        workers.emplace_back(work, std::cref(options), static_cast<unsigned>(i + 1), measure_from, until,
+                             std::ref(stats[static_cast<size_t>(i)]));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - measure_from).count();
+
+    WorkerStats total;
+    for (WorkerStats& worker : stats) {
+        total.requests += worker.requests;
+        total.errors += worker.errors;
+        total.bytes += worker.bytes;
+        total.latencies_ms.insert(total.latencies_ms.end(), worker.latencies_ms.begin(), worker.latencies_ms.end());
+        if (!worker.last_error.empty()) {
+            total.last_error = worker.last_error;
+        }
+    }
+    std::sort(total.latencies_ms.begin(), total.latencies_ms.end());
+
+    std::printf("endpoint     /%s (%s, %d connections, %.1fs)\n", options.endpoint.c_str(), options.db.c_str(),
+                options.concurrency, elapsed);
+    std::printf("requests     %llu (%llu errors)\n", static_cast<unsigned long long>(total.requests),
+                static_cast<unsigned long long>(total.errors));
+    std::printf("throughput   %.1f req/s, %.2f MB/s\n", static_cast<double>(total.requests) / elapsed,
+                static_cast<double>(total.bytes) / elapsed / 1e6);
+    std::printf("latency ms   p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+                percentile(total.latencies_ms, 0.5), percentile(total.latencies_ms, 0.9),
+                percentile(total.latencies_ms, 0.99), percentile(total.latencies_ms, 0.999),
+                total.latencies_ms.empty() ? 0 : total.latencies_ms.back());
+    if (!total.last_error.empty()) {
+        std::printf("last error   %s\n", total.last_error.c_str());
+    }
+    return total.errors == 0 ? 0 : 1;
+}
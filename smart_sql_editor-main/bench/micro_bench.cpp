@@ -0,0 +1,322 @@
+// Microbenchmarks of the code on the request path.
+//
+// Benchmarks that need a database read its connection string from
+// SQL_EDITOR_BENCH_DSN, e.g. the one pg_fixture.sh prints, and are skipped
+// without it:
+//   SQL_EDITOR_BENCH_DSN="dbname=bench_1k user=postgres host=127.0.0.1 port=55432" ./micro_bench
+
+#include <benchmark/benchmark.h>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <pqxx/pqxx>
+#include "crow_all.h"
+#include "interface.h"
+#include "jwt_auth.h"
+#include "result_json.h"
+#include "arrow_ipc.h"
+#include "prepared_statements.h"
+#include "static_page.h"
+#include "sql_lexer.h"
+
+namespace {
+
+// A connection to the benchmark database, opened once; null without one.
+pqxx::connection* benchConnection() {
+    static std::unique_ptr<pqxx::connection> conn = []() -> std::unique_ptr<pqxx::connection> {
+        const char* dsn = std::getenv("SQL_EDITOR_BENCH_DSN");
+        if (dsn == nullptr) {
+            return nullptr;
+        }
+        auto conn = std::make_unique<pqxx::connection>(dsn);
+        PreparedStatements::prepareAll(*conn);
+        pqxx::work txn(*conn);
+        txn.exec(
+            "CREATE TABLE IF NOT EXISTS bench_details ("
+            "    id bigint PRIMARY KEY, "
+            "    name varchar(200) NOT NULL DEFAULT '', "
+            "    amount numeric(12, 2), "
+            "    created_at timestamptz DEFAULT now(), "
+            "    payload jsonb)");
+        txn.exec("COMMENT ON TABLE bench_details IS 'Table details benchmark'");
+        txn.exec("COMMENT ON COLUMN bench_details.name IS 'Display name'");
+        txn.commit();
+        return conn;
+    }();
+    return conn.get();
+}
+
+// A result of state.range(0) rows of mixed column types, the shape of a
+// typical SELECT from the editor.
+pqxx::result sampleResult(benchmark::State& state) {
+    pqxx::work txn(*benchConnection());
+    return txn.exec(
+        "SELECT i AS id, 'name ' || i AS name, i * 1.5 AS amount, i % 2 = 0 AS flag, "
+        "       now() AS created_at, CASE WHEN i % 10 = 0 THEN NULL ELSE md5(i::text) END AS note "
+        "FROM generate_series(1, " + std::to_string(state.range(0)) + ") AS i");
+}
+
+#define REQUIRE_DATABASE(state)                                          \
+    if (benchConnection() == nullptr) {                                  \
+        (state).SkipWithError("SQL_EDITOR_BENCH_DSN is not set");        \
+        return;                                                          \
+    }
+
+// execute_query as it was before results were written straight to JSON:
+// a wvalue of rows of strings, then dumped.
+std::string legacyDocument(const pqxx::result& res) {
+    crow::json::wvalue result_json;
+    crow::json::wvalue::list columns;
+    for (size_t j = 0; j < res.columns(); ++j) {
+        columns.push_back(res.column_name(j));
+    }
+    result_json["columns"] = std::move(columns);
+
+    crow::json::wvalue::list rows;
+    for (size_t i = 0; i < res.size(); ++i) {
+        crow::json::wvalue::list row;
+        for (size_t j = 0; j < res.columns(); ++j) {
+            row.push_back(res[i][static_cast<int>(j)].is_null() ? "NULL" :
+                          std::string(res[i][static_cast<int>(j)].c_str()));
+        }
+        rows.push_back(std::move(row));
+    }
+    result_json["rows"] = std::move(rows);
+    result_json["status"] = "success";
+    return result_json.dump();
+}
+
+void BM_ExecuteQueryLegacyWvalue(benchmark::State& state) {
+    REQUIRE_DATABASE(state);
+    pqxx::result res = sampleResult(state);
+    for (auto _ : state) {
+        std::string body = legacyDocument(res);
+        benchmark::DoNotOptimize(body.data());
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(body.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExecuteQueryLegacyWvalue)->RangeMultiplier(10)->Range(10, 100000);
+
+void BM_ExecuteQueryJson(benchmark::State& state) {
+    REQUIRE_DATABASE(state);
+    pqxx::result res = sampleResult(state);
+    for (auto _ : state) {
+        std::string body = ResultJson::document(res);
+        benchmark::DoNotOptimize(body.data());
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(body.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExecuteQueryJson)->RangeMultiplier(10)->Range(10, 100000);
+
+void BM_ExecuteQueryArrow(benchmark::State& state) {
+    REQUIRE_DATABASE(state);
+    pqxx::result res = sampleResult(state);
+    for (auto _ : state) {
+        std::string body = ArrowIpc::stream(res);
+        benchmark::DoNotOptimize(body.data());
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(body.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ExecuteQueryArrow)->RangeMultiplier(10)->Range(10, 100000);
+
+// The shape of a get_table_details response with state.range(0) columns.
+crow::json::wvalue tableDetails(int64_t column_count) {
+    crow::json::wvalue result;
+    crow::json::wvalue::list columns;
+    for (int64_t i = 0; i < column_count; ++i) {
+        crow::json::wvalue column;
+        column["name"] = "column_" + std::to_string(i);
+        column["type"] = "character varying";
+        column["max_length"] = 200;
+        column["nullable"] = "YES";
+        column["default"] = "NULL";
+        column["position"] = i + 1;
+        column["is_primary_key"] = i == 0;
+        column["comment"] = "Column \"" + std::to_string(i) + "\" of the table";
+        columns.push_back(std::move(column));
+    }
+    result["primary_key_name"] = "column_0";
+    result["columns"] = std::move(columns);
+    result["column_count"] = column_count;
+    result["table_comment"] = "A table";
+    result["status"] = "success";
+    return result;
+}
+
+void BM_WvalueDump(benchmark::State& state) {
+    crow::json::wvalue details = tableDetails(state.range(0));
+    for (auto _ : state) {
+        std::string body = details.dump();
+        benchmark::DoNotOptimize(body.data());
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(body.size()));
+    }
+}
+BENCHMARK(BM_WvalueDump)->RangeMultiplier(8)->Range(8, 512);
+
+// The editor page as /connect serves it; the argument is 1 when the client
+// accepts gzip.
+void BM_EditorPage(benchmark::State& state) {
+    static const PageTemplate editor(Interface::getEditorTemplate(), Interface::DB_PARAMS_PLACEHOLDER, "text/html");
+    crow::json::wvalue db_params;
+    db_params["dbname"] = "bench_1k";
+    db_params["user"] = "postgres";
+    db_params["password"] = "secret";
+    db_params["host"] = "127.0.0.1";
+    db_params["port"] = "55432";
+    crow::request req;
+    if (state.range(0) != 0) {
+        req.add_header("Accept-Encoding", "gzip, deflate");
+    }
+    for (auto _ : state) {
+        crow::response res = editor.respond(req, Interface::dbParamsScript(db_params));
+        benchmark::DoNotOptimize(res.body.data());
+        state.SetBytesProcessed(state.bytes_processed() + static_cast<int64_t>(res.body.size()));
+    }
+}
+BENCHMARK(BM_EditorPage)->Arg(0)->Arg(1);
+
+// Logs in through JWTAuth::login, running its completion on a private
+// io_context as Crow would on the connection's.
+crow::response logIn(JWTAuth& auth, const std::string& username, const std::string& password) {
+    asio::io_context io;
+    auto work = asio::make_work_guard(io);
+    crow::request req;
+    req.io_service = &io;
+    req.body = "{\"username\":\"" + username + "\",\"password\":\"" + password + "\"}";
+    crow::response res;
+    auth.login(req, res);
+    while (!res.is_completed()) {
+        io.run_one();
+    }
+    return res;
+}
+
+// An in-memory credential store with the one account the benchmarks log in
+// with; nothing is written to the working directory.
+JWTAuth& benchAuth() {
+    static JWTAuth auth(CredentialStore::fromHashes({{"admin", PasswordHash::hash("password123")}}));
+    return auth;
+}
+
+// validate_jwt is private; protect_route is the path every request takes
+// through it, cookie parsing and refresh check included.
+void BM_ValidateJwt(benchmark::State& state) {
+    crow::response logged_in = logIn(benchAuth(), "admin", "password123");
+    std::string cookie = logged_in.get_header_value("Set-Cookie");
+    cookie = cookie.substr(0, cookie.find(';'));
+
+    crow::request req;
+    req.add_header("Cookie", "theme=dark; " + cookie);
+    for (auto _ : state) {
+        crow::response res;
+        bool allowed = benchAuth().protect_route(req, res);
+        benchmark::DoNotOptimize(allowed);
+        if (!allowed) {
+            state.SkipWithError("token was rejected");
+            break;
+        }
+    }
+}
+BENCHMARK(BM_ValidateJwt)->ThreadRange(1, 8)->UseRealTime();
+
+// Logins per second through the hash workers; past their queue, logins are
+// turned away with 503 and counted as rejected.
+void BM_Login(benchmark::State& state) {
+    int64_t rejected = 0;
+    for (auto _ : state) {
+        crow::response res = logIn(benchAuth(), "admin", "password123");
+        if (res.code == 503) {
+            ++rejected;
+        } else if (res.code != 200) {
+            state.SkipWithError("login failed");
+            break;
+        }
+    }
+    state.counters["rejected"] = benchmark::Counter(static_cast<double>(rejected), benchmark::Counter::kIsRate);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Login)->ThreadRange(1, 32)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+void BM_PasswordHashVerify(benchmark::State& state) {
+    const std::string hash = PasswordHash::hash("password123");
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(PasswordHash::verify("password123", hash));
+    }
+}
+BENCHMARK(BM_PasswordHashVerify)->Unit(benchmark::kMillisecond);
+
+void BM_QuoteIdentifier(benchmark::State& state) {
+    const std::string identifiers[] = {"orders", "Customer Orders", "weird\"name\"", "order_items_2024"};
+    for (auto _ : state) {
+        for (const std::string& identifier : identifiers) {
+            std::string quoted = SqlLexer::quoteIdentifier(identifier);
+            benchmark::DoNotOptimize(quoted.data());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 4);
+}
+BENCHMARK(BM_QuoteIdentifier);
+
+// get_table_details as it was before the catalog statements were prepared:
+// three information_schema queries per request.
+void BM_TableDetailsInformationSchema(benchmark::State& state) {
+    REQUIRE_DATABASE(state);
+    pqxx::connection& conn = *benchConnection();
+    const std::string table_name = "bench_details";
+    for (auto _ : state) {
+        pqxx::work txn(conn);
+        pqxx::result pk_res = txn.exec(
+            "SELECT kcu.column_name "
+            "FROM information_schema.table_constraints tc "
+            "JOIN information_schema.key_column_usage kcu "
+            "  ON tc.constraint_name = kcu.constraint_name "
+            "WHERE tc.table_name = '" + txn.esc(table_name) + "' "
+            "AND tc.constraint_type = 'PRIMARY KEY'");
+        pqxx::result res = txn.exec(
+            "SELECT c.column_name, c.data_type, c.character_maximum_length, c.is_nullable, "
+            "    c.column_default, c.ordinal_position, "
+            "    CASE WHEN pk.constraint_type = 'PRIMARY KEY' THEN true ELSE false END AS is_primary_key, "
+            "    pgd.description AS column_comment "
+            "FROM information_schema.columns c "
+            "LEFT JOIN ("
+            "    SELECT kcu.column_name, tc.constraint_type "
+            "    FROM information_schema.table_constraints tc "
+            "    JOIN information_schema.key_column_usage kcu "
+            "        ON tc.constraint_name = kcu.constraint_name "
+            "        AND tc.table_schema = kcu.table_schema "
+            "    WHERE tc.table_name = '" + txn.esc(table_name) + "' "
+            "    AND tc.constraint_type = 'PRIMARY KEY'"
+            ") pk ON c.column_name = pk.column_name "
+            "LEFT JOIN pg_catalog.pg_statio_all_tables st ON st.relname = c.table_name "
+            "LEFT JOIN pg_catalog.pg_description pgd ON pgd.objoid = st.relid AND pgd.objsubid = c.ordinal_position "
+            "WHERE c.table_name = '" + txn.esc(table_name) + "' "
+            "ORDER BY c.ordinal_position");
+        pqxx::result table_meta = txn.exec(
+            "SELECT "
+            "    (SELECT count(*) FROM information_schema.columns "
+            "     WHERE table_name = '" + txn.esc(table_name) + "') as column_count, "
+            "    obj_description(('public.' || '" + txn.esc(table_name) + "')::regclass::oid) as table_comment");
+        txn.commit();
+        benchmark::DoNotOptimize(res.size() + pk_res.size() + table_meta.size());
+    }
+}
+BENCHMARK(BM_TableDetailsInformationSchema)->UseRealTime();
+
+void BM_TableDetailsPrepared(benchmark::State& state) {
+    REQUIRE_DATABASE(state);
+    pqxx::connection& conn = *benchConnection();
+    for (auto _ : state) {
+        pqxx::work txn(conn);
+        pqxx::result res = txn.exec_prepared(PreparedStatements::TABLE_DETAILS, "public", "bench_details");
+        txn.commit();
+        benchmark::DoNotOptimize(res.size());
+    }
+}
+BENCHMARK(BM_TableDetailsPrepared)->UseRealTime();
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,82 @@
+#!/bin/sh
+# Starts a throwaway PostgreSQL cluster with the synthetic schemas the
+# benchmarks run against:
+#   bench_10, bench_1k, bench_10k  10, 1000 and 10000 tables t_00001 .. t_NNNNN
+#                                  of a few commented columns each, and
+#                                  rows_1000 .. rows_10000000 of mixed types
+#                                  (rows_N has N rows).
+#
+#   ./pg_fixture.sh start   create (first run) and start the cluster
+#   ./pg_fixture.sh stop
+#
+# BENCH_PG_DIR (default ./pgdata), BENCH_PG_PORT (55432) and BENCH_ROWS (the
+# row table sizes) override the defaults. The cluster trusts local
+# connections and runs with fsync off; never point it at real data.
+set -e
+
+PGDIR=${BENCH_PG_DIR:-./pgdata}
+PORT=${BENCH_PG_PORT:-55432}
+ROWS=${BENCH_ROWS:-"1000 10000 100000 1000000 10000000"}
+PSQL="psql -X -q -v ON_ERROR_STOP=1 -h 127.0.0.1 -p $PORT -U postgres"
+
+create_database() {
+    db=$1
+    tables=$2
+    $PSQL -d postgres -c "CREATE DATABASE $db"
+    $PSQL -d "$db" <<SQL
+DO \$\$
+BEGIN
+    FOR i IN 1..$tables LOOP
+        EXECUTE format(
+            'CREATE TABLE t_%s ('
+            '    id bigint PRIMARY KEY, '
+            '    name varchar(200) NOT NULL DEFAULT '''', '
+            '    amount numeric(12, 2), '
+            '    created_at timestamptz DEFAULT now(), '
+            '    payload jsonb)', lpad(i::text, 5, '0'));
+        EXECUTE format('COMMENT ON TABLE t_%s IS %L', lpad(i::text, 5, '0'), 'Synthetic table ' || i);
+        EXECUTE format('COMMENT ON COLUMN t_%s.name IS %L', lpad(i::text, 5, '0'), 'Display name');
+    END LOOP;
+END
+\$\$;
+SQL
+    for n in $ROWS; do
+        $PSQL -d "$db" <<SQL
+CREATE TABLE rows_$n AS
+SELECT i AS id,
+       'name ' || i AS name,
+       (i * 1.5)::numeric(12, 2) AS amount,
+       i % 2 = 0 AS flag,
+       timestamptz '2024-01-01' + i * interval '1 second' AS created_at,
+       CASE WHEN i % 10 = 0 THEN NULL ELSE md5(i::text) END AS note
+FROM generate_series(1, $n) AS i;
+ALTER TABLE rows_$n ADD PRIMARY KEY (id);
+ANALYZE rows_$n;
+SQL
+    done
+}
+
+case "$1" in
+start)
+    if [ ! -d "$PGDIR" ]; then
+        initdb -D "$PGDIR" -U postgres -A trust >/dev/null
+        fresh=1
+    fi
+    pg_ctl -D "$PGDIR" -l "$PGDIR/server.log" -w \
+        -o "-p $PORT -k /tmp -c listen_addresses=127.0.0.1 -c fsync=off -c synchronous_commit=off -c max_connections=200" \
+        start
+    if [ -n "$fresh" ]; then
+        create_database bench_10 10
+        create_database bench_1k 1000
+        create_database bench_10k 10000
+    fi
+    echo "SQL_EDITOR_BENCH_DSN=\"dbname=bench_1k user=postgres host=127.0.0.1 port=$PORT\""
+    ;;
+stop)
+    pg_ctl -D "$PGDIR" -m fast stop
+    ;;
+*)
+    echo "usage: $0 start|stop" >&2
+    exit 2
+    ;;
+esac
@@ -0,0 +1,33 @@
+#!/bin/sh
+# Runs the load generator over the endpoint and schema matrix against an API
+# server on BENCH_API (127.0.0.1:9999) that reaches the pg_fixture.sh cluster.
+# Extra arguments are passed to every run, e.g. --duration 30.
+set -e
+
+LOAD=${LOAD_GENERATOR:-./load_generator}
+API=${BENCH_API:-127.0.0.1:9999}
+PORT=${BENCH_PG_PORT:-55432}
+CONCURRENCY=${BENCH_CONCURRENCY:-"1 8 64"}
+
+run() {
+    echo
+    "$LOAD" --api "$API" --pg-port "$PORT" "$@"
+}
+
+for c in $CONCURRENCY; do
+    run --endpoint tables --db bench_10 --concurrency "$c" "$@"
+    run --endpoint tables --db bench_1k --concurrency "$c" "$@"
+    run --endpoint tables --db bench_10k --concurrency "$c" "$@"
+    run --endpoint table_details --db bench_10 --tables 10 --concurrency "$c" "$@"
+    run --endpoint table_details --db bench_1k --tables 1000 --concurrency "$c" "$@"
+    run --endpoint table_details --db bench_10k --tables 10000 --concurrency "$c" "$@"
+    for n in 1000 100000; do
+        run --endpoint query --db bench_10 --query "SELECT * FROM rows_$n" --concurrency "$c" "$@"
+        run --endpoint query --db bench_10 --query "SELECT * FROM rows_$n" --format arrow --concurrency "$c" "$@"
+    done
+    # Ten million rows are only sent through the streaming paths; buffering
+    # them as one JSON body would measure the server running out of memory.
+    run --endpoint query --db bench_10 --query "SELECT * FROM rows_10000000" --stream 1 --concurrency "$c" "$@"
+    run --endpoint query --db bench_10 --query "SELECT * FROM rows_10000000" --format arrow --concurrency "$c" "$@"
+    run --endpoint query --db bench_10 --query "SELECT * FROM rows_10000000 WHERE id = 4242" --concurrency "$c" "$@"
+done
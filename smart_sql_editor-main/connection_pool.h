@@ -0,0 +1,395 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <functional>
+#include <optional>
+#include <chrono>
+#include <thread>
+#include <stdexcept>
+#include <iostream>
+#include <openssl/evp.h>
+#include <pqxx/pqxx>
+#include "prepared_statements.h"
+#include "metrics.h"
+
+// Identifies one pool. Connections are only shared between requests that
+// present exactly the same parameters; the password takes part as a SHA-256
+// digest so the key never holds the secret itself.
+struct ConnectionKey {
+    std::string db_name;
+    std::string db_user;
+    std::string db_host;
+    std::string db_port;
+    std::string password_hash;
+
+    bool operator==(const ConnectionKey& other) const {
+        return db_name == other.db_name && db_user == other.db_user &&
+               db_host == other.db_host && db_port == other.db_port &&
+               password_hash == other.password_hash;
+    }
+};
+
+struct ConnectionKeyHash {
+    size_t operator()(const ConnectionKey& key) const {
+        std::hash<std::string> h;
+        size_t seed = h(key.password_hash);
+        for (const std::string* part : {&key.db_name, &key.db_user, &key.db_host, &key.db_port}) {
+            seed ^= h(*part) + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+};
+
+// Per-key sizing and timing. Every key gets its own pool with these limits.
+struct PoolOptions {
+    size_t min_size = 1;                                   // idle connections kept when evicting
+    size_t max_size = 8;                                   // open connections (idle + checked out)
+    std::chrono::seconds idle_timeout{300};                // idle connections older than this are closed
+    std::chrono::seconds health_check_after{30};           // ping connections idle longer than this
+    std::chrono::milliseconds checkout_timeout{5000};      // how long acquire() waits for a free slot
+    std::chrono::seconds reaper_interval{30};              // how often idle eviction runs
+    std::chrono::seconds connect_timeout{5};               // libpq connect_timeout for new connections
+};
+
+class ConnectionPool;
+
+// A connection checked out of the pool. It goes back to its pool when the
+// lease is destroyed, so handlers only need to keep it in scope.
+class PooledConnection {
+public:
+    PooledConnection(PooledConnection&& other) = default;
+    PooledConnection& operator=(PooledConnection&& other) = delete;
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    ~PooledConnection();
+
+    pqxx::connection& operator*() const { return *conn_; }
+    pqxx::connection* operator->() const { return conn_.get(); }
+
+    // Marks the session as possibly modified by user SQL (SET, temp tables,
+    // LISTEN, ...). It is reset before another request may reuse it.
+    void mark_dirty() { dirty_ = true; }
+
+    // Closes the connection instead of returning it to the pool.
+    void discard() { discard_ = true; }
+
+private:
+    friend class ConnectionPool;
+    struct Pool;
+
+    PooledConnection(std::shared_ptr<Pool> pool, std::unique_ptr<pqxx::connection> conn)
+        : pool_(std::move(pool)), conn_(std::move(conn)) {}
+
+    std::shared_ptr<Pool> pool_;
+    std::unique_ptr<pqxx::connection> conn_;
+    bool dirty_ = false;
+    bool discard_ = false;
+};
+
+struct PooledConnection::Pool {
+    struct IdleConnection {
+        std::unique_ptr<pqxx::connection> conn;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    std::string conn_str;
+    std::mutex mutex;
+    std::condition_variable available;
+    std::deque<IdleConnection> idle;   // most recently returned at the back
+    size_t open = 0;                   // idle plus checked out
+    bool connected = false;            // a connection has been opened, so the parameters work
+};
+
+class ConnectionPool {
+public:
+    explicit ConnectionPool(PoolOptions options = PoolOptions())
+        : options_(options), reaper_([this] { reapLoop(); }) {}
+
+    ~ConnectionPool() {
+        {
+            std::lock_guard<std::mutex> lock(pools_mutex_);
+            stopping_ = true;
+        }
+        reaper_wake_.notify_all();
+        reaper_.join();
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // The pool shared by all request handlers.
+    static ConnectionPool& instance() {
+        static ConnectionPool pool;
+        return pool;
+    }
+
+    const PoolOptions& options() const { return options_; }
+
+    // The key a set of connection parameters is pooled under.
+    static ConnectionKey makeKey(const std::string& db_name,
+                                 const std::string& db_user,
+                                 const std::string& db_pass,
+                                 const std::string& db_host,
+                                 const std::string& db_port) {
+        return ConnectionKey{db_name, db_user, db_host, db_port, hashPassword(db_pass)};
+    }
+
+    static std::string connectionString(const std::string& db_name,
+                                        const std::string& db_user,
+                                        const std::string& db_pass,
+                                        const std::string& db_host,
+                                        const std::string& db_port) {
+        return "dbname=" + db_name + " user=" + db_user +
+               " password=" + db_pass + " host=" + db_host +
+               " port=" + db_port;
+    }
+
+    // Checks out a connection for the given parameters, reusing an idle one
+    // when possible. Throws if none becomes available within checkout_timeout
+    // or if a new connection cannot be opened.
+    PooledConnection acquire(const std::string& db_name,
+                             const std::string& db_user,
+                             const std::string& db_pass,
+                             const std::string& db_host,
+                             const std::string& db_port) {
+        auto started = std::chrono::steady_clock::now();
+        std::shared_ptr<Pool> pool = poolFor(db_name, db_user, db_pass, db_host, db_port);
+        std::optional<PooledConnection> conn = checkout(pool, started + options_.checkout_timeout);
+        if (!conn) {
+            Metrics::instance().connection_acquire_timeouts.add();
+            throw std::runtime_error("Timed out waiting for a database connection");
+        }
+        Metrics::instance().connection_acquire.observeSince(started);
+        return std::move(*conn);
+    }
+
+    // Whether a connection with these parameters has been opened since their
+    // pool was created, i.e. they name a reachable database and valid login.
+    // Forgotten once the pool is reaped.
+    bool hasConnected(const ConnectionKey& key) {
+        std::shared_ptr<Pool> pool;
+        {
+            std::lock_guard<std::mutex> lock(pools_mutex_);
+            auto it = pools_.find(key);
+            if (it == pools_.end()) {
+                return false;
+            }
+            pool = it->second;
+        }
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        return pool->connected;
+    }
+
+    // Like acquire(), but returns nullopt instead of waiting when the pool
+    // for these parameters is at max_size with nothing idle. Used by callers
+    // that must not block their thread, which retry later instead.
+    std::optional<PooledConnection> tryAcquire(const std::string& db_name,
+                                               const std::string& db_user,
+                                               const std::string& db_pass,
+                                               const std::string& db_host,
+                                               const std::string& db_port) {
+        std::shared_ptr<Pool> pool = poolFor(db_name, db_user, db_pass, db_host, db_port);
+        return checkout(pool, std::chrono::steady_clock::now());
+    }
+
+private:
+    using Pool = PooledConnection::Pool;
+    friend class PooledConnection;
+
+    // Statements that undo session state a user query may have left behind.
+    // Prepared statements are deliberately kept; the last statement counts
+    // the pool's own ones so a DEALLOCATE run by the user can be repaired.
+    static constexpr const char* RESET_SESSION_SQL =
+        "CLOSE ALL; SET SESSION AUTHORIZATION DEFAULT; RESET ALL; UNLISTEN *; "
+        "SELECT pg_advisory_unlock_all(); DISCARD TEMP; DISCARD SEQUENCES; "
+        "SELECT count(*) FROM pg_catalog.pg_prepared_statements WHERE left(name, 11) = 'sql_editor_'";
+
+    std::optional<PooledConnection> checkout(const std::shared_ptr<Pool>& pool,
+                                             std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(pool->mutex);
+        for (;;) {
+            if (!pool->idle.empty()) {
+                Pool::IdleConnection candidate = std::move(pool->idle.back());
+                pool->idle.pop_back();
+                lock.unlock();
+                if (isHealthy(*candidate.conn, candidate.since)) {
+                    return PooledConnection(pool, std::move(candidate.conn));
+                }
+                candidate.conn.reset();
+                lock.lock();
+                --pool->open;
+                continue;
+            }
+
+            if (pool->open < options_.max_size) {
+                ++pool->open;
+                lock.unlock();
+                try {
+                    auto conn = std::make_unique<pqxx::connection>(pool->conn_str);
+                    PreparedStatements::prepareAll(*conn);
+                    lock.lock();
+                    pool->connected = true;
+                    lock.unlock();
+                    return PooledConnection(pool, std::move(conn));
+                } catch (...) {
+                    lock.lock();
+                    --pool->open;
+                    pool->available.notify_one();
+                    throw;
+                }
+            }
+
+            if (pool->available.wait_until(lock, deadline) == std::cv_status::timeout &&
+                pool->idle.empty() && pool->open >= options_.max_size) {
+                return std::nullopt;
+            }
+        }
+    }
+
+    static std::string hashPassword(const std::string& password) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_Digest(password.data(), password.size(), digest, &length, EVP_sha256(), nullptr) != 1) {
+            throw std::runtime_error("Failed to hash connection password");
+        }
+        static const char hex[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(length * 2);
+        for (unsigned int i = 0; i < length; ++i) {
+            out.push_back(hex[digest[i] >> 4]);
+            out.push_back(hex[digest[i] & 0x0f]);
+        }
+        return out;
+    }
+
+    std::shared_ptr<Pool> poolFor(const std::string& db_name,
+                                  const std::string& db_user,
+                                  const std::string& db_pass,
+                                  const std::string& db_host,
+                                  const std::string& db_port) {
+        ConnectionKey key = makeKey(db_name, db_user, db_pass, db_host, db_port);
+
+        std::lock_guard<std::mutex> lock(pools_mutex_);
+        std::shared_ptr<Pool>& pool = pools_[key];
+        if (!pool) {
+            pool = std::make_shared<Pool>();
+            // Bounded so one unreachable host cannot hold up a background
+            // thread that serves other databases too.
+            pool->conn_str = connectionString(db_name, db_user, db_pass, db_host, db_port) +
+                             " connect_timeout=" + std::to_string(options_.connect_timeout.count());
+        }
+        return pool;
+    }
+
+    bool isHealthy(pqxx::connection& conn, std::chrono::steady_clock::time_point idle_since) const {
+        if (!conn.is_open()) {
+            return false;
+        }
+        if (std::chrono::steady_clock::now() - idle_since < options_.health_check_after) {
+            return true;
+        }
+        try {
+            pqxx::nontransaction txn(conn);
+            txn.exec("SELECT 1");
+            return true;
+        } catch (const std::exception& e) {
+            std::cerr << "Dropping unhealthy pooled connection: " << e.what() << std::endl;
+            return false;
+        }
+    }
+
+    static void release(PooledConnection& lease) {
+        std::shared_ptr<Pool> pool = std::move(lease.pool_);
+        std::unique_ptr<pqxx::connection> conn = std::move(lease.conn_);
+        if (!pool || !conn) {
+            return;
+        }
+
+        bool keep = !lease.discard_ && conn->is_open();
+        if (keep && lease.dirty_) {
+            try {
+                bool reprepare = false;
+                {
+                    pqxx::nontransaction txn(*conn);
+                    pqxx::result prepared = txn.exec(RESET_SESSION_SQL);
+                    if (prepared[0][0].as<size_t>() < PreparedStatements::count()) {
+                        txn.exec("DEALLOCATE ALL");
+                        reprepare = true;
+                    }
+                }
+                if (reprepare) {
+                    PreparedStatements::prepareAll(*conn);
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Failed to reset pooled connection: " << e.what() << std::endl;
+                keep = false;
+            }
+        }
+        if (!keep) {
+            conn.reset();
+        }
+
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        if (keep) {
+            pool->idle.push_back({std::move(conn), std::chrono::steady_clock::now()});
+        } else {
+            --pool->open;
+        }
+        pool->available.notify_one();
+    }
+
+    // Closes connections that have sat idle past idle_timeout (keeping
+    // min_size per key) and forgets keys that no longer hold any connection.
+    void reapLoop() {
+        std::unique_lock<std::mutex> lock(pools_mutex_);
+        while (!stopping_) {
+            reaper_wake_.wait_for(lock, options_.reaper_interval);
+            if (stopping_) {
+                break;
+            }
+
+            std::vector<std::unique_ptr<pqxx::connection>> expired;
+            auto cutoff = std::chrono::steady_clock::now() - options_.idle_timeout;
+            for (auto it = pools_.begin(); it != pools_.end();) {
+                Pool& pool = *it->second;
+                std::lock_guard<std::mutex> pool_lock(pool.mutex);
+                while (pool.idle.size() > options_.min_size && pool.idle.front().since < cutoff) {
+                    expired.push_back(std::move(pool.idle.front().conn));
+                    pool.idle.pop_front();
+                    --pool.open;
+                }
+                if (pool.open == 0 && it->second.use_count() == 1) {
+                    it = pools_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+
+            // Close outside the registry lock; closing may block on the network.
+            lock.unlock();
+            expired.clear();
+            lock.lock();
+        }
+    }
+
+    PoolOptions options_;
+    std::mutex pools_mutex_;
+    std::condition_variable reaper_wake_;
+    bool stopping_ = false;
+    std::unordered_map<ConnectionKey, std::shared_ptr<Pool>, ConnectionKeyHash> pools_;
+    std::thread reaper_;
+};
+
+inline PooledConnection::~PooledConnection() {
+    ConnectionPool::release(*this);
+}
+
+#endif // CONNECTION_POOL_H
@@ -0,0 +1,292 @@
+#ifndef CREDENTIAL_STORE_H
+#define CREDENTIAL_STORE_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <cctype>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include <pqxx/pqxx>
+#include "sql_lexer.h"
+
+// Salted scrypt password hashes, encoded with their parameters so stronger
+// ones can be rolled out without invalidating stored hashes:
+//
+//     scrypt$<log2 N>$<r>$<p>$<salt hex>$<hash hex>
+class PasswordHash {
+public:
+    static constexpr int LOG2_N = 15;
+    static constexpr int R = 8;
+    static constexpr int P = 1;
+    static constexpr size_t SALT_BYTES = 16;
+    static constexpr size_t HASH_BYTES = 32;
+    // scrypt needs 128 * N * r bytes; stored parameters asking for more are refused.
+    static constexpr uint64_t MAX_MEMORY = 256 * 1024 * 1024;
+
+    static std::string hash(const std::string& password) {
+        std::string salt(SALT_BYTES, '\0');
+        if (RAND_bytes(reinterpret_cast<unsigned char*>(&salt[0]), static_cast<int>(salt.size())) != 1) {
+            throw std::runtime_error("Failed to generate salt");
+        }
+        return "scrypt$" + std::to_string(LOG2_N) + "$" + std::to_string(R) + "$" + std::to_string(P) + "$" +
+               toHex(salt) + "$" + toHex(derive(password, salt, LOG2_N, R, P, HASH_BYTES));
+    }
+
+    // Compares in constant time; false for malformed hashes.
+    static bool verify(const std::string& password, const std::string& encoded) {
+        std::vector<std::string> parts;
+        std::stringstream stream(encoded);
+        for (std::string part; std::getline(stream, part, '$');) {
+            parts.push_back(part);
+        }
+        try {
+            if (parts.size() != 6 || parts[0] != "scrypt") {
+                return false;
+            }
+            int log2_n = std::stoi(parts[1]);
+            int r = std::stoi(parts[2]);
+            int p = std::stoi(parts[3]);
+            std::string salt = fromHex(parts[4]);
+            std::string expected = fromHex(parts[5]);
+            if (log2_n < 1 || log2_n > 30 || r < 1 || p < 1 || expected.empty()) {
+                return false;
+            }
+            std::string actual = derive(password, salt, log2_n, r, p, expected.size());
+            return CRYPTO_memcmp(actual.data(), expected.data(), expected.size()) == 0;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+
+private:
+    static std::string derive(const std::string& password, const std::string& salt,
+                              int log2_n, int r, int p, size_t length) {
+        std::string key(length, '\0');
+        if (EVP_PBE_scrypt(password.data(), password.size(),
+                           reinterpret_cast<const unsigned char*>(salt.data()), salt.size(),
+                           uint64_t{1} << log2_n, static_cast<uint64_t>(r), static_cast<uint64_t>(p),
+                           MAX_MEMORY, reinterpret_cast<unsigned char*>(&key[0]), key.size()) != 1) {
+            throw std::runtime_error("Failed to hash password");
+        }
+        return key;
+    }
+
+    static std::string toHex(const std::string& bytes) {
+        static const char hex[] = "0123456789abcdef";
+        std::string out;
+        out.reserve(bytes.size() * 2);
+        for (unsigned char c : bytes) {
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0x0f]);
+        }
+        return out;
+    }
+
+    static std::string fromHex(const std::string& text) {
+        if (text.size() % 2 != 0) {
+            throw std::invalid_argument("Odd-length hex");
+        }
+        std::string out;
+        out.reserve(text.size() / 2);
+        for (size_t i = 0; i < text.size(); i += 2) {
+            if (!std::isxdigit(static_cast<unsigned char>(text[i])) ||
+                !std::isxdigit(static_cast<unsigned char>(text[i + 1]))) {
+                throw std::invalid_argument("Invalid hex");
+            }
+            out.push_back(static_cast<char>(std::stoi(text.substr(i, 2), nullptr, 16)));
+        }
+        return out;
+    }
+};
+
+// The dashboard's users and their password hashes, read once into a hash
+// map. CONFIG_FILE picks where they come from; without it they are read
+// from DEFAULT_FILE:
+//
+//     source file                      # lines of username:hash, # comments
+//     file credentials.passwd
+//
+//     source postgresql                # a username and a password_hash column
+//     connection host=10.0.0.5 dbname=auth user=dashboard
+//     table dashboard_users
+//
+// Hashes are made with `dashboard --hash-password`, which reads the password
+// from stdin.
+class CredentialStore {
+public:
+    static constexpr const char* CONFIG_FILE = "credential_store.conf";
+    static constexpr const char* DEFAULT_FILE = "credentials.passwd";
+
+    // Loads the store CONFIG_FILE describes.
+    static CredentialStore load() {
+        std::unordered_map<std::string, std::string> config;
+        std::ifstream file(CONFIG_FILE);
+        std::string line;
+        while (std::getline(file, line)) {
+            size_t start = line.find_first_not_of(" \t");
+            if (start == std::string::npos || line[start] == '#') {
+                continue;
+            }
+            size_t space = line.find_first_of(" \t", start);
+            std::string key = line.substr(start, space == std::string::npos ? std::string::npos : space - start);
+            size_t value = space == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", space);
+            config[key] = value == std::string::npos ? "" : line.substr(value);
+        }
+
+        std::string source = config.count("source") ? config["source"] : "file";
+        if (source == "postgresql") {
+            return fromDatabase(config["connection"], config.count("table") ? config["table"] : "dashboard_users");
+        }
+        if (source != "file") {
+            throw std::runtime_error(std::string(CONFIG_FILE) + ": unknown source " + source);
+        }
+        return fromFile(config.count("file") ? config["file"] : DEFAULT_FILE);
+    }
+
+    // A missing file is an error rather than an empty store, so the
+    // dashboard does not start with no way to log in, or with accounts
+    // nobody chose.
+    static CredentialStore fromFile(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.good()) {
+            throw std::runtime_error(path + ": not found. Create it with one username:hash line per user, "
+                                     "hashing each password with `dashboard --hash-password`, "
+                                     "and make it readable only by the dashboard's user (chmod 600).");
+        }
+
+        CredentialStore store;
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos || colon == 0) {
+                std::cerr << path << ": ignoring line without a username: " << line << std::endl;
+                continue;
+            }
+            store.users_[line.substr(0, colon)] = line.substr(colon + 1);
+        }
+        return store;
+    }
+
+    // A store of the given username -> hash pairs that is never written
+    // anywhere, for tests and benchmarks.
+    static CredentialStore fromHashes(std::unordered_map<std::string, std::string> users) {
+        CredentialStore store;
+        store.users_ = std::move(users);
+        return store;
+    }
+
+    static CredentialStore fromDatabase(const std::string& connection, const std::string& table) {
+        pqxx::connection conn(connection);
+        pqxx::work txn(conn);
+        pqxx::result res = txn.exec("SELECT username, password_hash FROM " + SqlLexer::quoteIdentifier(table));
+        txn.commit();
+
+        CredentialStore store;
+        for (const auto& row : res) {
+            if (!row[0].is_null() && !row[1].is_null()) {
+                store.users_[row[0].c_str()] = row[1].c_str();
+            }
+        }
+        return store;
+    }
+
+    size_t size() const { return users_.size(); }
+
+    // Runs the hash for unknown users too, so the time taken does not tell
+    // which usernames exist.
+    bool check(const std::string& username, const std::string& password) const {
+        auto it = users_.find(username);
+        bool valid = PasswordHash::verify(password, it == users_.end() ? dummyHash() : it->second);
+        return valid && it != users_.end();
+    }
+
+private:
+    static const std::string& dummyHash() {
+        static const std::string hash = PasswordHash::hash("");
+        return hash;
+    }
+
+    std::unordered_map<std::string, std::string> users_;
+};
+
+// A fixed set of threads for password hashing with a bounded queue, so a
+// burst of logins waits here, or is turned away, instead of occupying the
+// Crow threads that serve everything else.
+class HashWorkers {
+public:
+    static constexpr size_t MAX_QUEUED = 256;
+
+    explicit HashWorkers(size_t threads = std::max(2u, std::thread::hardware_concurrency() / 2)) {
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this] { run(); });
+        }
+    }
+
+    ~HashWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    HashWorkers(const HashWorkers&) = delete;
+    HashWorkers& operator=(const HashWorkers&) = delete;
+
+    // Queues a task; false when MAX_QUEUED tasks are already waiting.
+    bool submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queue_.size() >= MAX_QUEUED) {
+                return false;
+            }
+            queue_.push_back(std::move(task));
+        }
+        wake_.notify_one();
+        return true;
+    }
+
+private:
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) {
+                    return;
+                }
+                task = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+#endif // CREDENTIAL_STORE_H
@@ -7372,6 +7372,12 @@ namespace crow // NOTE: Already documented in "crow/app.h"
 #if !defined(S_ISREG) && defined(S_IFMT) && defined(S_IFREG)
 #define S_ISREG(m) (((m)&S_IFMT) == S_IFREG)
 #endif
+#include <memory>
+#include <mutex>
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/socket.h>
+#endif
 
 
 
@@ -7380,6 +7386,54 @@ namespace crow
     template<typename Adaptor, typename Handler, typename... Middlewares>
     class Connection;
 
+    namespace detail
+    {
+        /// Lets any thread check whether the client of a connection is still there.
+
+        ///
+        /// The probe peeks the socket without consuming data and never touches the connection's asio state.
+        /// The connection closes the probe before it closes the socket, so a probe never peeks a descriptor
+        /// that may have been reused by another connection.
+        class peer_probe
+        {
+        public:
+            explicit peer_probe(int fd):
+              fd_(fd)
+            {}
+
+            /// Check, without blocking, whether the socket is open and the client has not hung up.
+            bool alive()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!open_)
+                {
+                    return false;
+                }
+#ifndef _WIN32
+                char probe;
+                auto n = ::recv(fd_, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+                if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                {
+                    open_ = false;
+                }
+#endif
+                return open_;
+            }
+
+            /// Called by the connection before it closes the socket.
+            void close()
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                open_ = false;
+            }
+
+        private:
+            std::mutex mutex_;
+            int fd_;
+            bool open_ = true;
+        };
+    } // namespace detail
+
     class Router;
 
     /// HTTP response
@@ -7523,6 +7577,7 @@ namespace crow
             headers = std::move(r.headers);
             completed_ = r.completed_;
             file_info = std::move(r.file_info);
+            body_generator_ = std::move(r.body_generator_);
             return *this;
         }
 
@@ -7539,6 +7594,7 @@ namespace crow
             headers.clear();
             completed_ = false;
             file_info = static_file_info{};
+            body_generator_ = nullptr;
         }
 
         /// Return a "Temporary Redirect" response.
@@ -7620,6 +7676,20 @@ namespace crow
             return is_alive_helper_ && is_alive_helper_();
         }
 
+        /// Get a check that any thread may call, also after the response is complete, to see whether the client is still connected.
+        /// Returns an empty function when the response is not tied to a connection.
+        std::function<bool()> alive_check() const
+        {
+            if (!peer_probe_)
+            {
+                return nullptr;
+            }
+            auto probe = peer_probe_;
+            return [probe] {
+                return probe->alive();
+            };
+        }
+
         /// Check whether the response has a static file defined.
         bool is_static_type()
         {
@@ -7671,11 +7741,35 @@ namespace crow
             }
         }
 
+        /// Stream the body from a generator using chunked transfer encoding.
+
+        ///
+        /// The generator is called with an empty buffer to append the next part of the body to
+        /// and returns false once it has written the last part. It runs after the handler returns,
+        /// so it has to own everything it needs. If the client goes away the generator is dropped early.
+        /// If the generator throws, the connection is closed without the final chunk.
+        void set_body_generator(std::function<bool(std::string&)> generator)
+        {
+            body_generator_ = std::move(generator);
+            set_header("Transfer-Encoding", "chunked");
+#ifdef CROW_ENABLE_COMPRESSION
+            compressed = false;
+#endif
+        }
+
+        /// Check whether the response body comes from a generator.
+        bool is_stream_type()
+        {
+            return static_cast<bool>(body_generator_);
+        }
+
     private:
         bool completed_{};
         std::function<void()> complete_request_handler_;
         std::function<bool()> is_alive_helper_;
+        std::shared_ptr<detail::peer_probe> peer_probe_;
         static_file_info file_info;
+        std::function<bool(std::string&)> body_generator_;
     };
 } // namespace crow
 
@@ -9203,6 +9297,7 @@ namespace crow
 
         ~Connection()
         {
+            close_peer_probe();
 #ifdef CROW_ENABLE_DEBUG
             connectionCount--;
             CROW_LOG_DEBUG << "Connection (" << this << ") freed, total: " << connectionCount;
@@ -9314,6 +9409,15 @@ namespace crow
                 res.is_alive_helper_ = [self]() -> bool {
                     return self->adaptor_.is_open();
                 };
+                if (!peer_probe_)
+                {
+#ifndef _WIN32
+                    peer_probe_ = std::make_shared<detail::peer_probe>(adaptor_.raw_socket().native_handle());
+#else
+                    peer_probe_ = std::make_shared<detail::peer_probe>(-1);
+#endif
+                }
+                res.peer_probe_ = peer_probe_;
                 
                 detail::middleware_call_helper<detail::middleware_call_criteria_only_global,
                                                0, decltype(ctx_), decltype(*middlewares_)>({}, *middlewares_, req_, res, ctx_);
@@ -9345,6 +9449,7 @@ namespace crow
         {
             CROW_LOG_INFO << "Response: " << this << ' ' << req_.raw_url << ' ' << res.code << ' ' << close_connection_;
             res.is_alive_helper_ = nullptr;
+            res.peer_probe_ = nullptr;
 
             if (need_to_call_after_handlers_)
             {
@@ -9404,6 +9509,10 @@ namespace crow
             {
                 do_write_static();
             }
+            else if (res.is_stream_type())
+            {
+                do_write_stream();
+            }
             else
             {
                 do_write_general();
@@ -9411,10 +9520,20 @@ namespace crow
         }
 
     private:
+        /// Stop the peer probe handed out to handlers; called before the socket is closed.
+        void close_peer_probe()
+        {
+            if (peer_probe_)
+            {
+                peer_probe_->close();
+            }
+        }
+
         void prepare_buffers()
         {
             res.complete_request_handler_ = nullptr;
             res.is_alive_helper_ = nullptr;
+            res.peer_probe_ = nullptr;
 
             if (!adaptor_.is_open())
             {
@@ -9496,7 +9615,7 @@ namespace crow
                 buffers_.emplace_back(crlf.data(), crlf.size());
             }
 
-            if (!res.manual_length_header && !res.headers.count("content-length"))
+            if (!res.manual_length_header && !res.is_stream_type() && !res.headers.count("content-length"))
             {
                 content_length_ = std::to_string(res.body.size());
                 static std::string content_length_tag = "Content-Length: ";
@@ -9549,6 +9668,7 @@ namespace crow
             if (close_connection_)
             {
                 adaptor_.shutdown_readwrite();
+                close_peer_probe();
                 adaptor_.close();
                 CROW_LOG_DEBUG << this << " from write (static)";
             }
@@ -9559,6 +9679,69 @@ namespace crow
             parser_.clear();
         }
 
+        void do_write_stream()
+        {
+            asio::write(adaptor_.socket(), buffers_); // Write the response start / headers
+            cancel_deadline_timer();
+
+            static const std::string last_chunk = "0\r\n\r\n";
+            std::string chunk;
+            std::string chunk_size;
+            std::vector<asio::const_buffer> buffers{3};
+            bool more = true;
+            bool write_failed = false;
+            while (more && !write_failed)
+            {
+                chunk.clear();
+                try
+                {
+                    more = res.body_generator_(chunk);
+                }
+                catch (const std::exception& e)
+                {
+                    CROW_LOG_ERROR << this << " body generator failed: " << e.what();
+                    write_failed = true; // close without the last chunk, so the body reads as truncated
+                    break;
+                }
+                if (chunk.empty())
+                    continue;
+
+                char size_buf[20];
+                int size_len = snprintf(size_buf, sizeof(size_buf), "%zx\r\n", chunk.size());
+                chunk_size.assign(size_buf, size_len);
+                buffers[0] = asio::buffer(chunk_size);
+                buffers[1] = asio::buffer(chunk);
+                buffers[2] = asio::buffer(crlf);
+
+                error_code ec;
+                asio::write(adaptor_.socket(), buffers, ec);
+                if (ec)
+                {
+                    CROW_LOG_DEBUG << this << " from write (stream): " << ec.message();
+                    write_failed = true;
+                }
+            }
+
+            if (!write_failed)
+            {
+                error_code ec;
+                asio::write(adaptor_.socket(), asio::buffer(last_chunk), ec);
+                write_failed = static_cast<bool>(ec);
+            }
+            if (close_connection_ || write_failed)
+            {
+                adaptor_.shutdown_readwrite();
+                close_peer_probe();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from write (stream)";
+            }
+
+            res.end();
+            res.clear();
+            buffers_.clear();
+            parser_.clear();
+        }
+
         void do_write_general()
         {
             if (res.body.length() < res_stream_threshold_)
@@ -9595,6 +9778,7 @@ namespace crow
                 if (close_connection_)
                 {
                     adaptor_.shutdown_readwrite();
+                    close_peer_probe();
                     adaptor_.close();
                     CROW_LOG_DEBUG << this << " from write (res_stream)";
                 }
@@ -9627,6 +9811,7 @@ namespace crow
                       self->cancel_deadline_timer();
                       self->parser_.done();
                       self->adaptor_.shutdown_read();
+                      self->close_peer_probe();
                       self->adaptor_.close();
                       CROW_LOG_DEBUG << self << " from read(1) with description: \"" << http_errno_description(static_cast<http_errno>(self->parser_.http_errno)) << '\"';
                   }
@@ -9671,6 +9856,7 @@ namespace crow
                       if (self->close_connection_)
                       {
                           self->adaptor_.shutdown_write();
+                          self->close_peer_probe();
                           self->adaptor_.close();
                           CROW_LOG_DEBUG << self << " from write(1)";
                       }
@@ -9716,6 +9902,7 @@ namespace crow
                     return;
                 }
                 self->adaptor_.shutdown_readwrite();
+                self->close_peer_probe();
                 self->adaptor_.close();
             });
             CROW_LOG_DEBUG << this << " timer added: " << &task_timer_ << ' ' << task_id_;
@@ -9731,6 +9918,7 @@ namespace crow
         std::unique_ptr<routing_handle_result> routing_handle_result_;
         request& req_;
         response res;
+        std::shared_ptr<detail::peer_probe> peer_probe_;
 
         bool close_connection_ = false;
 
@@ -10580,6 +10768,15 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             tick_function_ = f;
         }
 
+        /// Number of requests queued or running on each worker thread.
+        std::vector<unsigned int> task_queue_lengths() const
+        {
+            std::vector<unsigned int> lengths;
+            for (const auto& length : task_queue_length_pool_)
+                lengths.push_back(length.load(std::memory_order_relaxed));
+            return lengths;
+        }
+
         void on_tick()
         {
             tick_function_();
@@ -13904,6 +14101,18 @@ namespace crow
             return concurrency_;
         }
 
+        /// \brief Get the number of requests queued or running on each worker thread, empty before the server runs
+        std::vector<unsigned int> task_queue_lengths()
+        {
+#ifdef CROW_ENABLE_SSL
+            if (ssl_server_)
+                return ssl_server_->task_queue_lengths();
+#endif
+            if (server_)
+                return server_->task_queue_lengths();
+            return {};
+        }
+
         /// \brief Set the server's log level
         ///
         /// Possible values are:
@@ -1,16 +1,14 @@
 #include "crow_all.h"
 #include "jwt_auth.h"
+#include "metrics.h"
+#include "static_page.h"
 #include <string>
+#include <optional>
+#include <iostream>
 
-//g++ dashboard.cpp -o dashboard -I/usr/local/include -L/usr/local/lib -lssl -lcrypto -lpqxx -lpq
+//g++ dashboard.cpp -o dashboard -I/usr/local/include -L/usr/local/lib -lssl -lcrypto -lpqxx -lpq -lz -lbrotlienc
 
-int main() {
-    crow::SimpleApp app;
-    JWTAuth auth;
-
-    // Serve login page
-    CROW_ROUTE(app, "/").methods("GET"_method)([](){
-        std::string login_html = R"EOF(
+static const char* const LOGIN_HTML = R"EOF(
         <!DOCTYPE html>
         <html lang="en">
         <head>
@@ -54,24 +52,8 @@ int main() {
         </body>
         </html>
         )EOF";
-        return crow::response(200, login_html);
-    });
-
-    // Login route
-    CROW_ROUTE(app, "/login").methods("POST"_method)([&auth](const crow::request& req){
-        return auth.login(req);
-    });
-
-    // Protected dashboard
-    CROW_ROUTE(app, "/dashboard").methods("GET"_method)([&auth](const crow::request& req, crow::response& res) {
-        if (!auth.protect_route(req, res)) {
-            res.code = 401;
-            res.write("Unauthorized: Invalid token");
-            res.end();
-            return;
-        }
 
-        std::string dashboard_html = R"EOF(
+static const char* const DASHBOARD_HTML = R"EOF(
 <!DOCTYPE html>
 <html lang="en">
 <head>
@@ -159,8 +141,69 @@ int main() {
 </html>
         )EOF";
 
-        res.code = 200;
-        res.write(dashboard_html);
+int main(int argc, char** argv) {
+    // Prints the hash of the password read from stdin, for the credential store.
+    if (argc > 1 && std::string(argv[1]) == "--hash-password") {
+        std::string password;
+        std::getline(std::cin, password);
+        std::cout << PasswordHash::hash(password) << std::endl;
+        return 0;
+    }
+
+    crow::SimpleApp app;
+    // Fails without a credential store; see CredentialStore.
+    std::optional<JWTAuth> auth_holder;
+    try {
+        auth_holder.emplace();
+    } catch (const std::exception& e) {
+        std::cerr << "Cannot start: " << e.what() << std::endl;
+        return 1;
+    }
+    JWTAuth& auth = *auth_holder;
+
+    // Pages are compressed once here; see StaticPage. The dashboard is only
+    // for logged-in users, so shared caches must not keep it.
+    const StaticPage login_page(LOGIN_HTML, "text/html");
+    const StaticPage dashboard_page(DASHBOARD_HTML, "text/html", "private, no-cache");
+
+    // Serve login page
+    CROW_ROUTE(app, "/").methods("GET"_method)([&login_page](const crow::request& req) {
+        return login_page.respond(req);
+    });
+
+    // Prometheus metrics of this process.
+    Metrics::instance().addGauge("sql_editor_task_queue_length",
+                                 "Requests queued or running on each Crow worker thread.", [&app] {
+        Metrics::GaugeSamples samples;
+        std::vector<unsigned int> lengths = app.task_queue_lengths();
+        for (size_t i = 0; i < lengths.size(); ++i) {
+            samples.emplace_back("thread=\"" + std::to_string(i) + "\"", lengths[i]);
+        }
+        return samples;
+    });
+    CROW_ROUTE(app, "/metrics")([] {
+        crow::response res(Metrics::instance().render());
+        res.set_header("Content-Type", Metrics::CONTENT_TYPE);
+        return res;
+    });
+
+    // Login route
+    CROW_ROUTE(app, "/login").methods("POST"_method)([&auth](const crow::request& req, crow::response& res) {
+        auth.login(req, res);
+    });
+
+    // Protected dashboard
+    CROW_ROUTE(app, "/dashboard").methods("GET"_method)([&auth, &dashboard_page](const crow::request& req,
+                                                                                  crow::response& res) {
+        if (!auth.protect_route(req, res)) {
+            res.code = 401;
+            res.write("Unauthorized: Invalid token");
+            res.end();
+            return;
+        }
+
+        // protect_route may have set a refreshed cookie; respond() keeps it.
+        dashboard_page.respond(req, res);
         res.end();
     });
 
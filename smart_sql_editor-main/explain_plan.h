@@ -0,0 +1,234 @@
+#ifndef EXPLAIN_PLAN_H
+#define EXPLAIN_PLAN_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "crow_all.h"
+
+// Turns the output of EXPLAIN (FORMAT JSON, ANALYZE, BUFFERS) into the
+// /explain response: a tree of plan nodes with the figures that matter when
+// tuning, and a list of hotspots.
+//
+// The server reports a node's time and buffers including its children, and
+// its time and rows per loop. Every node here gets the totals over all loops
+// and its self part, what is left after subtracting its children. Parallel
+// workers run children concurrently, so self time under a Gather is an
+// estimate; it never goes below zero.
+class ExplainPlan {
+public:
+    // A node whose self time takes this share of the execution is a hotspot.
+    static constexpr double HOTSPOT_TIME_SHARE = 0.1;
+    // Row estimates off by this factor either way, on at least
+    // MISESTIMATE_MIN_ROWS rows, usually mean a bad join or scan choice.
+    static constexpr double MISESTIMATE_FACTOR = 10;
+    static constexpr double MISESTIMATE_MIN_ROWS = 1000;
+    // Blocks read from outside shared buffers before a node counts as I/O bound.
+    static constexpr double HOTSPOT_READ_BLOCKS = 1000;
+
+    // plan_json is the single value EXPLAIN (FORMAT JSON) returns. Without
+    // ANALYZE only estimates are reported and nothing is flagged.
+    static crow::json::wvalue analyze(const std::string& plan_json) {
+        crow::json::rvalue explain = crow::json::load(plan_json);
+        if (!explain || explain.t() != crow::json::type::List || explain.size() == 0 ||
+            !explain[0].has("Plan")) {
+            throw std::runtime_error("Unexpected EXPLAIN output");
+        }
+        const crow::json::rvalue& top = explain[0];
+
+        std::vector<Node> nodes;
+        build(top["Plan"], nodes);
+        const Node& root = nodes[0];
+        bool analyzed = top.has("Execution Time");
+        double execution_ms = analyzed ? top["Execution Time"].d() : 0;
+
+        crow::json::wvalue result;
+        result["plan"] = render(nodes, 0, analyzed);
+        if (top.has("Planning Time")) {
+            result["planning_ms"] = top["Planning Time"].d();
+        }
+        if (analyzed) {
+            result["execution_ms"] = execution_ms;
+            result["shared_hit_blocks"] = root.shared_hit;
+            result["shared_read_blocks"] = root.shared_read;
+            result["temp_read_blocks"] = root.temp_read;
+            result["temp_written_blocks"] = root.temp_written;
+        }
+        result["hotspots"] = hotspots(nodes, analyzed ? std::max(execution_ms, root.total_ms) : 0);
+        result["status"] = "success";
+        return result;
+    }
+
+private:
+    struct Node {
+        const crow::json::rvalue* plan;
+        std::vector<size_t> children;
+        double loops = 0;
+        double total_ms = 0;        // over all loops, children included
+        double self_ms = 0;
+        double estimated_rows = 0;  // per loop
+        double actual_rows = 0;     // per loop
+        double shared_hit = 0;      // children included
+        double shared_read = 0;
+        double temp_read = 0;
+        double temp_written = 0;
+        double self_shared_read = 0;
+        double self_temp_written = 0;
+    };
+
+    static double number(const crow::json::rvalue& plan, const char* field) {
+        return plan.has(field) ? plan[field].d() : 0;
+    }
+
+    static std::string text(const crow::json::rvalue& plan, const char* field) {
+        return plan.has(field) ? std::string(plan[field].s()) : std::string();
+    }
+
+    // Appends the node and its descendants in preorder, so a node's index is
+    // its id in the response, and returns its index.
+    static size_t build(const crow::json::rvalue& plan, std::vector<Node>& nodes) {
+        size_t index = nodes.size();
+        nodes.emplace_back();
+        {
+            Node& node = nodes[index];
+            node.plan = &plan;
+            node.loops = number(plan, "Actual Loops");
+            node.total_ms = number(plan, "Actual Total Time") * node.loops;
+            node.estimated_rows = number(plan, "Plan Rows");
+            node.actual_rows = number(plan, "Actual Rows");
+            node.shared_hit = number(plan, "Shared Hit Blocks");
+            node.shared_read = number(plan, "Shared Read Blocks");
+            node.temp_read = number(plan, "Temp Read Blocks");
+            node.temp_written = number(plan, "Temp Written Blocks");
+        }
+        std::vector<size_t> children;
+        if (plan.has("Plans")) {
+            for (const auto& child : plan["Plans"]) {
+                children.push_back(build(child, nodes));
+            }
+        }
+
+        // nodes may have grown, so look the node up again.
+        Node& node = nodes[index];
+        double children_ms = 0;
+        double children_read = 0;
+        double children_temp_written = 0;
+        for (size_t child : children) {
+            children_ms += nodes[child].total_ms;
+            children_read += nodes[child].shared_read;
+            children_temp_written += nodes[child].temp_written;
+        }
+        node.children = std::move(children);
+        node.self_ms = std::max(0.0, node.total_ms - children_ms);
+        node.self_shared_read = std::max(0.0, node.shared_read - children_read);
+        node.self_temp_written = std::max(0.0, node.temp_written - children_temp_written);
+        return index;
+    }
+
+    // How far the row estimate was off, as a factor of at least 1.
+    static double misestimate(const Node& node) {
+        double estimated = std::max(node.estimated_rows, 1.0);
+        double actual = std::max(node.actual_rows, 1.0);
+        return std::max(estimated / actual, actual / estimated);
+    }
+
+    static crow::json::wvalue render(const std::vector<Node>& nodes, size_t index, bool analyzed) {
+        const Node& node = nodes[index];
+        const crow::json::rvalue& plan = *node.plan;
+        crow::json::wvalue out;
+        out["id"] = index;
+        out["node_type"] = text(plan, "Node Type");
+        for (const auto& [field, name] : {std::pair<const char*, const char*>{"Relation Name", "relation"},
+                                          {"Schema", "schema"},
+                                          {"Alias", "alias"},
+                                          {"Index Name", "index"},
+                                          {"Join Type", "join_type"},
+                                          {"Strategy", "strategy"},
+                                          {"Parent Relationship", "parent_relationship"},
+                                          {"Subplan Name", "subplan"},
+                                          {"Filter", "filter"},
+                                          {"Index Cond", "index_condition"},
+                                          {"Hash Cond", "hash_condition"},
+                                          {"Merge Cond", "merge_condition"},
+                                          {"Join Filter", "join_filter"},
+                                          {"Sort Method", "sort_method"}}) {
+            if (plan.has(field)) {
+                out[name] = text(plan, field);
+            }
+        }
+        out["total_cost"] = number(plan, "Total Cost");
+        out["estimated_rows"] = node.estimated_rows;
+        if (analyzed) {
+            out["loops"] = node.loops;
+            out["actual_rows"] = node.actual_rows;
+            out["total_ms"] = node.total_ms;
+            out["self_ms"] = node.self_ms;
+            out["row_estimate_error"] = misestimate(node);
+            out["rows_removed_by_filter"] = number(plan, "Rows Removed by Filter");
+            out["shared_hit_blocks"] = node.shared_hit;
+            out["shared_read_blocks"] = node.shared_read;
+            out["self_shared_read_blocks"] = node.self_shared_read;
+            out["temp_written_blocks"] = node.temp_written;
+            if (node.loops == 0) {
+                out["never_executed"] = true;
+            }
+        }
+        crow::json::wvalue::list children;
+        for (size_t child : node.children) {
+            children.push_back(render(nodes, child, analyzed));
+        }
+        out["children"] = std::move(children);
+        return out;
+    }
+
+    // Nodes worth looking at first, the slowest first. execution_ms is 0 for
+    // plans that did not run.
+    static crow::json::wvalue::list hotspots(const std::vector<Node>& nodes, double execution_ms) {
+        std::vector<size_t> order(nodes.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return nodes[a].self_ms > nodes[b].self_ms; });
+
+        crow::json::wvalue::list list;
+        if (execution_ms <= 0) {
+            return list;
+        }
+        for (size_t index : order) {
+            const Node& node = nodes[index];
+            std::vector<std::string> reasons;
+            if (node.self_ms >= HOTSPOT_TIME_SHARE * execution_ms) {
+                reasons.push_back("slow");
+            }
+            if (node.loops > 0 && misestimate(node) >= MISESTIMATE_FACTOR &&
+                std::max(node.estimated_rows, node.actual_rows) * std::max(node.loops, 1.0) >= MISESTIMATE_MIN_ROWS) {
+                reasons.push_back("row_misestimate");
+            }
+            if (node.self_shared_read >= HOTSPOT_READ_BLOCKS) {
+                reasons.push_back("disk_reads");
+            }
+            if (node.self_temp_written > 0) {
+                reasons.push_back("spills_to_disk");
+            }
+            if (reasons.empty()) {
+                continue;
+            }
+            crow::json::wvalue hotspot;
+            hotspot["id"] = index;
+            hotspot["node_type"] = text(*node.plan, "Node Type");
+            hotspot["self_ms"] = node.self_ms;
+            hotspot["time_share"] = node.self_ms / execution_ms;
+            crow::json::wvalue::list flags;
+            for (std::string& reason : reasons) {
+                flags.push_back(std::move(reason));
+            }
+            hotspot["reasons"] = std::move(flags);
+            list.push_back(std::move(hotspot));
+        }
+        return list;
+    }
+};
+
+#endif // EXPLAIN_PLAN_H
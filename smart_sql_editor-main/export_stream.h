@@ -0,0 +1,263 @@
+#ifndef EXPORT_STREAM_H
+#define EXPORT_STREAM_H
+
+#include <string>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <pqxx/pqxx>
+#include "connection_pool.h"
+#include "sql_lexer.h"
+#include "result_json.h"
+#include "query_registry.h"
+#include "gzip_encoder.h"
+
+// Produces a query's result as a file download, one chunk at a time. CSV
+// comes from COPY (query) TO STDOUT, converting each line from COPY's text
+// format as it arrives; NDJSON comes from a server-side cursor with one JSON
+// object per row. Only one chunk (and one FETCH batch) is held at a time, and
+// the output can be gzip-compressed on the fly. Exports run in a read-only
+// transaction, so COPY (DELETE ... RETURNING *) fails instead of deleting.
+class ExportStream {
+public:
+    enum class Format { Csv, Ndjson };
+
+    static constexpr size_t FETCH_SIZE = 1000;       // NDJSON rows per FETCH
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;  // uncompressed bytes per chunk
+
+    static const char* contentType(Format format) {
+        return format == Format::Csv ? "text/csv; charset=utf-8" : "application/x-ndjson";
+    }
+
+    static const char* extension(Format format) {
+        return format == Format::Csv ? "csv" : "ndjson";
+    }
+
+    // Starts the export. Errors up to the first row (syntax, permissions,
+    // statements that return no rows or that write, scripts of several
+    // statements) are thrown, so callers can still answer with an error
+    // document. The query is embedded in COPY or DECLARE, so it is trimmed
+    // to its one statement first, dropping trailing semicolons and comments. A CSV header needs
+    // the column names, which COPY does not report; they come from FETCH 0
+    // on a cursor for the query, declared in the same transaction.
+    static std::unique_ptr<ExportStream> open(PooledConnection conn,
+                                              const std::string& script,
+                                              Format format,
+                                              bool header,
+                                              bool gzip,
+                                              const QueryControl& control,
+                                              QueryRegistry::Registration registration) {
+        std::vector<std::string> statements = SqlLexer::splitStatements(script);
+        if (statements.size() != 1) {
+            throw std::invalid_argument("Export needs exactly one statement");
+        }
+        const std::string& query = statements.front();
+
+        std::unique_ptr<ExportStream> stream(new ExportStream(std::move(conn), format, std::move(registration)));
+        stream->txn_.exec(control.setLocalTimeoutSql());
+        if (gzip) {
+            stream->gzip_.emplace();
+        }
+
+        if (format == Format::Csv) {
+            if (header) {
+                stream->txn_.exec(declareSql(query));
+                pqxx::result columns = stream->txn_.exec("FETCH 0 FROM " + std::string(CURSOR_NAME));
+                stream->txn_.exec("CLOSE " + std::string(CURSOR_NAME));
+                for (int j = 0; j < columns.columns(); ++j) {
+                    if (j > 0) stream->pending_ += ',';
+                    const char* name = columns.column_name(j);
+                    appendCsvField(stream->pending_, name, std::strlen(name));
+                }
+                stream->pending_ += '\n';
+            }
+            stream->copy_.emplace(stream->txn_, pqxx::from_query, query);
+        } else {
+            stream->txn_.exec(declareSql(query));
+            stream->fetch();
+            for (int j = 0; j < stream->batch_.columns(); ++j) {
+                // Rendered once: ,"name": for every column.
+                std::string key = j > 0 ? "," : "";
+                const char* name = stream->batch_.column_name(j);
+                ResultJson::appendString(key, name, std::strlen(name));
+                key += ':';
+                stream->keys_.push_back(std::move(key));
+            }
+            stream->encodings_ = ResultJson::encodingsFor(stream->batch_);
+        }
+        return stream;
+    }
+
+    // Appends the next chunk of the file to out; returns false after the last
+    // one. Errors once the download has started are thrown: the response can
+    // no longer carry an error, so it is cut off instead.
+    bool next(std::string& out) {
+        if (finished_) {
+            return false;
+        }
+        bool more = fill();
+        if (!more) {
+            finish();
+        }
+        if (gzip_) {
+            gzip_->write(pending_, out);
+            if (!more) {
+                gzip_->finish(out);
+            }
+        } else {
+            out.swap(pending_);
+        }
+        pending_.clear();
+        finished_ = !more;
+        return more;
+    }
+
+private:
+    static constexpr const char* CURSOR_NAME = "sql_editor_export";
+
+    static std::string declareSql(const std::string& query) {
+        return "DECLARE " + std::string(CURSOR_NAME) + " NO SCROLL CURSOR FOR " + query;
+    }
+
+    ExportStream(PooledConnection conn, Format format, QueryRegistry::Registration registration)
+        : conn_(std::move(conn)), txn_(*conn_), registration_(std::move(registration)), format_(format) {}
+
+    // Adds rows to pending_ until a chunk's worth is ready. Returns false once
+    // the result is exhausted.
+    bool fill() {
+        while (pending_.size() < CHUNK_SIZE) {
+            if (format_ == Format::Csv) {
+                auto line = copy_->get_raw_line();
+                if (!line.first) {
+                    return false;
+                }
+                size_t size = line.second;
+                if (size > 0 && line.first.get()[size - 1] == '\n') --size;
+                appendCsvLine(pending_, line.first.get(), size);
+            } else {
+                if (batch_row_ == batch_.size()) {
+                    if (batch_.size() < static_cast<int>(FETCH_SIZE)) {
+                        return false;
+                    }
+                    fetch();
+                    continue;
+                }
+                appendJsonLine(pending_, batch_[batch_row_++]);
+            }
+        }
+        return true;
+    }
+
+    void fetch() {
+        batch_ = txn_.exec("FETCH FORWARD " + std::to_string(FETCH_SIZE) + " FROM " + CURSOR_NAME);
+        batch_row_ = 0;
+    }
+
+    void finish() {
+        if (format_ == Format::Csv) {
+            copy_->complete();
+        } else {
+            txn_.exec("CLOSE " + std::string(CURSOR_NAME));
+        }
+        txn_.commit();
+    }
+
+    void appendJsonLine(std::string& out, const pqxx::row& row) {
+        out += '{';
+        for (size_t j = 0; j < keys_.size(); ++j) {
+            out += keys_[j];
+            const pqxx::field field = row[static_cast<int>(j)];
+            if (field.is_null()) {
+                out += "null";
+            } else {
+                ResultJson::appendValue(out, field.c_str(), field.size(), encodings_[j]);
+            }
+        }
+        out += "}\n";
+    }
+
+    // Converts one line of COPY's text format (tab separated, backslash
+    // escapes, \N for NULL) to a CSV record. NULL becomes an empty field and
+    // an empty string a quoted "", as PostgreSQL's own CSV output does.
+    static void appendCsvLine(std::string& out, const char* line, size_t size) {
+        std::string field;
+        size_t start = 0;
+        for (size_t i = 0; i <= size; ++i) {
+            if (i < size && line[i] != '\t') {
+                continue;
+            }
+            if (start > 0) out += ',';
+            if (!(i - start == 2 && line[start] == '\\' && line[start + 1] == 'N')) {
+                field.clear();
+                unescapeCopyText(field, line + start, i - start);
+                appendCsvField(out, field.data(), field.size());
+            }
+            start = i + 1;
+        }
+        out += '\n';
+    }
+
+    static void unescapeCopyText(std::string& out, const char* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] != '\\' || i + 1 == size) {
+                out += data[i];
+                continue;
+            }
+            char c = data[++i];
+            switch (c) {
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'v': out += '\v'; break;
+                default:
+                    if (c >= '0' && c <= '7') {
+                        int value = 0;
+                        for (int k = 0; k < 3 && i < size && data[i] >= '0' && data[i] <= '7'; ++k, ++i) {
+                            value = value * 8 + (data[i] - '0');
+                        }
+                        --i;
+                        out += static_cast<char>(value);
+                    } else {
+                        out += c;  // \\ and any other escaped character stand for themselves
+                    }
+            }
+        }
+    }
+
+    static void appendCsvField(std::string& out, const char* data, size_t size) {
+        bool quote = size == 0;
+        for (size_t i = 0; i < size && !quote; ++i) {
+            char c = data[i];
+            quote = c == ',' || c == '"' || c == '\n' || c == '\r';
+        }
+        if (!quote) {
+            out.append(data, size);
+            return;
+        }
+        out += '"';
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] == '"') out += '"';
+            out += data[i];
+        }
+        out += '"';
+    }
+
+    PooledConnection conn_;
+    pqxx::read_transaction txn_;
+    QueryRegistry::Registration registration_;  // released before the connection
+    Format format_;
+    std::optional<pqxx::stream_from> copy_;     // CSV
+    pqxx::result batch_;                        // NDJSON
+    pqxx::result::size_type batch_row_ = 0;
+    std::vector<std::string> keys_;
+    std::vector<ResultJson::Encoding> encodings_;
+    std::optional<GzipEncoder> gzip_;
+    std::string pending_;
+    bool finished_ = false;
+};
+
+#endif // EXPORT_STREAM_H
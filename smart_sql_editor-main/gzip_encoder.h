@@ -0,0 +1,67 @@
+#ifndef GZIP_ENCODER_H
+#define GZIP_ENCODER_H
+
+#include <string>
+#include <stdexcept>
+#include <zlib.h>
+
+// Incremental gzip compressor for responses produced piece by piece. Each
+// write() appends whatever compressed output zlib has ready, so memory stays
+// bounded by zlib's window rather than by the size of the response.
+class GzipEncoder {
+public:
+    explicit GzipEncoder(int level = Z_DEFAULT_COMPRESSION) {
+        // 15 window bits + 16 selects the gzip wrapper instead of zlib's.
+        if (deflateInit2(&zs_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Failed to initialize gzip compression");
+        }
+    }
+
+    ~GzipEncoder() { deflateEnd(&zs_); }
+
+    GzipEncoder(const GzipEncoder&) = delete;
+    GzipEncoder& operator=(const GzipEncoder&) = delete;
+
+    void write(const char* data, size_t size, std::string& out) {
+        deflateChunk(data, size, Z_NO_FLUSH, out);
+    }
+
+    void write(const std::string& data, std::string& out) {
+        write(data.data(), data.size(), out);
+    }
+
+    // Flushes the remaining output and writes the gzip trailer.
+    void finish(std::string& out) {
+        deflateChunk(nullptr, 0, Z_FINISH, out);
+    }
+
+    // Compresses a whole buffer in one go.
+    static std::string compress(const std::string& data, int level = Z_BEST_COMPRESSION) {
+        GzipEncoder encoder(level);
+        std::string out;
+        encoder.write(data, out);
+        encoder.finish(out);
+        return out;
+    }
+
+private:
+    void deflateChunk(const char* data, size_t size, int flush, std::string& out) {
+        zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        zs_.avail_in = static_cast<uInt>(size);
+        char buffer[16384];
+        int status;
+        do {
+            zs_.next_out = reinterpret_cast<Bytef*>(buffer);
+            zs_.avail_out = sizeof(buffer);
+            status = deflate(&zs_, flush);
+            if (status == Z_STREAM_ERROR) {
+                throw std::runtime_error("gzip compression failed");
+            }
+            out.append(buffer, sizeof(buffer) - zs_.avail_out);
+        } while (zs_.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END));
+    }
+
+    z_stream zs_{};
+};
+
+#endif // GZIP_ENCODER_H
@@ -16,16 +16,12 @@ public:
         return editorTemplateHTML;
     }
 
-    // Embeds the DB parameters (as JSON) into the editor HTML and returns the result.
-    static std::string embedDBParams(const crow::json::wvalue& db_params) {
-        std::string html = editorTemplateHTML;
-        std::string script = "const DB_PARAMS = " + db_params.dump() + ";";
-        const std::string placeholder = "// DB_PARAMS_PLACEHOLDER";
-        size_t pos = html.find(placeholder);
-        if (pos != std::string::npos) {
-            html.replace(pos, placeholder.length(), script);
-        }
-        return html;
+    // The line of the editor template that dbParamsScript replaces.
+    static constexpr const char* DB_PARAMS_PLACEHOLDER = "// DB_PARAMS_PLACEHOLDER";
+
+    // The script that defines DB_PARAMS (as JSON) in the editor.
+    static std::string dbParamsScript(const crow::json::wvalue& db_params) {
+        return "const DB_PARAMS = " + db_params.dump() + ";";
     }
 
 private:
@@ -122,9 +118,14 @@ private:
             <textarea id="queryInput" placeholder="Enter your SQL query here..."></textarea>
             <br>
             <button onclick="executeQuery()">Execute Query</button>
+            <button onclick="executeScript()">Run as Script</button>
+            <button onclick="explainQuery()">Explain Analyze</button>
+            <button id="cancelButton" onclick="cancelQuery()" disabled>Cancel</button>
+            <button onclick="exportResults()">Export CSV</button>
             <div class="results">
                 <h2>Results</h2>
                 <div id="resultsTable"></div>
+                <button id="loadMoreButton" onclick="loadMoreRows()" style="display: none;">Load more rows</button>
                 <div id="errorMessage" class="error"></div>
             </div>
         </div>
@@ -134,14 +135,17 @@ private:
                 <option value="">Select a table...</option>
             </select>
             <div id="tableDetails" class="table-details"></div>
+            <input type="file" id="importFile" accept=".csv,.ndjson,.jsonl">
+            <button onclick="importFile()">Import into selected table</button>
         </div>
     </div>
 
     <script>
         // DB_PARAMS_PLACEHOLDER
 
-        // Fetch table list on page load
+        // Fetch table list on page load, then follow schema changes
     window.addEventListener('load', fetchTables);
+    window.addEventListener('load', subscribeSchemaEvents);
 
         async function fetchTables() {
             try {
@@ -157,24 +161,75 @@ private:
                     return;
                 }
 
-                const tableList = document.getElementById('tableList');
-                // Clear existing options except the first one
-                while (tableList.options.length > 1) {
-                    tableList.remove(1);
-                }
-                
-                // Add new options
-                data.tables.forEach(table => {
-                    const option = document.createElement('option');
-                    option.value = table;
-                    option.textContent = table;
-                    tableList.appendChild(option);
-                });
+                setTables(data.tables);
             } catch (error) {
                 document.getElementById('errorMessage').textContent = `Error: ${error.message}`;
             }
         }
 
+        function setTables(tables) {
+            const tableList = document.getElementById('tableList');
+            const selected = tableList.value;
+            // Clear existing options except the first one
+            while (tableList.options.length > 1) {
+                tableList.remove(1);
+            }
+            tables.forEach(addTableOption);
+            tableList.value = tables.includes(selected) ? selected : '';
+        }
+
+        function addTableOption(table) {
+            const option = document.createElement('option');
+            option.value = table;
+            option.textContent = table;
+            document.getElementById('tableList').appendChild(option);
+        }
+
+        // The server pushes schema changes: a snapshot of the table list when
+        // the socket opens, then only what DDL added, removed or changed. It
+        // covers every schema; the table list shows the public one.
+        let schemaRetryDelay = 1000;
+        function publicTables(tables) {
+            return tables.filter(table => table.schema === 'public').map(table => table.name);
+        }
+        function subscribeSchemaEvents() {
+            const scheme = location.protocol === 'https:' ? 'wss' : 'ws';
+            const socket = new WebSocket(`${scheme}://${location.host}/proxy/9999/schema_events`);
+            let failed = false;
+            socket.onopen = () => {
+                schemaRetryDelay = 1000;
+                socket.send(JSON.stringify(DB_PARAMS));
+            };
+            socket.onmessage = (event) => {
+                const message = JSON.parse(event.data);
+                const tableList = document.getElementById('tableList');
+                if (message.type === 'error') {
+                    failed = true;
+                    document.getElementById('errorMessage').textContent = `Error: ${message.error}`;
+                } else if (message.type === 'snapshot') {
+                    setTables(publicTables(message.tables));
+                } else if (message.type === 'delta') {
+                    const selected = tableList.value;
+                    const removed = publicTables(message.removed);
+                    publicTables(message.added).forEach(addTableOption);
+                    for (const option of Array.from(tableList.options)) {
+                        if (removed.includes(option.value)) option.remove();
+                    }
+                    if (removed.includes(selected)) {
+                        tableList.value = '';
+                        document.getElementById('tableDetails').innerHTML = '';
+                    } else if (publicTables(message.changed).includes(selected)) {
+                        getTableDetails();
+                    }
+                }
+            };
+            socket.onclose = () => {
+                if (failed) return;
+                setTimeout(subscribeSchemaEvents, schemaRetryDelay);
+                schemaRetryDelay = Math.min(schemaRetryDelay * 2, 30000);
+            };
+        }
+
 
 async function getTableDetails() {
     // Get the currently selected table name
@@ -286,16 +341,27 @@ async function getTableDetails() {
         document.getElementById('errorMessage').textContent = `Error: ${error.message}`;
     }
 }
+       // Rows per page; the rest of a large result stays on the server until requested.
+       const PAGE_SIZE = 500;
+       let runningRequestId = null;
+       let nextCursorId = null;
+
        async function executeQuery() {
             const query = document.getElementById('queryInput').value.trim();
             if (!query) return alert('Please enter a SQL query.');
 
+            releaseCursor();
+            const requestId = crypto.randomUUID();
+            runningRequestId = requestId;
+            document.getElementById('cancelButton').disabled = false;
             try {
                 const response = await fetch('/proxy/9999/query', {
                     method: 'POST',
                     headers: { 'Content-Type': 'application/json' },
                     body: JSON.stringify({
                         query: query,
+                        page_size: PAGE_SIZE,
+                        request_id: requestId,
                         dbname: DB_PARAMS.dbname,
                         user: DB_PARAMS.user,
                         password: DB_PARAMS.password,
@@ -305,12 +371,257 @@ async function getTableDetails() {
                 });
                 const data = await response.json();
                 displayResults(data);
+                setNextCursor(data);
+            } catch (error) {
+                displayResults({ error: 'Network error: ' + error.message });
+            } finally {
+                if (runningRequestId === requestId) {
+                    runningRequestId = null;
+                    document.getElementById('cancelButton').disabled = true;
+                }
+            }
+        }
 
-                // Check if the query is a CREATE TABLE statement
-                if (query.toLowerCase().includes('create table') && !data.error) {
-                    // Refresh the table list
-                    await fetchTables();
+        // Runs every statement of the editor in one transaction and shows
+        // each statement's outcome.
+        async function executeScript() {
+            const script = document.getElementById('queryInput').value.trim();
+            if (!script) return alert('Please enter a SQL script.');
+
+            releaseCursor();
+            setNextCursor({});
+            const requestId = crypto.randomUUID();
+            runningRequestId = requestId;
+            document.getElementById('cancelButton').disabled = false;
+            try {
+                const response = await fetch('/proxy/9999/query', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({
+                        query: script,
+                        script: true,
+                        request_id: requestId,
+                        dbname: DB_PARAMS.dbname,
+                        user: DB_PARAMS.user,
+                        password: DB_PARAMS.password,
+                        host: DB_PARAMS.host,
+                        port: DB_PARAMS.port
+                    })
+                });
+                displayScriptResults(await response.json());
+            } catch (error) {
+                displayResults({ error: 'Network error: ' + error.message });
+            } finally {
+                if (runningRequestId === requestId) {
+                    runningRequestId = null;
+                    document.getElementById('cancelButton').disabled = true;
                 }
+            }
+        }
+
+        // Runs the statement under EXPLAIN ANALYZE (rolled back on the
+        // server) and lists the plan nodes, hotspots first.
+        async function explainQuery() {
+            const query = document.getElementById('queryInput').value.trim();
+            if (!query) return alert('Please enter a SQL query.');
+
+            releaseCursor();
+            setNextCursor({});
+            const requestId = crypto.randomUUID();
+            runningRequestId = requestId;
+            document.getElementById('cancelButton').disabled = false;
+            try {
+                const response = await fetch('/proxy/9999/explain', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({
+                        query: query,
+                        request_id: requestId,
+                        dbname: DB_PARAMS.dbname,
+                        user: DB_PARAMS.user,
+                        password: DB_PARAMS.password,
+                        host: DB_PARAMS.host,
+                        port: DB_PARAMS.port
+                    })
+                });
+                displayPlan(await response.json());
+            } catch (error) {
+                displayResults({ error: 'Network error: ' + error.message });
+            } finally {
+                if (runningRequestId === requestId) {
+                    runningRequestId = null;
+                    document.getElementById('cancelButton').disabled = true;
+                }
+            }
+        }
+
+        function displayPlan(data) {
+            if (!data.plan) return displayResults(data);
+
+            const flags = {};
+            data.hotspots.forEach(hotspot => flags[hotspot.id] = hotspot.reasons.join(', '));
+            const rows = [];
+            const visit = (node, depth) => {
+                let label = '  '.repeat(depth) + node.node_type;
+                if (node.relation) label += ` on ${node.relation}`;
+                if (node.index) label += ` using ${node.index}`;
+                rows.push([label, node.self_ms ?? null, node.total_ms ?? null, node.estimated_rows,
+                           node.actual_rows ?? null, node.shared_hit_blocks ?? null,
+                           node.shared_read_blocks ?? null, flags[node.id] ?? '']);
+                node.children.forEach(child => visit(child, depth + 1));
+            };
+            visit(data.plan, 0);
+            displayResults({
+                columns: ['Node', 'Self ms', 'Total ms', 'Estimated rows', 'Actual rows',
+                          'Buffer hits', 'Buffer reads', 'Hotspot'],
+                rows: rows
+            });
+            const summary = document.createElement('div');
+            summary.className = 'metadata-item';
+            summary.textContent = data.execution_ms !== undefined
+                ? `Planning ${data.planning_ms} ms, execution ${data.execution_ms} ms (rolled back).`
+                : `Planning ${data.planning_ms} ms.`;
+            document.getElementById('resultsTable').prepend(summary);
+        }
+
+        function setNextCursor(data) {
+            nextCursorId = data.has_more ? data.cursor_id : null;
+            document.getElementById('loadMoreButton').style.display = nextCursorId ? '' : 'none';
+        }
+
+        async function loadMoreRows() {
+            if (!nextCursorId) return;
+            const cursorId = nextCursorId;
+            setNextCursor({});
+            try {
+                const response = await fetch('/proxy/9999/query/next', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({
+                        cursor_id: cursorId,
+                        dbname: DB_PARAMS.dbname,
+                        user: DB_PARAMS.user,
+                        password: DB_PARAMS.password,
+                        host: DB_PARAMS.host,
+                        port: DB_PARAMS.port
+                    })
+                });
+                const data = await response.json();
+                if (data.error) {
+                    document.getElementById('errorMessage').textContent = `Error: ${data.error}`;
+                    return;
+                }
+                const tbody = document.querySelector('#resultsTable tbody');
+                if (tbody) appendRows(tbody, data.rows);
+                setNextCursor(data);
+            } catch (error) {
+                document.getElementById('errorMessage').textContent = 'Network error: ' + error.message;
+            }
+        }
+
+        // Lets the server release the previous result's cursor right away
+        // instead of after its idle timeout.
+        function releaseCursor() {
+            if (!nextCursorId) return;
+            fetch('/proxy/9999/query/close', {
+                method: 'POST',
+                headers: { 'Content-Type': 'application/json' },
+                body: JSON.stringify({
+                    cursor_id: nextCursorId,
+                    dbname: DB_PARAMS.dbname,
+                    user: DB_PARAMS.user,
+                    password: DB_PARAMS.password,
+                    host: DB_PARAMS.host,
+                    port: DB_PARAMS.port
+                })
+            }).catch(() => {});
+            setNextCursor({});
+        }
+
+        // Downloads the full result as CSV; the server streams it gzipped and
+        // the browser decompresses it on the way in.
+        async function exportResults() {
+            const query = document.getElementById('queryInput').value.trim();
+            if (!query) return alert('Please enter a SQL query.');
+
+            try {
+                const response = await fetch('/proxy/9999/export', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({
+                        query: query,
+                        format: 'csv',
+                        compression: 'gzip',
+                        dbname: DB_PARAMS.dbname,
+                        user: DB_PARAMS.user,
+                        password: DB_PARAMS.password,
+                        host: DB_PARAMS.host,
+                        port: DB_PARAMS.port
+                    })
+                });
+                if ((response.headers.get('Content-Type') || '').startsWith('application/json')) {
+                    const data = await response.json();
+                    document.getElementById('errorMessage').textContent = `Error: ${data.error}`;
+                    return;
+                }
+                const url = URL.createObjectURL(await response.blob());
+                const link = document.createElement('a');
+                link.href = url;
+                link.download = 'export.csv';
+                link.click();
+                URL.revokeObjectURL(url);
+            } catch (error) {
+                document.getElementById('errorMessage').textContent = 'Network error: ' + error.message;
+            }
+        }
+
+        async function importFile() {
+            const tableName = document.getElementById('tableList').value;
+            const file = document.getElementById('importFile').files[0];
+            if (!tableName) return alert('Please select a table.');
+            if (!file) return alert('Please choose a CSV or NDJSON file.');
+
+            const format = /\.(ndjson|jsonl)$/i.test(file.name) ? 'ndjson' : 'csv';
+            try {
+                const response = await fetch(`/proxy/9999/import?table=${encodeURIComponent(tableName)}&format=${format}`, {
+                    method: 'POST',
+                    headers: {
+                        'Content-Type': format === 'csv' ? 'text/csv' : 'application/x-ndjson',
+                        'X-DB-Name': DB_PARAMS.dbname,
+                        'X-DB-User': DB_PARAMS.user,
+                        'X-DB-Password': DB_PARAMS.password,
+                        'X-DB-Host': DB_PARAMS.host,
+                        'X-DB-Port': DB_PARAMS.port
+                    },
+                    body: file
+                });
+                const data = await response.json();
+                if (data.error) {
+                    document.getElementById('errorMessage').textContent = `Error: ${data.error}`;
+                    return;
+                }
+                document.getElementById('errorMessage').textContent = '';
+                alert(`Imported ${data.rows} rows into ${tableName}.`);
+            } catch (error) {
+                document.getElementById('errorMessage').textContent = 'Network error: ' + error.message;
+            }
+        }
+
+        async function cancelQuery() {
+            if (!runningRequestId) return;
+            try {
+                await fetch('/proxy/9999/query/cancel', {
+                    method: 'POST',
+                    headers: { 'Content-Type': 'application/json' },
+                    body: JSON.stringify({
+                        request_id: runningRequestId,
+                        dbname: DB_PARAMS.dbname,
+                        user: DB_PARAMS.user,
+                        password: DB_PARAMS.password,
+                        host: DB_PARAMS.host,
+                        port: DB_PARAMS.port
+                    })
+                });
             } catch (error) {
                 displayResults({ error: 'Network error: ' + error.message });
             }
@@ -328,34 +639,79 @@ async function getTableDetails() {
             }
 
             if (data.columns && data.rows?.length) {
-                const table = document.createElement('table');
-                const thead = document.createElement('thead');
-                const headerRow = document.createElement('tr');
-                
-                data.columns.forEach(column => {
-                    const th = document.createElement('th');
-                    th.textContent = column;
-                    headerRow.appendChild(th);
-                });
-                thead.appendChild(headerRow);
-                table.appendChild(thead);
-
-                const tbody = document.createElement('tbody');
-                data.rows.forEach(row => {
-                    const tr = document.createElement('tr');
-                    row.forEach(value => {
-                        const td = document.createElement('td');
-                        td.textContent = value;
-                        tr.appendChild(td);
-                    });
-                    tbody.appendChild(tr);
-                });
-                table.appendChild(tbody);
-                resultsTable.appendChild(table);
+                renderTable(resultsTable, data);
             } else {
                 resultsTable.textContent = 'No results found.';
             }
         }
+
+        function displayScriptResults(data) {
+            if (!data.statements) return displayResults(data);
+
+            const resultsTable = document.getElementById('resultsTable');
+            const errorMessage = document.getElementById('errorMessage');
+            resultsTable.innerHTML = '';
+            errorMessage.innerHTML = '';
+            data.statements.forEach((statement, i) => {
+                const heading = document.createElement('div');
+                heading.className = 'metadata-item';
+                let summary = `${i + 1}. ${statement.statement.split('\n')[0]}`;
+                if (statement.status === 'success') {
+                    summary += ` — ${statement.command} (${statement.duration_ms} ms)`;
+                    if (statement.truncated) summary += ', first rows only';
+                } else if (statement.status === 'error') {
+                    summary += ` — error: ${statement.error}`;
+                } else {
+                    summary += ' — skipped';
+                }
+                heading.textContent = summary;
+                resultsTable.appendChild(heading);
+                if (statement.columns?.length && statement.rows?.length) {
+                    renderTable(resultsTable, statement);
+                }
+            });
+            const footer = document.createElement('div');
+            footer.className = 'metadata-item';
+            footer.textContent = data.committed ? `Committed in ${data.duration_ms} ms.` : 'Rolled back.';
+            resultsTable.appendChild(footer);
+            if (data.error) {
+                errorMessage.textContent = `Error: ${data.error}`;
+            }
+        }
+
+        function renderTable(container, data) {
+            const table = document.createElement('table');
+            const thead = document.createElement('thead');
+            const headerRow = document.createElement('tr');
+
+            data.columns.forEach((column, i) => {
+                const th = document.createElement('th');
+                th.textContent = column;
+                if (data.types) th.title = data.types[i];
+                headerRow.appendChild(th);
+            });
+            thead.appendChild(headerRow);
+            table.appendChild(thead);
+
+            const tbody = document.createElement('tbody');
+            appendRows(tbody, data.rows);
+            table.appendChild(tbody);
+            container.appendChild(table);
+        }
+
+        function appendRows(tbody, rows) {
+            rows.forEach(row => {
+                const tr = document.createElement('tr');
+                row.forEach(value => {
+                    const td = document.createElement('td');
+                    // json/jsonb columns arrive as parsed JSON values.
+                    td.textContent = value === null ? 'NULL'
+                                   : typeof value === 'object' ? JSON.stringify(value) : value;
+                    tr.appendChild(td);
+                });
+                tbody.appendChild(tr);
+            });
+        }
     </script>
 </body>
 </html>
@@ -4,10 +4,14 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <optional>
 #include <stdexcept>
 #include <openssl/rand.h>
 #include <jwt-cpp/jwt.h>
 #include "crow_all.h"
+#include "metrics.h"
+#include "token_cache.h"
+#include "credential_store.h"
 
 class JWTAuth {
 private:
@@ -16,12 +20,12 @@ private:
     const int TOKEN_EXPIRY_SECONDS = 3600;
 
     std::string secure_key;
+    // Built once the key is loaded; verify() is const and safe to share.
+    decltype(jwt::verify()) verifier = jwt::verify();
+    VerifiedTokenCache verified_tokens;
 
-    std::vector<std::pair<std::string, std::string>> users = {
-        {"admin", "password123"},
-        {"user1", "mypassword"},
-        {"test", "test123"}
-    };
+    CredentialStore credentials;
+    HashWorkers hash_workers;
 
     std::string generate_secure_key(int length) {
         std::vector<unsigned char> buffer(length);
@@ -54,60 +58,81 @@ private:
         return token;
     }
 
-    bool validate_jwt(const std::string& token) {
+    // Checks a token's signature and claims once; afterwards its digest is
+    // found in verified_tokens until it expires. Returns who it was issued to
+    // and when it expires, or nothing if it is not valid.
+    std::optional<VerifiedTokenCache::Entry> validate_jwt(const std::string& token) {
+        std::string key = VerifiedTokenCache::digest(token);
+        if (auto entry = verified_tokens.find(key)) {
+            Metrics::instance().jwt_cache_hits.add();
+            return entry;
+        }
+
+        Metrics::ScopedTimer timer(Metrics::instance().jwt_verify);
         try {
             auto decoded = jwt::decode(token);
-            auto verifier = jwt::verify()
-                .allow_algorithm(jwt::algorithm::hs256{secure_key})
-                .with_issuer("auth_server");
             verifier.verify(decoded);
-            return true;
+            VerifiedTokenCache::Entry entry{decoded.get_payload_claim("username").as_string(),
+                                            decoded.get_expires_at()};
+            verified_tokens.insert(key, entry);
+            return entry;
         } catch (const std::exception& e) {
             std::cerr << "Token validation error: " << e.what() << std::endl;
-            return false;
+            return std::nullopt;
         }
     }
 
-    std::pair<bool, std::string> refresh_token_if_needed(const std::string& token) {
-        try {
-            auto decoded = jwt::decode(token);
-            auto exp = decoded.get_expires_at();
-            if (std::chrono::system_clock::now() + std::chrono::minutes(1) >= exp) {
-                std::string username = decoded.get_payload_claim("username").as_string();
-                std::string new_token = create_jwt(username);
-                return {true, new_token};
+    // A new token for tokens that expire within a minute, nothing otherwise.
+    std::optional<std::string> refresh_token_if_needed(const VerifiedTokenCache::Entry& verified) {
+        if (std::chrono::system_clock::now() + std::chrono::minutes(1) >= verified.expires_at) {
+            try {
+                return create_jwt(verified.username);
+            } catch (const std::exception& e) {
+                std::cerr << "Token refresh error: " << e.what() << std::endl;
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Token refresh error: " << e.what() << std::endl;
         }
-        return {false, ""};
+        return std::nullopt;
     }
 
 public:
-    JWTAuth() {
+    // The store defaults to the one credential_store.conf describes.
+    explicit JWTAuth(CredentialStore store = CredentialStore::load()) : credentials(std::move(store)) {
         load_or_generate_secure_key();
+        verifier.allow_algorithm(jwt::algorithm::hs256{secure_key}).with_issuer("auth_server");
     }
 
-    crow::response login(const crow::request& req) {
+    // The password is checked on hash_workers and res is completed on the
+    // request's io_service; a full queue answers 503 right away.
+    void login(const crow::request& req, crow::response& res) {
         auto x = crow::json::load(req.body);
-        if (!x) {
-            return crow::response(400, "Invalid JSON");
+        if (!x || !x.has("username") || !x.has("password")) {
+            res = crow::response(400, "Invalid JSON");
+            res.end();
+            return;
         }
 
         std::string username = x["username"].s();
         std::string password = x["password"].s();
-
-        for (const auto& user : users) {
-            if (user.first == username && user.second == password) {
-                std::string token = create_jwt(username);
-                crow::response res(200, "Login successful");
-                res.add_header("Set-Cookie", "jwt=" + token + "; HttpOnly; Path=/; Max-Age=" + std::to_string(TOKEN_EXPIRY_SECONDS));
-                return res;
-            }
+        asio::io_service& io = *req.io_service;
+        bool queued = hash_workers.submit([this, &io, &res, username, password] {
+            bool valid = credentials.check(username, password);
+            asio::post(io, [this, &res, username, valid] {
+                if (valid) {
+                    std::string token = create_jwt(username);
+                    res = crow::response(200, "Login successful");
+                    res.add_header("Set-Cookie", "jwt=" + token + "; HttpOnly; Path=/; Max-Age=" + std::to_string(TOKEN_EXPIRY_SECONDS));
+                } else {
+                    res = crow::response(401, "Invalid username or password");
+                }
+                res.end();
+            });
+        });
+        if (!queued) {
+            res = crow::response(503, "Too many login attempts, try again later");
+            res.end();
         }
-        return crow::response(401, "Invalid username or password");
     }
-    
+
     bool protect_route(const crow::request& req, crow::response& res) {
         auto cookie_header = req.get_header_value("Cookie");
         std::string token = "";
@@ -121,10 +146,9 @@ public:
         }
 
         if (!token.empty()) {
-            if (validate_jwt(token)) {
-                auto [refreshed, new_token] = refresh_token_if_needed(token);
-                if (refreshed) {
-                    res.add_header("Set-Cookie", "jwt=" + new_token + "; HttpOnly; Path=/; Max-Age=" + std::to_string(TOKEN_EXPIRY_SECONDS));
+            if (auto verified = validate_jwt(token)) {
+                if (auto new_token = refresh_token_if_needed(*verified)) {
+                    res.add_header("Set-Cookie", "jwt=" + *new_token + "; HttpOnly; Path=/; Max-Age=" + std::to_string(TOKEN_EXPIRY_SECONDS));
                 }
                 return true;
             }
@@ -0,0 +1,264 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <utility>
+#include <functional>
+
+// Process-wide counters and histograms, rendered in the Prometheus text
+// format by the /metrics routes. Recording never takes a lock: every metric
+// is split into SHARDS cache-line-sized slots, each thread adds to its own
+// slot with relaxed atomics, and the slots are only summed when rendering.
+//
+// Histograms count values in power-of-two buckets, like an HDR histogram
+// with one sub-bucket per octave, so observing is a bit scan and an
+// increment. Times are recorded in microseconds and exposed in seconds.
+class Metrics {
+public:
+    static constexpr size_t SHARDS = 16;
+
+    class Metric {
+    public:
+        Metric(const char* name, const char* help) : name_(name), help_(help) {}
+        virtual ~Metric() = default;
+        virtual void render(std::string& out) const = 0;
+
+    protected:
+        void renderHeader(std::string& out, const char* type) const {
+            out += "# HELP ";
+            out += name_;
+            out += ' ';
+            out += help_;
+            out += "\n# TYPE ";
+            out += name_;
+            out += ' ';
+            out += type;
+            out += '\n';
+        }
+
+        const char* name_;
+        const char* help_;
+    };
+
+    class Counter : public Metric {
+    public:
+        using Metric::Metric;
+
+        void add(uint64_t n = 1) {
+            shards_[shard()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t value() const {
+            uint64_t total = 0;
+            for (const Shard& shard : shards_) {
+                total += shard.value.load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        void render(std::string& out) const override {
+            renderHeader(out, "counter");
+            out += name_;
+            out += ' ';
+            out += std::to_string(value());
+            out += '\n';
+        }
+
+    private:
+        struct alignas(64) Shard {
+            std::atomic<uint64_t> value{0};
+        };
+        std::array<Shard, SHARDS> shards_;
+    };
+
+    class Histogram : public Metric {
+    public:
+        // Bucket i counts the values up to 2^i.
+        static constexpr size_t BUCKETS = 65;
+
+        // Values are exposed multiplied by scale, with the buckets from
+        // 2^first_bucket to 2^last_bucket (and +Inf).
+        Histogram(const char* name, const char* help, double scale, int first_bucket, int last_bucket)
+            : Metric(name, help), scale_(scale), first_bucket_(first_bucket), last_bucket_(last_bucket) {}
+
+        void observe(uint64_t value) {
+            Shard& shard = shards_[Metrics::shard()];
+            shard.buckets[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+            shard.sum.fetch_add(value, std::memory_order_relaxed);
+        }
+
+        // Records the microseconds since start.
+        void observeSince(std::chrono::steady_clock::time_point start) {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            observe(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count()));
+        }
+
+        static size_t bucketFor(uint64_t value) {
+            return value <= 1 ? 0 : 64 - static_cast<size_t>(__builtin_clzll(value - 1));
+        }
+
+        void render(std::string& out) const override {
+            std::array<uint64_t, BUCKETS> counts{};
+            uint64_t sum = 0;
+            for (const Shard& shard : shards_) {
+                for (size_t i = 0; i < BUCKETS; ++i) {
+                    counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+                }
+                sum += shard.sum.load(std::memory_order_relaxed);
+            }
+
+            renderHeader(out, "histogram");
+            uint64_t cumulative = 0;
+            char number[32];
+            for (size_t i = 0; i < BUCKETS; ++i) {
+                cumulative += counts[i];
+                if (static_cast<int>(i) < first_bucket_ || static_cast<int>(i) > last_bucket_) {
+                    continue;
+                }
+                std::snprintf(number, sizeof(number), "%.9g", static_cast<double>(uint64_t{1} << i) * scale_);
+                out += name_;
+                out += "_bucket{le=\"";
+                out += number;
+                out += "\"} ";
+                out += std::to_string(cumulative);
+                out += '\n';
+            }
+            out += name_;
+            out += "_bucket{le=\"+Inf\"} ";
+            out += std::to_string(cumulative);
+            std::snprintf(number, sizeof(number), "%.9g", static_cast<double>(sum) * scale_);
+            out += '\n';
+            out += name_;
+            out += "_sum ";
+            out += number;
+            out += '\n';
+            out += name_;
+            out += "_count ";
+            out += std::to_string(cumulative);
+            out += '\n';
+        }
+
+    private:
+        struct alignas(64) Shard {
+            std::array<std::atomic<uint64_t>, BUCKETS> buckets{};
+            std::atomic<uint64_t> sum{0};
+        };
+
+        double scale_;
+        int first_bucket_;
+        int last_bucket_;
+        std::array<Shard, SHARDS> shards_;
+    };
+
+    // Observes the time from construction to destruction.
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(Histogram& histogram)
+            : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+        ~ScopedTimer() { histogram_.observeSince(start_); }
+
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    private:
+        Histogram& histogram_;
+        std::chrono::steady_clock::time_point start_;
+    };
+
+    // Labelled samples of a gauge, e.g. {"thread=\"0\"", 3}.
+    using GaugeSamples = std::vector<std::pair<std::string, double>>;
+
+    static Metrics& instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    // 16us .. 33s, 64B .. 1GiB and 1 .. 16M rows.
+    Histogram connection_acquire{"sql_editor_connection_acquire_seconds",
+                                 "Time to check a connection out of the pool.", 1e-6, 4, 25};
+    Counter connection_acquire_timeouts{"sql_editor_connection_acquire_timeouts_total",
+                                        "Checkouts that gave up waiting for a free connection."};
+    Histogram query_execution{"sql_editor_query_execution_seconds",
+                              "Time the server took to execute a statement.", 1e-6, 4, 25};
+    Histogram serialization{"sql_editor_serialization_seconds",
+                            "Time to serialize a result as JSON or Arrow.", 1e-6, 4, 25};
+    Histogram query{"sql_editor_query_seconds",
+                    "Time to answer a /query request, streaming included.", 1e-6, 4, 25};
+    Histogram response_bytes{"sql_editor_response_bytes", "Size of /query responses.", 1, 6, 30};
+    Histogram rows_returned{"sql_editor_rows_returned", "Rows returned per /query request.", 1, 0, 24};
+    Counter queries{"sql_editor_queries_total", "/query requests answered."};
+    Counter query_errors{"sql_editor_query_errors_total", "/query requests that failed."};
+    Histogram metadata_write{"sql_editor_metadata_write_seconds",
+                             "Time to write one batch of table metadata.", 1e-6, 4, 25};
+    Histogram jwt_verify{"sql_editor_jwt_verify_seconds", "Time to verify a JWT not found in the cache.", 1e-6, 0, 20};
+    Counter jwt_cache_hits{"sql_editor_jwt_cache_hits_total", "JWTs accepted from the verified-token cache."};
+
+    void addGauge(const char* name, const char* help, std::function<GaugeSamples()> read) {
+        std::lock_guard<std::mutex> lock(gauges_mutex_);
+        gauges_.push_back(Gauge{name, help, std::move(read)});
+    }
+
+    std::string render() {
+        std::string out;
+        const Metric* metrics[] = {&connection_acquire, &connection_acquire_timeouts, &query_execution,
+                                   &serialization, &query, &response_bytes, &rows_returned, &queries,
+                                   &query_errors, &metadata_write, &jwt_verify, &jwt_cache_hits};
+        for (const Metric* metric : metrics) {
+            metric->render(out);
+        }
+        std::lock_guard<std::mutex> lock(gauges_mutex_);
+        char number[32];
+        for (const Gauge& gauge : gauges_) {
+            out += "# HELP ";
+            out += gauge.name;
+            out += ' ';
+            out += gauge.help;
+            out += "\n# TYPE ";
+            out += gauge.name;
+            out += " gauge\n";
+            for (const auto& [labels, value] : gauge.read()) {
+                std::snprintf(number, sizeof(number), "%.9g", value);
+                out += gauge.name;
+                if (!labels.empty()) {
+                    out += '{';
+                    out += labels;
+                    out += '}';
+                }
+                out += ' ';
+                out += number;
+                out += '\n';
+            }
+        }
+        return out;
+    }
+
+    static constexpr const char* CONTENT_TYPE = "text/plain; version=0.0.4";
+
+private:
+    struct Gauge {
+        const char* name;
+        const char* help;
+        std::function<GaugeSamples()> read;
+    };
+
+    Metrics() = default;
+
+    // The slot of the calling thread; threads are spread round-robin.
+    static size_t shard() {
+        static std::atomic<size_t> next{0};
+        thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % SHARDS;
+        return shard;
+    }
+
+    std::mutex gauges_mutex_;
+    std::vector<Gauge> gauges_;
+};
+
+#endif // METRICS_H
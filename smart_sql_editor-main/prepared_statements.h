@@ -0,0 +1,96 @@
+#ifndef PREPARED_STATEMENTS_H
+#define PREPARED_STATEMENTS_H
+
+#include <cstddef>
+#include <iterator>
+#include <pqxx/pqxx>
+
+// Catalog statements the API runs on every schema request. The pool prepares
+// them once on each new connection, so requests only bind parameters and
+// PostgreSQL parses and plans each statement once per connection. Names start
+// with "sql_editor_"; the pool counts them by that prefix after user SQL ran.
+class PreparedStatements {
+public:
+    // $1 = schema name.
+    static constexpr const char* TABLES = "sql_editor_tables";
+
+    // $1 = schema name, $2 = table name. A row per column, with the table-level
+    // fields repeated on every row; a table without columns still yields one
+    // row, with a NULL column name.
+    static constexpr const char* TABLE_DETAILS = "sql_editor_table_details";
+
+    // A row per table TABLES would list in any non-system schema: its schema,
+    // its name and an md5 over everything TABLE_DETAILS reports about it, so a
+    // changed signature means changed details.
+    static constexpr const char* TABLE_SIGNATURES = "sql_editor_table_signatures";
+
+    static void prepareAll(pqxx::connection& conn) {
+        for (const Statement& statement : STATEMENTS) {
+            conn.prepare(statement.name, statement.sql);
+        }
+    }
+
+    static constexpr size_t count() { return std::size(STATEMENTS); }
+
+private:
+    struct Statement {
+        const char* name;
+        const char* sql;
+    };
+
+    static constexpr Statement STATEMENTS[] = {
+        {TABLES,
+         "SELECT table_name FROM information_schema.tables "
+         "WHERE table_schema = $1 AND table_type = 'BASE TABLE'"},
+        {TABLE_DETAILS,
+         "SELECT "
+         "    a.attname, "
+         "    pg_catalog.format_type(a.atttypid, NULL) AS data_type, "
+         "    CASE "
+         "        WHEN a.atttypid IN (1042, 1043) AND a.atttypmod > 0 THEN a.atttypmod - 4 "
+         "        WHEN a.atttypid IN (1560, 1562) AND a.atttypmod > 0 THEN a.atttypmod "
+         "    END AS character_maximum_length, "
+         "    CASE WHEN a.attnotnull THEN 'NO' ELSE 'YES' END AS is_nullable, "
+         "    pg_catalog.pg_get_expr(ad.adbin, ad.adrelid) AS column_default, "
+         "    a.attnum AS ordinal_position, "
+         "    COALESCE(a.attnum = ANY (pk.indkey), false) AS is_primary_key, "
+         "    pg_catalog.col_description(c.oid, a.attnum) AS column_comment, "
+         "    pg_catalog.obj_description(c.oid, 'pg_class') AS table_comment, "
+         "    (SELECT pka.attname FROM pg_catalog.pg_attribute pka "
+         "     WHERE pka.attrelid = c.oid AND pka.attnum = pk.indkey[0]) AS primary_key_name "
+         "FROM pg_catalog.pg_class c "
+         "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+         "LEFT JOIN pg_catalog.pg_index pk ON pk.indrelid = c.oid AND pk.indisprimary "
+         "LEFT JOIN pg_catalog.pg_attribute a "
+         "    ON a.attrelid = c.oid AND a.attnum > 0 AND NOT a.attisdropped "
+         "LEFT JOIN pg_catalog.pg_attrdef ad ON ad.adrelid = c.oid AND ad.adnum = a.attnum "
+         "WHERE n.nspname = $1 AND c.relname = $2 "
+         "ORDER BY a.attnum"},
+        {TABLE_SIGNATURES,
+         "SELECT "
+         "    n.nspname, "
+         "    c.relname, "
+         "    md5(concat_ws('|', "
+         "        pg_catalog.obj_description(c.oid, 'pg_class'), "
+         "        (SELECT pk.indkey::text FROM pg_catalog.pg_index pk "
+         "         WHERE pk.indrelid = c.oid AND pk.indisprimary), "
+         "        (SELECT string_agg(concat_ws(':', a.attname, "
+         "                                     pg_catalog.format_type(a.atttypid, a.atttypmod), "
+         "                                     a.attnotnull, "
+         "                                     pg_catalog.pg_get_expr(ad.adbin, ad.adrelid), "
+         "                                     pg_catalog.col_description(c.oid, a.attnum)), "
+         "                           ',' ORDER BY a.attnum) "
+         "         FROM pg_catalog.pg_attribute a "
+         "         LEFT JOIN pg_catalog.pg_attrdef ad ON ad.adrelid = a.attrelid AND ad.adnum = a.attnum "
+         "         WHERE a.attrelid = c.oid AND a.attnum > 0 AND NOT a.attisdropped))) "
+         "FROM pg_catalog.pg_class c "
+         "JOIN pg_catalog.pg_namespace n ON n.oid = c.relnamespace "
+         "WHERE n.nspname <> 'information_schema' AND n.nspname !~ '^pg_' AND c.relkind IN ('r', 'p') "
+         // The visibility rule of information_schema.tables.
+         "AND (pg_catalog.pg_has_role(c.relowner, 'USAGE') "
+         "     OR pg_catalog.has_table_privilege(c.oid, 'SELECT, INSERT, UPDATE, DELETE, TRUNCATE, REFERENCES, TRIGGER') "
+         "     OR pg_catalog.has_any_column_privilege(c.oid, 'SELECT, INSERT, UPDATE, REFERENCES'))"},
+    };
+};
+
+#endif // PREPARED_STATEMENTS_H
@@ -0,0 +1,87 @@
+#ifndef QUANTILE_SKETCH_H
+#define QUANTILE_SKETCH_H
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+// Streaming quantile estimate of positive values (latencies) in bounded
+// memory, after DDSketch: values fall into logarithmic buckets whose bounds
+// grow by a factor of GAMMA, so any quantile is reported within
+// RELATIVE_ACCURACY of the true value. Bucket counts are dense from the
+// lowest to the highest bucket seen; past MAX_BUCKETS the lowest buckets are
+// merged, which only costs accuracy at the fast end.
+class QuantileSketch {
+public:
+    static constexpr double RELATIVE_ACCURACY = 0.01;
+    static constexpr double GAMMA = (1 + RELATIVE_ACCURACY) / (1 - RELATIVE_ACCURACY);
+    // Values below this count as zero.
+    static constexpr double MIN_VALUE = 1e-6;
+    static constexpr size_t MAX_BUCKETS = 2048;
+
+    void add(double value) {
+        ++count_;
+        if (value < MIN_VALUE) {
+            ++zeros_;
+            return;
+        }
+        int index = static_cast<int>(std::ceil(std::log(value) / LOG_GAMMA));
+        if (buckets_.empty()) {
+            offset_ = index;
+            buckets_.push_back(0);
+        } else if (index < offset_) {
+            if (static_cast<size_t>(offset_ + static_cast<int>(buckets_.size()) - index) > MAX_BUCKETS) {
+                index = offset_;  // below the retained range; counts as its lowest bucket
+            } else {
+                buckets_.insert(buckets_.begin(), static_cast<size_t>(offset_ - index), 0);
+                offset_ = index;
+            }
+        } else if (index >= offset_ + static_cast<int>(buckets_.size())) {
+            buckets_.resize(static_cast<size_t>(index - offset_) + 1, 0);
+            if (buckets_.size() > MAX_BUCKETS) {
+                size_t merged = buckets_.size() - MAX_BUCKETS;
+                uint64_t low = 0;
+                for (size_t i = 0; i <= merged; ++i) {
+                    low += buckets_[i];
+                }
+                buckets_.erase(buckets_.begin(), buckets_.begin() + static_cast<std::ptrdiff_t>(merged));
+                buckets_[0] = low;
+                offset_ += static_cast<int>(merged);
+            }
+        }
+        ++buckets_[static_cast<size_t>(index - offset_)];
+    }
+
+    uint64_t count() const { return count_; }
+
+    // Estimate of the q-quantile (0 <= q <= 1); 0 when nothing was added.
+    double quantile(double q) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(count_ - 1));
+        if (rank < zeros_) {
+            return 0;
+        }
+        uint64_t seen = zeros_;
+        for (size_t i = 0; i < buckets_.size(); ++i) {
+            seen += buckets_[i];
+            if (seen > rank) {
+                // The point of the bucket with the least relative error to both bounds.
+                return 2 * std::pow(GAMMA, offset_ + static_cast<int>(i)) / (GAMMA + 1);
+            }
+        }
+        return 2 * std::pow(GAMMA, offset_ + static_cast<int>(buckets_.size()) - 1) / (GAMMA + 1);
+    }
+
+private:
+    static inline const double LOG_GAMMA = std::log(GAMMA);
+
+    uint64_t count_ = 0;
+    uint64_t zeros_ = 0;
+    int offset_ = 0;  // index of buckets_[0]
+    std::vector<uint64_t> buckets_;
+};
+
+#endif // QUANTILE_SKETCH_H
@@ -0,0 +1,415 @@
+#ifndef QUERY_HISTORY_H
+#define QUERY_HISTORY_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+#include <iostream>
+#include <pqxx/pqxx>
+#include "crow_all.h"
+#include "connection_pool.h"
+#include "quantile_sketch.h"
+#include "metrics.h"
+#include "sql_lexer.h"
+
+// Records every /query execution. Records go into a fixed-size in-memory
+// ring and a background writer appends them in batches to a query_history
+// table in the database they ran against, next to metadata_table; when the
+// writer falls behind the oldest unwritten records are dropped. Alongside,
+// per-fingerprint statistics with latency quantiles are kept in memory for
+// the /query_history/stats endpoint.
+//
+// A database is only tracked once the pool has connected with its
+// parameters, so requests with made-up credentials or hosts leave nothing
+// behind, and it is forgotten after IDLE_TTL without executions. A database
+// whose write fails is skipped for WRITE_RETRY_DELAY, so an unreachable one
+// costs the writer one connect timeout now and then.
+class QueryHistory {
+public:
+    static constexpr size_t RING_CAPACITY = 8192;
+    static constexpr size_t MAX_BATCH_SIZE = 500;
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{1000};
+    // Longer statements are stored cut at this size.
+    static constexpr size_t MAX_QUERY_BYTES = 4096;
+    // Fingerprints per database; executions of further ones count as OTHER.
+    static constexpr size_t MAX_FINGERPRINTS = 5000;
+    static constexpr const char* OTHER = "(other)";
+    static constexpr std::chrono::minutes IDLE_TTL{30};
+    static constexpr std::chrono::seconds WRITE_RETRY_DELAY{30};
+
+private:
+    struct Database;
+
+public:
+    // Measures one execution from its start; finish() records it.
+    class Recording {
+    public:
+        Recording() = default;
+        Recording(Recording&& other) noexcept { *this = std::move(other); }
+        Recording& operator=(Recording&& other) noexcept {
+            if (this != &other) {
+                database_ = std::move(other.database_);
+                query_ = std::move(other.query_);
+                executed_at_ = other.executed_at_;
+                started_ = other.started_;
+                other.database_.reset();
+            }
+            return *this;
+        }
+
+        // An execution that never finished, e.g. a stream whose client went
+        // away, is recorded as failed.
+        ~Recording() { finish(-1, 0, true); }
+
+        // rows is -1 when unknown.
+        void finish(int64_t rows, size_t bytes, bool failed) {
+            if (!database_) {
+                return;
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started_;
+            QueryHistory::instance().record(std::move(database_), std::move(query_), executed_at_, elapsed.count(),
+                                            rows, bytes, failed);
+            database_.reset();
+        }
+
+        // Reads the outcome off a complete response: its body size, the
+        // X-Row-Count header and a leading "error" field.
+        void finish(crow::response& response) {
+            std::string rows = response.get_header_value("X-Row-Count");
+            bool failed = response.code >= 400 || response.body.compare(0, 9, "{\"error\":") == 0;
+            finish(rows.empty() ? -1 : std::stoll(rows), response.body.size(), failed);
+        }
+
+    private:
+        friend class QueryHistory;
+
+        std::shared_ptr<Database> database_;  // not yet tracked; see record()
+        std::string query_;
+        std::chrono::system_clock::time_point executed_at_;
+        std::chrono::steady_clock::time_point started_;
+    };
+
+    ~QueryHistory() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        writer_.join();
+    }
+
+    static QueryHistory& instance() {
+        // Construct the pool first so it outlives the writer.
+        ConnectionPool::instance();
+        static QueryHistory history;
+        return history;
+    }
+
+    Recording start(const std::string& query,
+                    const std::string& db_name,
+                    const std::string& db_user,
+                    const std::string& db_pass,
+                    const std::string& db_host,
+                    const std::string& db_port) {
+        Recording recording;
+        recording.database_ = std::make_shared<Database>();
+        recording.database_->key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        recording.database_->db_name = db_name;
+        recording.database_->db_user = db_user;
+        recording.database_->db_pass = db_pass;
+        recording.database_->db_host = db_host;
+        recording.database_->db_port = db_port;
+        recording.query_ = query;
+        recording.executed_at_ = std::chrono::system_clock::now();
+        recording.started_ = std::chrono::steady_clock::now();
+        return recording;
+    }
+
+    // The fingerprints of a database with the most total time first:
+    // {"fingerprints":[{"id","fingerprint","query","calls","errors",
+    //  "total_ms","mean_ms","p50_ms","p95_ms","p99_ms","rows","bytes"},..]}
+    crow::json::wvalue stats(const std::string& db_name,
+                             const std::string& db_user,
+                             const std::string& db_pass,
+                             const std::string& db_host,
+                             const std::string& db_port,
+                             size_t limit) {
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        crow::json::wvalue::list list;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto db = databases_.find(key);
+            if (db != databases_.end()) {
+                std::vector<const std::pair<const std::string, Stats>*> order;
+                for (const auto& entry : db->second->stats) {
+                    order.push_back(&entry);
+                }
+                std::sort(order.begin(), order.end(),
+                          [](auto* a, auto* b) { return a->second.total_ms > b->second.total_ms; });
+                order.resize(std::min(order.size(), limit));
+                for (const auto* entry : order) {
+                    const Stats& stats = entry->second;
+                    crow::json::wvalue item;
+                    item["id"] = fingerprintId(entry->first);
+                    item["fingerprint"] = entry->first;
+                    item["query"] = stats.sample;
+                    item["calls"] = stats.calls;
+                    item["errors"] = stats.errors;
+                    item["total_ms"] = stats.total_ms;
+                    item["mean_ms"] = stats.total_ms / static_cast<double>(stats.calls);
+                    item["p50_ms"] = stats.latency.quantile(0.50);
+                    item["p95_ms"] = stats.latency.quantile(0.95);
+                    item["p99_ms"] = stats.latency.quantile(0.99);
+                    item["rows"] = stats.rows;
+                    item["bytes"] = stats.bytes;
+                    list.push_back(std::move(item));
+                }
+            }
+        }
+        crow::json::wvalue result;
+        result["fingerprints"] = std::move(list);
+        result["status"] = "success";
+        return result;
+    }
+
+    // Identifies a fingerprint in query_history: its 64-bit FNV-1a hash in
+    // hex, which unlike std::hash is the same in every build.
+    static std::string fingerprintId(const std::string& fingerprint) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : fingerprint) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+        }
+        char id[17];
+        std::snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(hash));
+        return id;
+    }
+
+private:
+    struct Stats {
+        std::string sample;  // the first statement seen with this fingerprint
+        uint64_t calls = 0;
+        uint64_t errors = 0;
+        double total_ms = 0;
+        uint64_t rows = 0;
+        uint64_t bytes = 0;
+        QuantileSketch latency;
+    };
+
+    struct Database {
+        ConnectionKey key;
+        std::string db_name;
+        std::string db_user;
+        std::string db_pass;
+        std::string db_host;
+        std::string db_port;
+        bool table_created = false;  // by the writer
+        std::chrono::steady_clock::time_point write_retry_at;  // by the writer
+        std::chrono::steady_clock::time_point last_used;
+        std::unordered_map<std::string, Stats> stats;  // by fingerprint
+    };
+
+    struct Record {
+        std::shared_ptr<Database> database;
+        std::string fingerprint;
+        std::string query;
+        double executed_at;  // Unix time in milliseconds
+        double duration_ms;
+        int64_t rows;  // -1 when unknown
+        int64_t bytes;
+        bool failed;
+    };
+
+    QueryHistory() : ring_(RING_CAPACITY), writer_([this] { writeLoop(); }) {}
+
+    // candidate is the recording's database, added to databases_ unless it is
+    // there already; executions whose parameters never connected only count
+    // towards the process metrics.
+    void record(std::shared_ptr<Database> candidate,
+                std::string query,
+                std::chrono::system_clock::time_point executed_at,
+                double duration_ms,
+                int64_t rows,
+                size_t bytes,
+                bool failed) {
+        if (query.size() > MAX_QUERY_BYTES) {
+            // Cut on a character boundary; the column is text.
+            size_t size = MAX_QUERY_BYTES;
+            while (size > 0 && (static_cast<unsigned char>(query[size]) & 0xC0) == 0x80) {
+                --size;
+            }
+            query.resize(size);
+        }
+        Metrics& metrics = Metrics::instance();
+        metrics.queries.add();
+        metrics.query_errors.add(failed);
+        metrics.query.observe(static_cast<uint64_t>(duration_ms * 1000));
+        metrics.response_bytes.observe(bytes);
+        if (rows >= 0) {
+            metrics.rows_returned.observe(static_cast<uint64_t>(rows));
+        }
+
+        if (!ConnectionPool::instance().hasConnected(candidate->key)) {
+            return;
+        }
+
+        std::string fingerprint = SqlLexer::fingerprint(query);
+        std::chrono::duration<double, std::milli> since_epoch = executed_at.time_since_epoch();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Database>& database = databases_[candidate->key];
+        if (!database) {
+            database = std::move(candidate);
+        }
+        database->last_used = std::chrono::steady_clock::now();
+        auto it = database->stats.find(fingerprint);
+        if (it == database->stats.end()) {
+            bool full = database->stats.size() >= MAX_FINGERPRINTS;
+            it = database->stats.try_emplace(full ? OTHER : fingerprint).first;
+            if (it->second.calls == 0) {
+                it->second.sample = full ? std::string() : query;
+            }
+        }
+        Stats& stats = it->second;
+        ++stats.calls;
+        stats.errors += failed;
+        stats.total_ms += duration_ms;
+        stats.rows += rows > 0 ? static_cast<uint64_t>(rows) : 0;
+        stats.bytes += bytes;
+        stats.latency.add(duration_ms);
+
+        if (count_ == ring_.size()) {
+            ++dropped_;
+            head_ = (head_ + 1) % ring_.size();
+            --count_;
+        }
+        ring_[(head_ + count_) % ring_.size()] =
+            Record{database, std::move(fingerprint), std::move(query), since_epoch.count(), duration_ms,
+                   rows, static_cast<int64_t>(bytes), failed};
+        if (++count_ >= ring_.size() / 2) {
+            wake_.notify_one();
+        }
+    }
+
+    // Background writer: every FLUSH_INTERVAL, or sooner when the ring is
+    // half full, takes the buffered records and appends them to each
+    // database's query_history table, and forgets idle databases. Records
+    // of a failed batch are dropped, as are those of a database whose last
+    // write failed less than WRITE_RETRY_DELAY ago.
+    void writeLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait_for(lock, FLUSH_INTERVAL, [this] { return stopping_ || count_ >= ring_.size() / 2; });
+            if (dropped_ > 0) {
+                std::cerr << "Query history dropped " << dropped_ << " records" << std::endl;
+                dropped_ = 0;
+            }
+            std::unordered_map<Database*, std::vector<Record>> batches;
+            for (; count_ > 0; --count_) {
+                Record& record = ring_[head_];
+                Database* database = record.database.get();
+                batches[database].push_back(std::move(record));
+                head_ = (head_ + 1) % ring_.size();
+            }
+            auto now = std::chrono::steady_clock::now();
+            for (auto it = databases_.begin(); it != databases_.end();) {
+                if (now - it->second->last_used > IDLE_TTL) {
+                    it = databases_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            bool stopping = stopping_;
+            lock.unlock();
+
+            // The records keep their databases alive until written.
+            for (auto& [database, records] : batches) {
+                if (now < database->write_retry_at) {
+                    continue;
+                }
+                for (size_t begin = 0; begin < records.size(); begin += MAX_BATCH_SIZE) {
+                    try {
+                        insertBatch(*database, records, begin, std::min(records.size(), begin + MAX_BATCH_SIZE));
+                    } catch (const std::exception& e) {
+                        std::cerr << "Query history write to " << database->db_name << "@" << database->db_host
+                                  << ":" << database->db_port << " failed: " << e.what() << std::endl;
+                        database->write_retry_at = std::chrono::steady_clock::now() + WRITE_RETRY_DELAY;
+                        break;
+                    }
+                }
+            }
+
+            if (stopping) {
+                return;
+            }
+            lock.lock();
+        }
+    }
+
+    // Appends records [begin, end) with a single INSERT that takes each
+    // column as an array, as Crud does for metadata_table.
+    static void insertBatch(Database& database, const std::vector<Record>& records, size_t begin, size_t end) {
+        std::vector<double> executed_at, durations;
+        std::vector<std::string> ids, fingerprints, queries, statuses;
+        std::vector<int64_t> rows, bytes;
+        for (size_t i = begin; i < end; ++i) {
+            const Record& record = records[i];
+            executed_at.push_back(record.executed_at);
+            ids.push_back(fingerprintId(record.fingerprint));
+            fingerprints.push_back(record.fingerprint);
+            queries.push_back(record.query);
+            durations.push_back(record.duration_ms);
+            rows.push_back(record.rows);
+            bytes.push_back(record.bytes);
+            statuses.push_back(record.failed ? "error" : "success");
+        }
+
+        PooledConnection conn = ConnectionPool::instance().acquire(database.db_name, database.db_user,
+                                                                   database.db_pass, database.db_host,
+                                                                   database.db_port);
+        pqxx::work txn(*conn);
+        // Only the writer thread touches table_created.
+        if (!database.table_created) {
+            txn.exec(
+                "CREATE TABLE IF NOT EXISTS query_history ("
+                "  id BIGSERIAL PRIMARY KEY, "
+                "  executed_at TIMESTAMPTZ NOT NULL, "
+                "  fingerprint_id TEXT NOT NULL, "
+                "  fingerprint TEXT NOT NULL, "
+                "  query TEXT NOT NULL, "
+                "  duration_ms DOUBLE PRECISION NOT NULL, "
+                "  rows BIGINT, "
+                "  bytes BIGINT NOT NULL, "
+                "  status TEXT NOT NULL"
+                ")");
+        }
+        txn.exec_params(
+            "INSERT INTO query_history "
+            "(executed_at, fingerprint_id, fingerprint, query, duration_ms, rows, bytes, status) "
+            "SELECT to_timestamp(t / 1000), id, f, q, d, NULLIF(r, -1), b, s "
+            "FROM unnest($1::float8[], $2::text[], $3::text[], $4::text[], $5::float8[], $6::int8[], "
+            "$7::int8[], $8::text[]) AS u(t, id, f, q, d, r, b, s)",
+            executed_at, ids, fingerprints, queries, durations, rows, bytes, statuses);
+        txn.commit();
+        database.table_created = true;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    // Databases that connected and ran something within IDLE_TTL.
+    std::unordered_map<ConnectionKey, std::shared_ptr<Database>, ConnectionKeyHash> databases_;
+    std::vector<Record> ring_;
+    size_t head_ = 0;  // oldest record
+    size_t count_ = 0;
+    uint64_t dropped_ = 0;
+    std::thread writer_;
+};
+
+#endif // QUERY_HISTORY_H
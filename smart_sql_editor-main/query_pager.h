@@ -0,0 +1,288 @@
+#ifndef QUERY_PAGER_H
+#define QUERY_PAGER_H
+
+#include <string>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <condition_variable>
+#include <pqxx/pqxx>
+#include "connection_pool.h"
+#include "result_json.h"
+#include "query_registry.h"
+#include "sql_lexer.h"
+#include "sql_classifier.h"
+
+// Serves the result of a row-returning query one page per request. The first
+// page is fetched through a server-side cursor whose connection and
+// transaction stay pinned until the last page has been read, the cursor is
+// closed, or it sits idle for longer than IDLE_TTL. Every page has the shape
+// of execute_query's document plus "has_more" and, while more rows remain,
+// the "cursor_id" to pass to next().
+class QueryPager {
+public:
+    static constexpr size_t DEFAULT_PAGE_SIZE = 500;
+    static constexpr size_t MAX_PAGE_SIZE = 10000;
+    // Each held cursor pins a pooled connection, so only a few may be open per
+    // database; opening another evicts the least recently used idle one.
+    static constexpr size_t MAX_CURSORS_PER_DATABASE = 4;
+    static constexpr std::chrono::seconds IDLE_TTL{120};
+    static constexpr std::chrono::seconds REAPER_INTERVAL{10};
+
+    ~QueryPager() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        reaper_.join();
+    }
+
+    static QueryPager& instance() {
+        // Construct the pool first so it outlives the held cursors.
+        ConnectionPool::instance();
+        static QueryPager pager;
+        return pager;
+    }
+
+    // Whether open() may take the query: a single statement that
+    // SqlClassifier counts as read-only. Cursors run in a read-only
+    // transaction that is rolled back when they are released, and the query
+    // is embedded in DECLARE, which would page the first statement of a
+    // script where execute_query returns the last.
+    static bool canPage(const std::string& query) {
+        return SqlLexer::splitStatements(query).size() == 1 && SqlClassifier::isReadOnly(query);
+    }
+
+    // Runs query through a new cursor and returns the first page. Returns
+    // nullopt when canPage() refuses the query or it cannot be declared as a
+    // cursor; callers then run it the regular way. The cursor runs on
+    // db_host:db_port, which may be a read replica of the server owner
+    // identifies; next() and close() take owner.
+    std::optional<std::string> open(const std::string& script,
+                                    size_t page_size,
+                                    const QueryControl& control,
+                                    const ConnectionKey& owner,
+                                    const std::string& db_name,
+                                    const std::string& db_user,
+                                    const std::string& db_pass,
+                                    const std::string& db_host,
+                                    const std::string& db_port) {
+        if (!canPage(script)) {
+            return std::nullopt;
+        }
+        // The statement alone, without trailing semicolons and comments.
+        const std::string query = SqlLexer::splitStatements(script).front();
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        makeRoom(key);
+
+        PooledConnection conn = ConnectionPool::instance().acquire(db_name, db_user, db_pass, db_host, db_port);
+        conn.mark_dirty();  // arbitrary user SQL may change session state
+        auto cursor = std::make_shared<Cursor>(std::move(conn), key, owner,
+                                               std::clamp<size_t>(page_size, 1, MAX_PAGE_SIZE));
+        std::string id = QueryRegistry::newRequestId();
+
+        std::string page;
+        bool more = false;
+        {
+            QueryRegistry::Registration registration = QueryRegistry::instance().add(control, owner, *cursor->conn);
+            // Applies to every FETCH, not to the time between pages.
+            cursor->txn->exec(control.setLocalTimeoutSql());
+            try {
+                cursor->txn->exec("DECLARE " + std::string(CURSOR_NAME) + " NO SCROLL CURSOR FOR " + query);
+            } catch (const pqxx::sql_error&) {
+                return std::nullopt;
+            }
+            more = fetchPage(*cursor, id, page);
+        }
+
+        if (more) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cursor->last_used = std::chrono::steady_clock::now();
+            cursors_.emplace(id, std::move(cursor));
+        }
+        return page;
+    }
+
+    // Fetches the next page of a held cursor. The cursor is released after
+    // its last page or an error.
+    std::string next(const std::string& cursor_id, const ConnectionKey& key, const QueryControl& control) {
+        std::shared_ptr<Cursor> cursor;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = cursors_.find(cursor_id);
+            if (it == cursors_.end() || !(it->second->owner == key)) {
+                throw std::runtime_error("Unknown or expired cursor");
+            }
+            if (it->second->busy) {
+                throw std::runtime_error("Cursor is already fetching a page");
+            }
+            cursor = it->second;
+            cursor->busy = true;
+        }
+
+        std::string page;
+        bool more = false;
+        try {
+            QueryRegistry::Registration registration = QueryRegistry::instance().add(control, key, *cursor->conn);
+            more = fetchPage(*cursor, cursor_id, page);
+        } catch (...) {
+            drop(cursor_id);
+            throw;
+        }
+
+        if (!more) {
+            drop(cursor_id);
+        } else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cursor->busy = false;
+            cursor->last_used = std::chrono::steady_clock::now();
+        }
+        return page;
+    }
+
+    // Releases a held cursor before its last page has been read.
+    bool close(const std::string& cursor_id, const ConnectionKey& key) {
+        std::shared_ptr<Cursor> cursor;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = cursors_.find(cursor_id);
+            if (it == cursors_.end() || !(it->second->owner == key) || it->second->busy) {
+                return false;
+            }
+            cursor = std::move(it->second);
+            cursors_.erase(it);
+        }
+        return true;  // rolled back and returned to the pool here, unlocked
+    }
+
+private:
+    static constexpr const char* CURSOR_NAME = "sql_editor_page";
+
+    struct Cursor {
+        Cursor(PooledConnection c, ConnectionKey k, ConnectionKey o, size_t size)
+            : conn(std::move(c)),
+              txn(new pqxx::read_transaction(*conn)),
+              key(std::move(k)), owner(std::move(o)), page_size(size) {}
+
+        PooledConnection conn;
+        std::unique_ptr<pqxx::transaction_base> txn;
+        ConnectionKey key;    // the pool the connection came from
+        ConnectionKey owner;  // the credentials of the request that opened it
+        size_t page_size;
+        std::string columns;  // names and types, rendered with the first page
+        std::vector<ResultJson::Encoding> encodings;
+
+        // Guarded by the pager's mutex.
+        bool busy = false;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    QueryPager() : reaper_([this] { reapLoop(); }) {}
+
+    // Renders the next page into out and returns whether more rows may
+    // follow. A short page closes the cursor and commits.
+    bool fetchPage(Cursor& cursor, const std::string& id, std::string& out) {
+        pqxx::result res = cursor.txn->exec("FETCH FORWARD " + std::to_string(cursor.page_size) + " FROM " + CURSOR_NAME);
+        if (cursor.columns.empty()) {
+            ResultJson::appendColumns(cursor.columns, res);
+            cursor.columns += ",\"types\":";
+            ResultJson::appendTypes(cursor.columns, res);
+            cursor.encodings = ResultJson::encodingsFor(res);
+        }
+
+        bool more = res.size() >= static_cast<int>(cursor.page_size);
+        if (!more) {
+            cursor.txn->exec("CLOSE " + std::string(CURSOR_NAME));
+            cursor.txn->commit();
+        }
+
+        out.reserve(cursor.columns.size() + 64);
+        out += "{\"columns\":";
+        out += cursor.columns;
+        out += ",\"rows\":[";
+        ResultJson::appendRows(out, res, cursor.encodings, false);
+        out += "],";
+        if (more) {
+            out += "\"cursor_id\":\"" + id + "\",\"has_more\":true";
+        } else {
+            out += "\"has_more\":false";
+        }
+        out += ",\"status\":\"success\"}";
+        return more;
+    }
+
+    void drop(const std::string& cursor_id) {
+        std::shared_ptr<Cursor> cursor;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = cursors_.find(cursor_id);
+        if (it != cursors_.end()) {
+            cursor = std::move(it->second);
+            cursors_.erase(it);
+        }
+    }
+
+    // Evicts least recently used idle cursors of this database until another
+    // one fits. Throws when every held cursor is busy.
+    void makeRoom(const ConnectionKey& key) {
+        std::vector<std::shared_ptr<Cursor>> evicted;
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (;;) {
+            size_t held = 0;
+            auto oldest = cursors_.end();
+            for (auto it = cursors_.begin(); it != cursors_.end(); ++it) {
+                if (!(it->second->key == key)) {
+                    continue;
+                }
+                ++held;
+                if (!it->second->busy &&
+                    (oldest == cursors_.end() || it->second->last_used < oldest->second->last_used)) {
+                    oldest = it;
+                }
+            }
+            if (held < MAX_CURSORS_PER_DATABASE) {
+                break;
+            }
+            if (oldest == cursors_.end()) {
+                throw std::runtime_error("Too many open cursors for this database");
+            }
+            evicted.push_back(std::move(oldest->second));
+            cursors_.erase(oldest);
+        }
+        // The lock is released before evicted, so the rollbacks happen unlocked.
+    }
+
+    // Releases cursors that have been idle for longer than IDLE_TTL.
+    void reapLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            wake_.wait_for(lock, REAPER_INTERVAL);
+            auto now = std::chrono::steady_clock::now();
+            std::vector<std::shared_ptr<Cursor>> expired;
+            for (auto it = cursors_.begin(); it != cursors_.end();) {
+                if (!it->second->busy && now - it->second->last_used > IDLE_TTL) {
+                    expired.push_back(std::move(it->second));
+                    it = cursors_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            lock.unlock();
+            expired.clear();
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::unordered_map<std::string, std::shared_ptr<Cursor>> cursors_;
+    std::thread reaper_;
+};
+
+#endif // QUERY_PAGER_H
@@ -0,0 +1,229 @@
+#ifndef QUERY_REGISTRY_H
+#define QUERY_REGISTRY_H
+
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <cctype>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+#include <random>
+#include <iostream>
+#include <pqxx/pqxx>
+#include "connection_pool.h"
+
+// Per-request execution settings for /query.
+struct QueryControl {
+    static constexpr int DEFAULT_STATEMENT_TIMEOUT_MS = 5 * 60 * 1000;
+    static constexpr int MAX_STATEMENT_TIMEOUT_MS = 60 * 60 * 1000;
+    static constexpr int DEFAULT_MAX_REPLICA_LAG_MS = 1000;
+    static constexpr size_t MAX_REQUEST_ID_LENGTH = 128;
+
+    std::string request_id;
+    int statement_timeout_ms = DEFAULT_STATEMENT_TIMEOUT_MS;  // 0 disables the timeout
+    std::function<bool()> client_alive;  // called from the watchdog thread; empty when the caller cannot tell
+    int max_replica_lag_ms = DEFAULT_MAX_REPLICA_LAG_MS;  // for reads sent to a replica; 0 keeps them on the primary
+
+    // Client-chosen IDs are echoed in the X-Request-Id header, so they are
+    // limited to [A-Za-z0-9._-]{1,128}.
+    static bool isValidRequestId(const std::string& id) {
+        if (id.empty() || id.size() > MAX_REQUEST_ID_LENGTH) {
+            return false;
+        }
+        return std::all_of(id.begin(), id.end(), [](char c) {
+            return std::isalnum(static_cast<unsigned char>(c)) || c == '.' || c == '_' || c == '-';
+        });
+    }
+
+    // "SET LOCAL statement_timeout = ..." for the current transaction.
+    std::string setLocalTimeoutSql() const {
+        return "SET LOCAL statement_timeout = " + std::to_string(statement_timeout_ms);
+    }
+
+    // Session-level variant for autocommit execution; the pooled connection
+    // resets it with the rest of the session state.
+    std::string setTimeoutSql() const {
+        return "SET statement_timeout = " + std::to_string(statement_timeout_ms);
+    }
+};
+
+// Tracks the queries that are currently running so they can be cancelled by
+// request ID, and cancels queries whose client has disconnected. A watchdog
+// thread polls each query's client_alive check a few times per second.
+class QueryRegistry {
+public:
+    static constexpr std::chrono::milliseconds WATCH_INTERVAL{250};
+
+    // Keeps a query registered for as long as it lives.
+    class Registration {
+    public:
+        Registration() = default;
+        Registration(Registration&& other) noexcept : id_(std::move(other.id_)) { other.id_.clear(); }
+        Registration& operator=(Registration&& other) noexcept {
+            if (this != &other) {
+                release();
+                id_ = std::move(other.id_);
+                other.id_.clear();
+            }
+            return *this;
+        }
+        ~Registration() { release(); }
+
+    private:
+        friend class QueryRegistry;
+        explicit Registration(std::string id) : id_(std::move(id)) {}
+
+        void release() {
+            if (!id_.empty()) {
+                QueryRegistry::instance().remove(id_);
+                id_.clear();
+            }
+        }
+
+        std::string id_;
+    };
+
+    ~QueryRegistry() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        watchdog_.join();
+    }
+
+    static QueryRegistry& instance() {
+        static QueryRegistry registry;
+        return registry;
+    }
+
+    static std::string newRequestId() {
+        thread_local std::mt19937_64 rng{std::random_device{}()};
+        static const char hex[] = "0123456789abcdef";
+        std::string id(32, '0');
+        for (size_t i = 0; i < id.size(); i += 16) {
+            uint64_t bits = rng();
+            for (size_t j = 0; j < 16; ++j, bits >>= 4) {
+                id[i + j] = hex[bits & 0x0f];
+            }
+        }
+        return id;
+    }
+
+    // Registers a running query on conn. Throws if the request ID is in use.
+    Registration add(const QueryControl& control, const ConnectionKey& key, pqxx::connection& conn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, inserted] = running_.try_emplace(control.request_id);
+        if (!inserted) {
+            throw std::runtime_error("request_id " + control.request_id + " is already running");
+        }
+        it->second.key = key;
+        it->second.conn = &conn;
+        it->second.client_alive = control.client_alive;
+        return Registration(control.request_id);
+    }
+
+    // Cancels the query running under request_id. Only callers presenting the
+    // same connection parameters the query was started with may cancel it.
+    bool cancel(const std::string& request_id, const ConnectionKey& key) {
+        RunningQuery* query;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = running_.find(request_id);
+            if (it == running_.end() || !(it->second.key == key)) {
+                return false;
+            }
+            query = &it->second;
+            if (!beginCancel(*query)) {
+                return true;
+            }
+        }
+        sendCancel(*query);
+        return true;
+    }
+
+private:
+    struct RunningQuery {
+        ConnectionKey key;
+        pqxx::connection* conn = nullptr;
+        std::function<bool()> client_alive;
+        bool cancelled = false;
+        bool cancelling = false;  // a cancel request is in flight; conn must stay open
+    };
+
+    QueryRegistry() : watchdog_([this] { watchLoop(); }) {}
+
+    // Waits for a cancel request in flight, which still uses the connection.
+    void remove(const std::string& id) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cancel_sent_.wait(lock, [&] {
+            auto it = running_.find(id);
+            return it == running_.end() || !it->second.cancelling;
+        });
+        running_.erase(id);
+    }
+
+    // Marks a query as cancelled under mutex_; returns false if it already
+    // was. The caller then sends the cancel request with sendCancel().
+    static bool beginCancel(RunningQuery& query) {
+        if (query.cancelled) {
+            return false;
+        }
+        query.cancelled = true;
+        query.cancelling = true;
+        return true;
+    }
+
+    // Sends a cancel request for the backend; the query then fails with
+    // "canceling statement due to user request" in its own thread. The
+    // request opens a new connection to the server and waits for it, so it
+    // is sent without holding mutex_; remove() waits for it instead, which
+    // keeps the entry and its connection alive until it is done.
+    void sendCancel(RunningQuery& query) {
+        try {
+            query.conn->cancel_query();
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to cancel query: " << e.what() << std::endl;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            query.cancelling = false;
+        }
+        cancel_sent_.notify_all();
+    }
+
+    void watchLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            wake_.wait_for(lock, WATCH_INTERVAL);
+            std::vector<RunningQuery*> disconnected;
+            for (auto& [id, query] : running_) {
+                if (!query.cancelled && query.client_alive && !query.client_alive()) {
+                    beginCancel(query);
+                    disconnected.push_back(&query);
+                }
+            }
+            if (disconnected.empty()) {
+                continue;
+            }
+            lock.unlock();
+            for (RunningQuery* query : disconnected) {
+                sendCancel(*query);
+            }
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable cancel_sent_;
+    bool stopping_ = false;
+    std::unordered_map<std::string, RunningQuery> running_;
+    std::thread watchdog_;
+};
+
+#endif // QUERY_REGISTRY_H
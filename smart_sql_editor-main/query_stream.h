@@ -0,0 +1,181 @@
+#ifndef QUERY_STREAM_H
+#define QUERY_STREAM_H
+
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <pqxx/pqxx>
+#include "connection_pool.h"
+#include "result_json.h"
+#include "arrow_ipc.h"
+#include "query_registry.h"
+#include "sql_lexer.h"
+#include "sql_classifier.h"
+
+// Output formats of /query.
+enum class ResultFormat { Json, Arrow };
+
+// Runs a row-returning statement through a server-side cursor and renders the
+// result one batch at a time, either as JSON with the same shape as the
+// document built by execute_query or as an Arrow IPC stream with a record
+// batch per FETCH. At most one batch of rows is held in memory no matter how
+// large the result is.
+class QueryStream {
+public:
+    static constexpr size_t DEFAULT_BATCH_SIZE = 1000;
+    static constexpr size_t MAX_BATCH_SIZE = 50000;
+
+    // Whether open() may take the query: a single statement that
+    // SqlClassifier counts as read-only. The query is embedded in DECLARE,
+    // so a script like "SELECT 1; DELETE FROM t" would run its later
+    // statements; scripts and anything that may write are not streamed.
+    static bool canStream(const std::string& query) {
+        return SqlLexer::splitStatements(query).size() == 1 && SqlClassifier::isReadOnly(query);
+    }
+
+    // Declares the cursor and fetches the first batch. Returns nullptr when
+    // canStream() refuses the query or the server refuses to declare a cursor
+    // for it (SHOW, EXPLAIN); callers then run it the regular way. Errors
+    // while fetching the first batch are thrown. The registration keeps the
+    // query cancellable until the stream is done.
+    static std::unique_ptr<QueryStream> open(PooledConnection conn,
+                                             const std::string& script,
+                                             size_t batch_size,
+                                             ResultFormat format,
+                                             const QueryControl& control,
+                                             QueryRegistry::Registration registration) {
+        if (!canStream(script)) {
+            return nullptr;
+        }
+        // The statement alone, without trailing semicolons and comments.
+        const std::string query = SqlLexer::splitStatements(script).front();
+        std::unique_ptr<QueryStream> stream(new QueryStream(std::move(conn), batch_size, format, std::move(registration)));
+        // Applies to every FETCH, not to the time the client takes to read.
+        stream->txn_.exec(control.setLocalTimeoutSql());
+        if (format == ResultFormat::Arrow) {
+            stream->txn_.exec(ArrowIpc::SET_DATESTYLE_SQL);
+        }
+        try {
+            stream->txn_.exec("DECLARE " + std::string(CURSOR_NAME) + " NO SCROLL CURSOR FOR " + query);
+        } catch (const pqxx::sql_error&) {
+            return nullptr;
+        }
+        stream->fetch();
+        return stream;
+    }
+
+    // Appends the next part of the output to out. Returns false once the
+    // closing part has been written. An error after streaming has started is
+    // reported in the JSON document's "error" field, as execute_query does.
+    // An Arrow stream has no place for it, and readers take a clean end at a
+    // message boundary for the end of the stream, so the error is rethrown:
+    // the body generator then drops the connection without the last chunk
+    // and the client sees a truncated response.
+    bool next(std::string& out) {
+        if (finished_) {
+            return false;
+        }
+        try {
+            if (!header_written_) {
+                writeHeader(out);
+            } else {
+                fetch();
+            }
+            writeRows(out);
+            if (batch_.size() < static_cast<int>(batch_size_)) {
+                txn_.exec("CLOSE " + std::string(CURSOR_NAME));
+                txn_.commit();
+                writeFooter(out);
+                finished_ = true;
+            }
+        } catch (const std::exception& e) {
+            failed_ = true;
+            finished_ = true;
+            if (format_ == ResultFormat::Arrow) {
+                registration_ = QueryRegistry::Registration();
+                throw;
+            }
+            writeError(out, e.what());
+        }
+        if (finished_) {
+            registration_ = QueryRegistry::Registration();
+        }
+        return !finished_;
+    }
+
+    size_t rowsWritten() const { return rows_written_; }
+
+    // Whether the stream ended with an error instead of its last row.
+    bool failed() const { return failed_; }
+
+private:
+    static constexpr const char* CURSOR_NAME = "sql_editor_stream";
+
+    QueryStream(PooledConnection conn, size_t batch_size, ResultFormat format,
+                QueryRegistry::Registration registration)
+        : conn_(std::move(conn)), txn_(*conn_), registration_(std::move(registration)),
+          batch_size_(std::clamp<size_t>(batch_size, 1, MAX_BATCH_SIZE)), format_(format) {}
+
+    void fetch() {
+        batch_ = txn_.exec("FETCH FORWARD " + std::to_string(batch_size_) + " FROM " + CURSOR_NAME);
+    }
+
+    void writeHeader(std::string& out) {
+        header_written_ = true;
+        if (format_ == ResultFormat::Arrow) {
+            arrow_types_ = ArrowIpc::typesFor(batch_);
+            ArrowIpc::appendSchema(out, batch_, arrow_types_);
+            return;
+        }
+        out += "{\"columns\":";
+        ResultJson::appendColumns(out, batch_);
+        out += ",\"types\":";
+        ResultJson::appendTypes(out, batch_);
+        out += ",\"rows\":[";
+        encodings_ = ResultJson::encodingsFor(batch_);
+    }
+
+    void writeRows(std::string& out) {
+        if (format_ == ResultFormat::Arrow) {
+            // The final FETCH comes back empty when the row count is a
+            // multiple of the batch size; it needs no record batch.
+            if (!batch_.empty() || rows_written_ == 0) {
+                ArrowIpc::appendRecordBatch(out, batch_, arrow_types_);
+            }
+        } else {
+            ResultJson::appendRows(out, batch_, encodings_, rows_written_ > 0);
+        }
+        rows_written_ += batch_.size();
+    }
+
+    void writeFooter(std::string& out) {
+        if (format_ == ResultFormat::Arrow) {
+            ArrowIpc::appendEndOfStream(out);
+        } else {
+            out += "],\"status\":\"success\"}";
+        }
+    }
+
+    void writeError(std::string& out, const char* message) {
+        out += "],\"error\":";
+        ResultJson::appendString(out, message, std::strlen(message));
+        out += '}';
+    }
+
+    PooledConnection conn_;
+    pqxx::work txn_;
+    QueryRegistry::Registration registration_;  // released before the connection
+    size_t batch_size_;
+    pqxx::result batch_;
+    ResultFormat format_;
+    std::vector<ResultJson::Encoding> encodings_;
+    std::vector<ArrowIpc::Type> arrow_types_;
+    size_t rows_written_ = 0;
+    bool header_written_ = false;
+    bool finished_ = false;
+    bool failed_ = false;
+};
+
+#endif // QUERY_STREAM_H
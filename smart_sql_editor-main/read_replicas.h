@@ -0,0 +1,261 @@
+#ifndef READ_REPLICAS_H
+#define READ_REPLICAS_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <optional>
+#include <unordered_map>
+#include <condition_variable>
+#include <iostream>
+#include <pqxx/pqxx>
+#include "connection_pool.h"
+
+// Spreads read-only statements over the read replicas of a primary. The
+// replicas are listed in CONFIG_FILE, one primary per line followed by its
+// replicas, all as host:port:
+//
+//     10.0.0.5:5432 10.0.0.6:5432 10.0.0.7:5432
+//
+// Streaming replicas share the primary's databases and roles, so requests
+// use their own credentials unchanged. A probe thread measures every replica
+// in use once per PROBE_INTERVAL; reads go round-robin to the replicas that
+// are in recovery, lag less than the request allows, and have replayed the
+// last write made through the editor with the same credentials. When none
+// qualifies the read runs on the primary.
+class ReadReplicas {
+public:
+    static constexpr const char* CONFIG_FILE = "read_replicas.conf";
+    static constexpr std::chrono::milliseconds PROBE_INTERVAL{1000};
+    // Replicas nobody has read from for this long are no longer probed, and
+    // credentials that neither read nor wrote for this long are forgotten.
+    static constexpr std::chrono::seconds IDLE_AFTER{300};
+
+    // Where a statement runs: the primary from the request or a replica.
+    struct Target {
+        std::string host;
+        std::string port;
+        bool replica = false;
+    };
+
+    ~ReadReplicas() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        if (prober_.joinable()) {
+            prober_.join();
+        }
+    }
+
+    static ReadReplicas& instance() {
+        // Construct the pool first so it outlives the probes.
+        ConnectionPool::instance();
+        static ReadReplicas replicas;
+        return replicas;
+    }
+
+    bool hasReplicas(const std::string& db_host, const std::string& db_port) const {
+        return replicas_.count(db_host + ":" + db_port) > 0;
+    }
+
+    // Picks where a read-only statement of this request runs. A max_lag_ms
+    // of 0 keeps it on the primary.
+    Target pick(const std::string& db_name,
+                const std::string& db_user,
+                const std::string& db_pass,
+                const std::string& db_host,
+                const std::string& db_port,
+                int max_lag_ms) {
+        Target primary{db_host, db_port, false};
+        auto configured = replicas_.find(db_host + ":" + db_port);
+        if (configured == replicas_.end() || max_lag_ms <= 0) {
+            return primary;
+        }
+
+        ConnectionKey primary_key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        Session& session = sessions_[primary_key];
+        session.last_used = now;
+        std::vector<const Replica*> eligible;
+        for (const Target& target : configured->second) {
+            ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, target.host, target.port);
+            Replica& replica = replicas_in_use_[key];
+            if (replica.target.host.empty()) {
+                replica.target = target;
+                replica.db_name = db_name;
+                replica.db_user = db_user;
+                replica.db_pass = db_pass;
+                startProber();
+            }
+            replica.last_used = now;
+            if (replica.healthy && replica.lag_ms <= max_lag_ms && replica.replay_lsn >= session.last_write_lsn) {
+                eligible.push_back(&replica);
+            }
+        }
+        if (eligible.empty()) {
+            return primary;
+        }
+        return eligible[session.next++ % eligible.size()]->target;
+    }
+
+    // Takes a replica out of rotation until its next successful probe.
+    void markDown(const std::string& db_name,
+                  const std::string& db_user,
+                  const std::string& db_pass,
+                  const Target& target) {
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, target.host, target.port);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = replicas_in_use_.find(key);
+        if (it != replicas_in_use_.end()) {
+            it->second.healthy = false;
+        }
+    }
+
+    // Records the primary's WAL position after a write made with these
+    // credentials; later reads only go to replicas that have replayed it.
+    void noteWrite(const ConnectionKey& primary_key, uint64_t lsn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Session& session = sessions_[primary_key];
+        session.last_write_lsn = std::max(session.last_write_lsn, lsn);
+        session.last_used = std::chrono::steady_clock::now();
+        startProber();
+    }
+
+    // Parses a pg_lsn as text ("16/B374D848").
+    static uint64_t parseLsn(const std::string& text) {
+        size_t slash = text.find('/');
+        if (slash == std::string::npos) {
+            return 0;
+        }
+        return (std::stoull(text.substr(0, slash), nullptr, 16) << 32) |
+               std::stoull(text.substr(slash + 1), nullptr, 16);
+    }
+
+private:
+    struct Replica {
+        Target target;
+        std::string db_name;
+        std::string db_user;
+        std::string db_pass;
+        bool healthy = false;  // false until the first probe succeeds
+        int64_t lag_ms = 0;
+        uint64_t replay_lsn = 0;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    // Per-credentials routing state on the primary.
+    struct Session {
+        uint64_t last_write_lsn = 0;
+        size_t next = 0;
+        std::chrono::steady_clock::time_point last_used;
+    };
+
+    ReadReplicas() {
+        std::ifstream file(CONFIG_FILE);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            std::istringstream fields(line);
+            std::string primary;
+            std::string replica;
+            fields >> primary;
+            while (fields >> replica) {
+                size_t colon = replica.rfind(':');
+                if (colon == std::string::npos) {
+                    std::cerr << CONFIG_FILE << ": ignoring replica without a port: " << replica << std::endl;
+                    continue;
+                }
+                replicas_[primary].push_back(Target{replica.substr(0, colon), replica.substr(colon + 1), true});
+            }
+        }
+    }
+
+    // Called with mutex_ held.
+    void startProber() {
+        if (!prober_.joinable() && !stopping_) {
+            prober_ = std::thread([this] { probeLoop(); });
+        }
+    }
+
+    void probeLoop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            auto now = std::chrono::steady_clock::now();
+            std::vector<std::pair<ConnectionKey, Replica>> due;
+            for (auto it = replicas_in_use_.begin(); it != replicas_in_use_.end();) {
+                if (now - it->second.last_used > IDLE_AFTER) {
+                    it = replicas_in_use_.erase(it);
+                } else {
+                    due.emplace_back(it->first, it->second);
+                    ++it;
+                }
+            }
+            for (auto it = sessions_.begin(); it != sessions_.end();) {
+                if (now - it->second.last_used > IDLE_AFTER) {
+                    it = sessions_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            lock.unlock();
+
+            for (auto& [key, replica] : due) {
+                probe(replica);
+            }
+
+            lock.lock();
+            for (auto& [key, probed] : due) {
+                auto it = replicas_in_use_.find(key);
+                if (it != replicas_in_use_.end()) {
+                    it->second.healthy = probed.healthy;
+                    it->second.lag_ms = probed.lag_ms;
+                    it->second.replay_lsn = probed.replay_lsn;
+                }
+            }
+            wake_.wait_for(lock, PROBE_INTERVAL, [this] { return stopping_; });
+        }
+    }
+
+    // Lag is zero while everything received has been replayed, so an idle
+    // primary does not make its replicas look stale.
+    static void probe(Replica& replica) {
+        try {
+            PooledConnection conn = ConnectionPool::instance().acquire(
+                replica.db_name, replica.db_user, replica.db_pass, replica.target.host, replica.target.port);
+            pqxx::nontransaction txn(*conn);
+            pqxx::row row = txn.exec1(
+                "SELECT pg_is_in_recovery(), COALESCE(pg_last_wal_replay_lsn()::text, '0/0'), "
+                "CASE WHEN pg_last_wal_receive_lsn() = pg_last_wal_replay_lsn() THEN 0 "
+                "ELSE COALESCE(EXTRACT(EPOCH FROM now() - pg_last_xact_replay_timestamp()) * 1000, 0) END::bigint");
+            // A replica that is not in recovery has been promoted.
+            replica.healthy = row[0].as<bool>();
+            replica.replay_lsn = parseLsn(row[1].c_str());
+            replica.lag_ms = row[2].as<int64_t>();
+        } catch (const std::exception& e) {
+            std::cerr << "Read replica " << replica.target.host << ":" << replica.target.port
+                      << " probe failed: " << e.what() << std::endl;
+            replica.healthy = false;
+        }
+    }
+
+    // Read-only after construction.
+    std::unordered_map<std::string, std::vector<Target>> replicas_;  // by primary host:port
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::unordered_map<ConnectionKey, Replica, ConnectionKeyHash> replicas_in_use_;
+    std::unordered_map<ConnectionKey, Session, ConnectionKeyHash> sessions_;
+    std::thread prober_;
+};
+
+#endif // READ_REPLICAS_H
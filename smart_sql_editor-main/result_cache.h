@@ -0,0 +1,308 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+#include <unordered_set>
+#include "crow_all.h"
+#include "connection_pool.h"
+#include "sql_lexer.h"
+#include "sql_classifier.h"
+
+// Opt-in LRU cache of serialized /query responses for read-only statements,
+// keyed by the normalized SQL, the response format and the database and role
+// it ran as. A hit costs a hash lookup and a copy of the stored bytes.
+//
+// Invalidation is per database on a server, whichever role or spelling of
+// the host wrote to it (see databaseId). A response is stored with the value
+// of a version clock read before its statement ran and with the tables its
+// plan scans; it stays valid while none of those tables has been written
+// since. Tables are bumped by NOTIFYs on WRITE_CHANNEL (see SchemaCache), and
+// any DDL or write made through the editor bumps the whole database. Callers
+// only store responses while SchemaCache listens for those NOTIFYs. Writes
+// that neither report nor go through the editor are only bounded by the
+// entry's TTL.
+class ResultCache {
+public:
+    static constexpr const char* WRITE_CHANNEL = "sql_editor_write";
+    static constexpr size_t BUDGET_BYTES = 64 * 1024 * 1024;
+    static constexpr size_t MAX_ENTRY_BYTES = 4 * 1024 * 1024;
+    static constexpr int DEFAULT_TTL_MS = 60 * 1000;
+    static constexpr int MAX_TTL_MS = 60 * 60 * 1000;
+    // Databases tracked at once; beyond it, those without entries are dropped.
+    static constexpr size_t MAX_DATABASES = 1024;
+
+    struct Hit {
+        std::shared_ptr<const std::string> body;
+        std::string content_type;
+    };
+
+    // What a cached response depends on, read from its plan.
+    struct Dependencies {
+        std::vector<std::string> tables;  // schema.table
+        bool any_table = false;           // scans functions or foreign data
+    };
+
+    static ResultCache& instance() {
+        static ResultCache cache;
+        return cache;
+    }
+
+    // Returns the cache key for a statement, or nothing when the statement
+    // must not be cached: more than one statement, anything but a read-only
+    // SELECT, VALUES, TABLE or WITH query, and calls of volatile built-ins.
+    // Statements that get through are still run in a read-only transaction.
+    static std::optional<std::string> keyFor(const std::string& sql,
+                                             const std::string& format,
+                                             const ConnectionKey& database) {
+        static const std::unordered_set<std::string> volatile_functions = {
+            "now", "random", "nextval", "setval", "currval", "lastval", "gen_random_uuid",
+            "clock_timestamp", "statement_timestamp", "transaction_timestamp", "timeofday",
+            "current_timestamp", "current_time", "current_date", "localtime", "localtimestamp",
+            "txid_current", "pg_sleep"};
+
+        std::vector<SqlToken> tokens = SqlLexer::tokenize(sql);
+        while (!tokens.empty() && SqlLexer::isPunctuation(sql, tokens.back(), ';')) {
+            tokens.pop_back();
+        }
+        if (tokens.empty() ||
+            !(SqlLexer::isWord(sql, tokens[0], "select") || SqlLexer::isWord(sql, tokens[0], "values") ||
+              SqlLexer::isWord(sql, tokens[0], "table") || SqlLexer::isWord(sql, tokens[0], "with")) ||
+            !SqlClassifier::isReadOnly(sql)) {
+            return std::nullopt;
+        }
+
+        std::string key;
+        for (const std::string* part : {&format, &database.db_name, &database.db_user, &database.db_host,
+                                        &database.db_port, &database.password_hash}) {
+            key += *part;
+            key += '\0';
+        }
+        size_t prefix = key.size();
+        for (const SqlToken& token : tokens) {
+            if (SqlLexer::isPunctuation(sql, token, ';')) {
+                return std::nullopt;
+            }
+            std::string text = SqlLexer::lowerText(sql, token);
+            if (token.type == SqlToken::Type::Word && volatile_functions.count(text)) {
+                return std::nullopt;
+            }
+            if (key.size() > prefix) key += ' ';
+            key += text;
+        }
+        return key;
+    }
+
+    // Collects the tables an EXPLAIN (FORMAT JSON, VERBOSE) plan scans.
+    static Dependencies dependencies(const std::string& plan_json) {
+        Dependencies deps;
+        crow::json::rvalue plan = crow::json::load(plan_json);
+        if (!plan || plan.t() != crow::json::type::List || plan.size() == 0 || !plan[0].has("Plan")) {
+            deps.any_table = true;
+            return deps;
+        }
+        collect(plan[0]["Plan"], deps);
+        std::sort(deps.tables.begin(), deps.tables.end());
+        deps.tables.erase(std::unique(deps.tables.begin(), deps.tables.end()), deps.tables.end());
+        return deps;
+    }
+
+    std::optional<Hit> lookup(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            return std::nullopt;
+        }
+        Entry& entry = *it->second;
+        if (std::chrono::steady_clock::now() >= entry.expires || !isCurrent(entry)) {
+            erase(it->second);
+            return std::nullopt;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return Hit{entry.body, entry.content_type};
+    }
+
+    // The database a key connects to, as far as invalidation goes: host,
+    // port and database name, with the usual spellings of the local host
+    // taken as one. Roles do not take part; a write by one is seen by all.
+    static std::string databaseId(const ConnectionKey& database) {
+        std::string host;
+        for (char c : database.db_host) {
+            host.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+        if (host.empty() || host == "127.0.0.1" || host == "::1" || host[0] == '/') {
+            host = "localhost";
+        }
+        return host + ':' + (database.db_port.empty() ? "5432" : database.db_port) + '/' + database.db_name;
+    }
+
+    // Read before running a statement whose response may be stored. Starts
+    // tracking the database's writes if nothing did yet.
+    uint64_t version(const ConnectionKey& database) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string id = databaseId(database);
+        if (databases_.count(id) == 0) {
+            if (databases_.size() >= MAX_DATABASES) {
+                dropUnused();
+            }
+            // Writes made before now went unrecorded; only responses read
+            // after them are current.
+            auto versions = std::make_shared<DatabaseVersions>();
+            versions->epoch = ++clock_;
+            databases_.emplace(id, std::move(versions));
+        }
+        return clock_;
+    }
+
+    // Stores a response unless it is too large or something it depends on
+    // was written after version was read.
+    void store(const ConnectionKey& database,
+               const std::string& key,
+               std::string body,
+               const std::string& content_type,
+               Dependencies deps,
+               uint64_t version,
+               int ttl_ms) {
+        size_t size = key.size() + body.size() + content_type.size();
+        for (const std::string& table : deps.tables) {
+            size += table.size();
+        }
+        if (size > MAX_ENTRY_BYTES) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Dropped since version was read, so writes may have gone unrecorded.
+        auto versions = databases_.find(databaseId(database));
+        if (versions == databases_.end()) {
+            return;
+        }
+        Entry candidate{key, std::make_shared<const std::string>(std::move(body)), content_type,
+                        std::move(deps), versions->second, version, size,
+                        std::chrono::steady_clock::now() + std::chrono::milliseconds(ttl_ms)};
+        if (!isCurrent(candidate)) {
+            return;
+        }
+        auto existing = entries_.find(key);
+        if (existing != entries_.end()) {
+            erase(existing->second);
+        }
+        lru_.push_front(std::move(candidate));
+        entries_.emplace(lru_.front().key, lru_.begin());
+        bytes_ += size;
+        while (bytes_ > BUDGET_BYTES) {
+            erase(std::prev(lru_.end()));
+        }
+    }
+
+    // A NOTIFY reported a write to schema.table.
+    void tableWritten(const ConnectionKey& database, const std::string& table) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = databases_.find(databaseId(database));
+        if (it != databases_.end()) {
+            it->second->tables[table] = ++clock_;
+            it->second->any_table = clock_;
+        }
+    }
+
+    // Invalidates every response of a database.
+    void invalidate(const ConnectionKey& database) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = databases_.find(databaseId(database));
+        if (it != databases_.end()) {
+            it->second->epoch = ++clock_;
+        }
+    }
+
+private:
+    // Last bumps of one database. Every bump takes a new value of the shared
+    // clock, so a response stored at version v is stale once anything it
+    // depends on is above v.
+    struct DatabaseVersions {
+        uint64_t epoch = 0;      // last database-wide invalidation, or when tracking began
+        uint64_t any_table = 0;  // last table write of any table
+        std::unordered_map<std::string, uint64_t> tables;
+    };
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const std::string> body;
+        std::string content_type;
+        Dependencies deps;
+        std::shared_ptr<DatabaseVersions> versions;
+        uint64_t version;
+        size_t size;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    ResultCache() = default;
+
+    static void collect(const crow::json::rvalue& node, Dependencies& deps) {
+        if (node.has("Relation Name")) {
+            std::string schema = node.has("Schema") ? std::string(node["Schema"].s()) : "public";
+            deps.tables.push_back(schema + "." + std::string(node["Relation Name"].s()));
+        }
+        if (node.has("Node Type")) {
+            std::string type = node["Node Type"].s();
+            if (type == "Function Scan" || type == "Table Function Scan" || type == "Foreign Scan" ||
+                type == "Custom Scan") {
+                deps.any_table = true;
+            }
+        }
+        if (node.has("Plans")) {
+            for (const auto& child : node["Plans"]) {
+                collect(child, deps);
+            }
+        }
+    }
+
+    bool isCurrent(const Entry& entry) const {
+        const DatabaseVersions& versions = *entry.versions;
+        if (versions.epoch > entry.version || (entry.deps.any_table && versions.any_table > entry.version)) {
+            return false;
+        }
+        for (const std::string& table : entry.deps.tables) {
+            auto it = versions.tables.find(table);
+            if (it != versions.tables.end() && it->second > entry.version) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void erase(std::list<Entry>::iterator it) {
+        bytes_ -= it->size;
+        entries_.erase(it->key);
+        lru_.erase(it);
+    }
+
+    // Stops tracking databases no entry depends on. A statement that read
+    // their version before is then not stored (see store()).
+    void dropUnused() {
+        for (auto it = databases_.begin(); it != databases_.end();) {
+            if (it->second.use_count() == 1) {
+                it = databases_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    std::mutex mutex_;
+    size_t bytes_ = 0;
+    std::list<Entry> lru_;  // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+    uint64_t clock_ = 0;
+    // By databaseId; entries share their database's versions.
+    std::unordered_map<std::string, std::shared_ptr<DatabaseVersions>> databases_;
+};
+
+#endif // RESULT_CACHE_H
@@ -0,0 +1,255 @@
+#ifndef RESULT_JSON_H
+#define RESULT_JSON_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <pqxx/pqxx>
+
+namespace result_json_detail {
+    // Bytes that cannot appear unescaped inside a JSON string.
+    struct EscapeTable {
+        bool needs[256] = {};
+        constexpr EscapeTable() {
+            for (int c = 0; c < 0x20; ++c) needs[c] = true;
+            needs[static_cast<unsigned char>('"')] = true;
+            needs[static_cast<unsigned char>('\\')] = true;
+        }
+    };
+    inline constexpr EscapeTable ESCAPE_TABLE{};
+}
+
+// Serializes pqxx results straight into a JSON string, without building a
+// crow::json::wvalue tree first. Each column is formatted by its type OID:
+// numbers and booleans are written unquoted, json and jsonb values are
+// embedded as they are, and SQL NULL becomes JSON null.
+class ResultJson {
+public:
+    // How a column's text representation is written to JSON.
+    enum class Encoding { String, Number, Boolean, Json };
+
+    // Well-known type OIDs from pg_type.
+    static constexpr pqxx::oid BOOLOID = 16;
+    static constexpr pqxx::oid INT8OID = 20;
+    static constexpr pqxx::oid INT2OID = 21;
+    static constexpr pqxx::oid INT4OID = 23;
+    static constexpr pqxx::oid TEXTOID = 25;
+    static constexpr pqxx::oid OIDOID = 26;
+    static constexpr pqxx::oid JSONOID = 114;
+    static constexpr pqxx::oid FLOAT4OID = 700;
+    static constexpr pqxx::oid FLOAT8OID = 701;
+    static constexpr pqxx::oid NUMERICOID = 1700;
+    static constexpr pqxx::oid JSONBOID = 3802;
+
+    static Encoding encodingFor(pqxx::oid type) {
+        switch (type) {
+            case INT2OID: case INT4OID: case INT8OID: case OIDOID:
+            case FLOAT4OID: case FLOAT8OID: case NUMERICOID:
+                return Encoding::Number;
+            case BOOLOID:
+                return Encoding::Boolean;
+            case JSONOID: case JSONBOID:
+                return Encoding::Json;
+            default:
+                return Encoding::String;
+        }
+    }
+
+    static std::vector<Encoding> encodingsFor(const pqxx::result& res) {
+        std::vector<Encoding> encodings(res.columns());
+        for (int j = 0; j < res.columns(); ++j) {
+            encodings[j] = encodingFor(res.column_type(j));
+        }
+        return encodings;
+    }
+
+    // Name of a built-in type as in pg_type.typname. Other types (domains,
+    // enums, extension types) are reported by their OID.
+    static std::string typeName(pqxx::oid type) {
+        switch (type) {
+            case BOOLOID: return "bool";
+            case 17: return "bytea";
+            case 18: return "char";
+            case 19: return "name";
+            case INT8OID: return "int8";
+            case INT2OID: return "int2";
+            case INT4OID: return "int4";
+            case TEXTOID: return "text";
+            case OIDOID: return "oid";
+            case JSONOID: return "json";
+            case 142: return "xml";
+            case FLOAT4OID: return "float4";
+            case FLOAT8OID: return "float8";
+            case 790: return "money";
+            case 869: return "inet";
+            case 1042: return "bpchar";
+            case 1043: return "varchar";
+            case 1082: return "date";
+            case 1083: return "time";
+            case 1114: return "timestamp";
+            case 1184: return "timestamptz";
+            case 1186: return "interval";
+            case 1266: return "timetz";
+            case NUMERICOID: return "numeric";
+            case 2950: return "uuid";
+            case JSONBOID: return "jsonb";
+            default: return std::to_string(type);
+        }
+    }
+
+    // Returns the whole execute_query document:
+    // {"columns":[...],"types":[...],"rows":[[...],...],"status":"success"}
+    static std::string document(const pqxx::result& res) {
+        std::string out;
+        out.reserve(estimateSize(res) + 64);
+        out += "{\"columns\":";
+        appendColumns(out, res);
+        out += ",\"types\":";
+        appendTypes(out, res);
+        out += ",\"rows\":[";
+        appendRows(out, res, encodingsFor(res), false);
+        out += "],\"status\":\"success\"}";
+        return out;
+    }
+
+    // Appends the column names as a JSON array.
+    static void appendColumns(std::string& out, const pqxx::result& res) {
+        out += '[';
+        for (int j = 0; j < res.columns(); ++j) {
+            if (j > 0) out += ',';
+            const char* name = res.column_name(j);
+            appendString(out, name, std::strlen(name));
+        }
+        out += ']';
+    }
+
+    // Appends the column type names as a JSON array, in column order.
+    static void appendTypes(std::string& out, const pqxx::result& res) {
+        out += '[';
+        for (int j = 0; j < res.columns(); ++j) {
+            if (j > 0) out += ',';
+            std::string name = typeName(res.column_type(j));
+            appendString(out, name.data(), name.size());
+        }
+        out += ']';
+    }
+
+    // Appends every row, or the first max_rows, as a JSON array, separated by
+    // commas. When leading_comma is set a comma is written before the first
+    // row too, so batches can be appended to an array that already has rows.
+    static void appendRows(std::string& out, const pqxx::result& res,
+                           const std::vector<Encoding>& encodings, bool leading_comma,
+                           size_t max_rows = SIZE_MAX) {
+        const int columns = res.columns();
+        for (const auto& row : res) {
+            if (max_rows-- == 0) break;
+            if (leading_comma) out += ',';
+            leading_comma = true;
+            out += '[';
+            for (int j = 0; j < columns; ++j) {
+                if (j > 0) out += ',';
+                const pqxx::field field = row[j];
+                if (field.is_null()) {
+                    out += "null";
+                } else {
+                    appendValue(out, field.c_str(), field.size(), encodings[j]);
+                }
+            }
+            out += ']';
+        }
+    }
+
+    static void appendValue(std::string& out, const char* data, size_t size, Encoding encoding) {
+        switch (encoding) {
+            case Encoding::Boolean:
+                out += (size > 0 && data[0] == 't') ? "true" : "false";
+                return;
+            case Encoding::Number:
+                // NaN and Infinity have no JSON number form, so they stay strings.
+                if (isJsonNumber(data, size)) {
+                    out.append(data, size);
+                    return;
+                }
+                break;
+            case Encoding::Json:
+                // PostgreSQL only outputs valid JSON for these types.
+                out.append(data, size);
+                return;
+            case Encoding::String:
+                break;
+        }
+        appendString(out, data, size);
+    }
+
+    // Appends a quoted, escaped JSON string. Runs of bytes that need no
+    // escaping are found eight bytes at a time and copied in one append.
+    static void appendString(std::string& out, const char* data, size_t size) {
+        out += '"';
+        size_t start = 0;
+        for (size_t i = 0; i < size;) {
+            if (i + 8 <= size && !blockNeedsEscape(data + i)) {
+                i += 8;
+                continue;
+            }
+            unsigned char c = static_cast<unsigned char>(data[i]);
+            if (result_json_detail::ESCAPE_TABLE.needs[c]) {
+                out.append(data + start, i - start);
+                appendEscaped(out, c);
+                start = i + 1;
+            }
+            ++i;
+        }
+        out.append(data + start, size - start);
+        out += '"';
+    }
+
+    // Upper bound guess of the serialized size, used to reserve the output
+    // buffer once instead of letting it grow row by row.
+    static size_t estimateSize(const pqxx::result& res) {
+        size_t total = 0;
+        for (const auto& row : res) {
+            for (const auto& field : row) {
+                total += field.size() + 3;
+            }
+            total += 3;
+        }
+        return total;
+    }
+
+private:
+    // True if any of the eight bytes is a control character, '"' or '\\'.
+    static bool blockNeedsEscape(const char* p) {
+        uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        constexpr uint64_t ones = 0x0101010101010101ULL;
+        constexpr uint64_t highs = 0x8080808080808080ULL;
+        auto has_zero = [](uint64_t x) { return (x - ones) & ~x & highs; };
+        uint64_t below_space = (v - ones * 0x20) & ~v & highs;
+        return (below_space | has_zero(v ^ (ones * '"')) | has_zero(v ^ (ones * '\\'))) != 0;
+    }
+
+    static void appendEscaped(std::string& out, unsigned char c) {
+        switch (c) {
+            case '"':  out += "\\\""; return;
+            case '\\': out += "\\\\"; return;
+            case '\b': out += "\\b"; return;
+            case '\f': out += "\\f"; return;
+            case '\n': out += "\\n"; return;
+            case '\r': out += "\\r"; return;
+            case '\t': out += "\\t"; return;
+            default: {
+                static const char hex[] = "0123456789abcdef";
+                char buf[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0f]};
+                out.append(buf, sizeof(buf));
+            }
+        }
+    }
+
+    static bool isJsonNumber(const char* data, size_t size) {
+        size_t i = (size > 0 && data[0] == '-') ? 1 : 0;
+        return i < size && data[i] >= '0' && data[i] <= '9';
+    }
+};
+
+#endif // RESULT_JSON_H
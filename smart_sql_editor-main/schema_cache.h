@@ -0,0 +1,313 @@
+#ifndef SCHEMA_CACHE_H
+#define SCHEMA_CACHE_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <unordered_map>
+#include <condition_variable>
+#include <iostream>
+#include <pqxx/pqxx>
+#include "connection_pool.h"
+#include "result_cache.h"
+#include "schema_events.h"
+
+// In-process cache of the /tables and /table_details responses, one entry set
+// per database. A DDL event trigger in the database sends a NOTIFY on every
+// schema change and a background listener drops that database's entries when
+// it arrives. The trigger is installed by an admin through install() (POST
+// /schema_cache/install); nothing installs it implicitly. While the listener
+// is not connected or the trigger is missing nothing is served from the
+// cache, so responses are never older than the last DDL the listener saw.
+//
+// The same listener feeds the result cache and schema subscribers: DDL
+// invalidates the database's cached query results and is pushed to editor
+// pages (see SchemaEvents), and NOTIFYs on ResultCache::WRITE_CHANNEL (sent by
+// public.sql_editor_notify_write(), which admins attach to tables as an
+// AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ... FOR EACH STATEMENT
+// trigger) invalidate the results that read the written table.
+class SchemaCache {
+public:
+    static constexpr const char* CHANNEL = "sql_editor_ddl";
+    static constexpr const char* TRIGGER_NAME = "sql_editor_ddl_notify";
+    static constexpr size_t MAX_DATABASES = 256;
+    static constexpr std::chrono::seconds MAX_BACKOFF{60};
+    static constexpr std::chrono::seconds TRIGGER_CHECK_INTERVAL{60};
+
+    // Cached responses of a single database.
+    class Database {
+    public:
+        // Returns the cached response body for entry, if there is one.
+        std::optional<std::string> lookup(const std::string& entry) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!watching_) {
+                return std::nullopt;
+            }
+            auto it = entries_.find(entry);
+            if (it == entries_.end()) {
+                return std::nullopt;
+            }
+            return it->second;
+        }
+
+        // Take this before querying the catalog and hand it to store(); an
+        // invalidation in between makes store() a no-op.
+        uint64_t generation() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return generation_;
+        }
+
+        void store(const std::string& entry, std::string body, uint64_t generation) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (watching_ && generation == generation_) {
+                entries_[entry] = std::move(body);
+            }
+        }
+
+        // Whether the listener is connected, so DDL and write NOTIFYs reach
+        // this cache and the result cache.
+        bool isWatching() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return watching_;
+        }
+
+        // Drops every entry of this database.
+        void invalidate() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+            entries_.clear();
+        }
+
+    private:
+        friend class SchemaCache;
+
+        void setWatching(bool watching) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                watching_ = watching;
+                ++generation_;
+                entries_.clear();
+            }
+            // Writes may have gone unreported while nobody listened.
+            ResultCache::instance().invalidate(key_);
+        }
+
+        std::mutex mutex_;
+        bool watching_ = false;
+        uint64_t generation_ = 0;
+        std::unordered_map<std::string, std::string> entries_;
+        ConnectionKey key_;
+        std::string conn_str_;
+        std::thread listener_;
+        bool retry_ = false;  // guarded by SchemaCache::mutex_
+    };
+
+    ~SchemaCache() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        stop_wake_.notify_all();
+        for (auto& [key, db] : databases_) {
+            if (db->listener_.joinable()) {
+                db->listener_.join();
+            }
+        }
+    }
+
+    static SchemaCache& instance() {
+        static SchemaCache cache;
+        return cache;
+    }
+
+    // Returns the cache of the database behind these parameters, or nullptr
+    // if it is not being watched yet.
+    std::shared_ptr<Database> find(const std::string& db_name,
+                                   const std::string& db_user,
+                                   const std::string& db_pass,
+                                   const std::string& db_host,
+                                   const std::string& db_port) {
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = databases_.find(key);
+        return it == databases_.end() ? nullptr : it->second;
+    }
+
+    // Starts caching the database behind these parameters. Call it only after
+    // a request with them succeeded, so bad credentials never get a listener.
+    // Each database keeps a listener thread and connection, so at most
+    // MAX_DATABASES are watched; beyond that this returns nullptr.
+    std::shared_ptr<Database> watch(const std::string& db_name,
+                                    const std::string& db_user,
+                                    const std::string& db_pass,
+                                    const std::string& db_host,
+                                    const std::string& db_port) {
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = databases_.find(key);
+        if (it != databases_.end()) {
+            return it->second;
+        }
+        if (stopping_ || databases_.size() >= MAX_DATABASES) {
+            return nullptr;
+        }
+        auto db = std::make_shared<Database>();
+        db->key_ = key;
+        db->conn_str_ = ConnectionPool::connectionString(db_name, db_user, db_pass, db_host, db_port);
+        Database* raw = db.get();
+        db->listener_ = std::thread([this, raw] { listen(*raw); });
+        databases_.emplace(std::move(key), db);
+        return db;
+    }
+
+    // Makes a waiting listener reconnect now instead of after its backoff,
+    // e.g. once the trigger has been installed.
+    void retry(const ConnectionKey& key) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = databases_.find(key);
+            if (it == databases_.end()) {
+                return;
+            }
+            it->second->retry_ = true;
+        }
+        stop_wake_.notify_all();
+    }
+
+    // Installs the event trigger that reports DDL on CHANNEL, and the
+    // public.sql_editor_notify_write() function admins attach to tables.
+    // Creating event triggers needs superuser; an existing trigger is left
+    // alone.
+    static void install(pqxx::connection& conn) {
+        pqxx::work txn(conn);
+        txn.exec("SELECT pg_advisory_xact_lock(hashtext('" + std::string(TRIGGER_NAME) + "'))");
+        pqxx::result existing = txn.exec(
+            "SELECT 1 FROM pg_catalog.pg_event_trigger WHERE evtname = '" + std::string(TRIGGER_NAME) + "'");
+        if (existing.empty()) {
+            txn.exec(
+                "CREATE OR REPLACE FUNCTION public.sql_editor_notify_ddl() RETURNS event_trigger "
+                "LANGUAGE plpgsql AS $$ BEGIN PERFORM pg_notify('" + std::string(CHANNEL) + "', tg_tag); END $$");
+            txn.exec(
+                "CREATE EVENT TRIGGER " + std::string(TRIGGER_NAME) + " ON ddl_command_end "
+                "EXECUTE FUNCTION public.sql_editor_notify_ddl()");
+        }
+        pqxx::result write_notifier = txn.exec(
+            "SELECT 1 FROM pg_catalog.pg_proc WHERE oid = to_regproc('public.sql_editor_notify_write')");
+        if (write_notifier.empty()) {
+            txn.exec(
+                "CREATE FUNCTION public.sql_editor_notify_write() RETURNS trigger "
+                "LANGUAGE plpgsql AS $$ BEGIN PERFORM pg_notify('" + std::string(ResultCache::WRITE_CHANNEL) +
+                "', tg_table_schema || '.' || tg_table_name); RETURN NULL; END $$");
+        }
+        txn.commit();
+    }
+
+private:
+    // The listeners report to the result cache and to schema subscribers
+    // until they are joined in the destructor, so those have to be
+    // constructed first and destroyed last.
+    SchemaCache() {
+        ResultCache::instance();
+        SchemaEvents::instance();
+    }
+
+    // Whether the enabled event trigger reports DDL in conn's database.
+    static bool triggerInstalled(pqxx::connection& conn) {
+        pqxx::nontransaction txn(conn);
+        return !txn.exec(
+            "SELECT 1 FROM pg_catalog.pg_event_trigger "
+            "WHERE evtname = '" + std::string(TRIGGER_NAME) + "' AND evtenabled <> 'D'").empty();
+    }
+
+    class DdlReceiver : public pqxx::notification_receiver {
+    public:
+        DdlReceiver(pqxx::connection& conn, Database& db)
+            : pqxx::notification_receiver(conn, CHANNEL), db_(db) {}
+
+        void operator()(const std::string& /*payload*/, int /*backend_pid*/) override {
+            db_.invalidate();
+            ResultCache::instance().invalidate(db_.key_);
+            SchemaEvents::instance().changed(db_.key_);
+        }
+
+    private:
+        Database& db_;
+    };
+
+    class WriteReceiver : public pqxx::notification_receiver {
+    public:
+        WriteReceiver(pqxx::connection& conn, Database& db)
+            : pqxx::notification_receiver(conn, ResultCache::WRITE_CHANNEL), db_(db) {}
+
+        void operator()(const std::string& payload, int /*backend_pid*/) override {
+            ResultCache::instance().tableWritten(db_.key_, payload);
+        }
+
+    private:
+        Database& db_;
+    };
+
+    // Listener thread body: keeps a dedicated connection LISTENing on CHANNEL
+    // and reconnects with backoff when it is lost. The database's cache is
+    // only enabled while the LISTEN is in place and the event trigger exists;
+    // a missing trigger is checked for again after the same backoff, and an
+    // installed one every TRIGGER_CHECK_INTERVAL.
+    void listen(Database& db) {
+        std::chrono::seconds backoff{1};
+        bool reported_missing = false;
+        while (!isStopping()) {
+            try {
+                pqxx::connection conn(db.conn_str_);
+                DdlReceiver receiver(conn, db);
+                WriteReceiver writes(conn, db);
+                // Checked after the LISTEN, so no DDL from then on is missed.
+                if (triggerInstalled(conn)) {
+                    db.setWatching(true);
+                    backoff = std::chrono::seconds{1};
+                    reported_missing = false;
+                    auto checked = std::chrono::steady_clock::now();
+                    while (!isStopping()) {
+                        conn.await_notification(1, 0);
+                        if (std::chrono::steady_clock::now() - checked >= TRIGGER_CHECK_INTERVAL) {
+                            if (!triggerInstalled(conn)) {
+                                break;
+                            }
+                            checked = std::chrono::steady_clock::now();
+                        }
+                    }
+                    db.setWatching(false);
+                }
+                if (!isStopping() && !reported_missing) {
+                    std::cerr << "Schema cache off for " << db.conn_str_.substr(0, db.conn_str_.find(" password="))
+                              << ": the " << TRIGGER_NAME << " event trigger is not installed "
+                              << "(POST /schema_cache/install)" << std::endl;
+                    reported_missing = true;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Schema cache listener error: " << e.what() << std::endl;
+                db.setWatching(false);
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_wake_.wait_for(lock, backoff, [this, &db] { return stopping_ || db.retry_; });
+            db.retry_ = false;
+            backoff = std::min(backoff * 2, MAX_BACKOFF);
+        }
+    }
+
+    bool isStopping() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stopping_;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable stop_wake_;
+    bool stopping_ = false;
+    std::unordered_map<ConnectionKey, std::shared_ptr<Database>, ConnectionKeyHash> databases_;
+};
+
+#endif // SCHEMA_CACHE_H
@@ -0,0 +1,297 @@
+#ifndef SCHEMA_EVENTS_H
+#define SCHEMA_EVENTS_H
+
+#include <map>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <iostream>
+#include <pqxx/pqxx>
+#include "crow_all.h"
+#include "connection_pool.h"
+
+// Pushes schema changes to editor pages over a WebSocket. A page subscribes
+// to its database; the server keeps a signature of every table in its
+// non-system schemas (columns, types, defaults, comments and primary key)
+// and, whenever DDL is reported, diffs a fresh set of signatures against it
+// and sends subscribers only the difference:
+//
+//     {"type":"delta","added":[..],"removed":[..],"changed":[..]}
+//
+// where each table is {"schema":"public","name":"orders"}. A new subscriber
+// first gets {"type":"snapshot","tables":[..]}, which also resynchronizes a
+// page after its socket reconnects. Signatures are recomputed by a few worker
+// threads, so a slow or unreachable server only holds up its own databases.
+// A database is recomputed by one worker at a time, and changes reported
+// while it is being recomputed are folded into one more pass.
+class SchemaEvents {
+public:
+    static constexpr size_t WORKERS = 4;
+    static constexpr int SIGNATURES_TIMEOUT_MS = 30 * 1000;
+
+    ~SchemaEvents() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    static SchemaEvents& instance() {
+        // Construct the pool first so it outlives the workers.
+        ConnectionPool::instance();
+        static SchemaEvents events;
+        return events;
+    }
+
+    // Subscribes a socket to the database behind these parameters. The first
+    // signature query doubles as the credentials check; if it fails, the
+    // socket gets an error and is closed.
+    void subscribe(crow::websocket::connection& conn,
+                   const std::string& db_name,
+                   const std::string& db_user,
+                   const std::string& db_pass,
+                   const std::string& db_host,
+                   const std::string& db_port) {
+        ConnectionKey key = ConnectionPool::makeKey(db_name, db_user, db_pass, db_host, db_port);
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsubscribeLocked(conn);
+        Database& db = databases_[key];
+        if (db.db_name.empty()) {
+            db.db_name = db_name;
+            db.db_user = db_user;
+            db.db_pass = db_pass;
+            db.db_host = db_host;
+            db.db_port = db_port;
+        }
+        db.awaiting_snapshot.insert(&conn);
+        subscriptions_[&conn] = key;
+        enqueue(key, db);
+    }
+
+    void unsubscribe(crow::websocket::connection& conn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        unsubscribeLocked(conn);
+    }
+
+    // The schema of a database may have changed.
+    void changed(const ConnectionKey& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = databases_.find(key);
+        if (it != databases_.end()) {
+            enqueue(key, it->second);
+        }
+    }
+
+private:
+    using TableName = std::pair<std::string, std::string>;  // schema, name
+
+    struct Database {
+        std::string db_name;
+        std::string db_user;
+        std::string db_pass;
+        std::string db_host;
+        std::string db_port;
+        bool loaded = false;
+        bool queued = false;
+        bool running = false;  // a worker is recomputing the signatures
+        std::map<TableName, std::string> tables;  // -> signature
+        std::unordered_set<crow::websocket::connection*> subscribers;
+        std::unordered_set<crow::websocket::connection*> awaiting_snapshot;
+    };
+
+    SchemaEvents() {
+        for (size_t i = 0; i < WORKERS; ++i) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    // Called with mutex_ held. A database that is being recomputed is queued
+    // again by its worker once it is done.
+    void enqueue(const ConnectionKey& key, Database& db) {
+        if (!db.queued) {
+            db.queued = true;
+            if (!db.running) {
+                queue_.push_back(key);
+                wake_.notify_one();
+            }
+        }
+    }
+
+    static bool unused(const Database& db) {
+        return db.subscribers.empty() && db.awaiting_snapshot.empty() && !db.queued && !db.running;
+    }
+
+    // Called with mutex_ held. The database's state goes with its last
+    // subscriber.
+    void unsubscribeLocked(crow::websocket::connection& conn) {
+        auto it = subscriptions_.find(&conn);
+        if (it == subscriptions_.end()) {
+            return;
+        }
+        auto db = databases_.find(it->second);
+        db->second.subscribers.erase(&conn);
+        db->second.awaiting_snapshot.erase(&conn);
+        if (unused(db->second)) {
+            databases_.erase(db);
+        }
+        subscriptions_.erase(it);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            ConnectionKey key = std::move(queue_.front());
+            queue_.pop_front();
+            auto it = databases_.find(key);
+            if (it == databases_.end()) {
+                continue;
+            }
+            it->second.queued = false;
+            it->second.running = true;
+            Database params = it->second;  // the query runs unlocked
+            lock.unlock();
+
+            std::map<TableName, std::string> tables;
+            std::string error;
+            try {
+                tables = signatures(params);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+
+            lock.lock();
+            it = databases_.find(key);
+            if (it == databases_.end()) {
+                continue;
+            }
+            it->second.running = false;
+            if (error.empty()) {
+                publish(it->second, std::move(tables));
+            } else {
+                fail(it->second, error);
+            }
+            if (it->second.queued) {
+                queue_.push_back(key);
+                wake_.notify_one();
+            } else if (unused(it->second)) {
+                databases_.erase(it);
+            }
+        }
+    }
+
+    // Connecting is bounded by the pool's connect timeout and the query by
+    // SIGNATURES_TIMEOUT_MS.
+    static std::map<TableName, std::string> signatures(const Database& db) {
+        PooledConnection conn = ConnectionPool::instance().acquire(db.db_name, db.db_user, db.db_pass,
+                                                                   db.db_host, db.db_port);
+        pqxx::work txn(*conn);
+        txn.exec("SET LOCAL statement_timeout = " + std::to_string(SIGNATURES_TIMEOUT_MS));
+        pqxx::result res = txn.exec_prepared(PreparedStatements::TABLE_SIGNATURES);
+        txn.commit();
+        std::map<TableName, std::string> tables;
+        for (const auto& row : res) {
+            tables.emplace(TableName(row[0].c_str(), row[1].c_str()), row[2].c_str());
+        }
+        return tables;
+    }
+
+    static crow::json::wvalue tableJson(const TableName& table) {
+        crow::json::wvalue json;
+        json["schema"] = table.first;
+        json["name"] = table.second;
+        return json;
+    }
+
+    // Called with mutex_ held: sends the difference to subscribers and the
+    // full list to new ones.
+    void publish(Database& db, std::map<TableName, std::string> tables) {
+        if (db.loaded && !db.subscribers.empty()) {
+            crow::json::wvalue::list added;
+            crow::json::wvalue::list removed;
+            crow::json::wvalue::list changed;
+            for (const auto& [name, signature] : tables) {
+                auto old = db.tables.find(name);
+                if (old == db.tables.end()) {
+                    added.push_back(tableJson(name));
+                } else if (old->second != signature) {
+                    changed.push_back(tableJson(name));
+                }
+            }
+            for (const auto& [name, signature] : db.tables) {
+                if (!tables.count(name)) {
+                    removed.push_back(tableJson(name));
+                }
+            }
+            if (!added.empty() || !removed.empty() || !changed.empty()) {
+                crow::json::wvalue delta;
+                delta["type"] = "delta";
+                delta["added"] = std::move(added);
+                delta["removed"] = std::move(removed);
+                delta["changed"] = std::move(changed);
+                std::string message = delta.dump();
+                for (crow::websocket::connection* conn : db.subscribers) {
+                    conn->send_text(message);
+                }
+            }
+        }
+        db.tables = std::move(tables);
+        db.loaded = true;
+
+        if (!db.awaiting_snapshot.empty()) {
+            crow::json::wvalue::list names;
+            for (const auto& [name, signature] : db.tables) {
+                names.push_back(tableJson(name));
+            }
+            crow::json::wvalue snapshot;
+            snapshot["type"] = "snapshot";
+            snapshot["tables"] = std::move(names);
+            std::string message = snapshot.dump();
+            for (crow::websocket::connection* conn : db.awaiting_snapshot) {
+                conn->send_text(message);
+                db.subscribers.insert(conn);
+            }
+            db.awaiting_snapshot.clear();
+        }
+    }
+
+    // Called with mutex_ held. Sockets still waiting for their snapshot are
+    // told and closed; established ones keep their subscription and catch up
+    // with the next change.
+    void fail(Database& db, const std::string& error) {
+        std::cerr << "Schema events for " << db.db_name << "@" << db.db_host << ":" << db.db_port
+                  << " failed: " << error << std::endl;
+        crow::json::wvalue message;
+        message["type"] = "error";
+        message["error"] = error;
+        for (crow::websocket::connection* conn : db.awaiting_snapshot) {
+            conn->send_text(message.dump());
+            conn->close("schema subscription failed");
+            subscriptions_.erase(conn);
+        }
+        db.awaiting_snapshot.clear();
+    }
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stopping_ = false;
+    std::deque<ConnectionKey> queue_;
+    std::unordered_map<ConnectionKey, Database, ConnectionKeyHash> databases_;
+    std::unordered_map<crow::websocket::connection*, ConnectionKey> subscriptions_;
+    std::vector<std::thread> workers_;
+};
+
+#endif // SCHEMA_EVENTS_H
@@ -0,0 +1,193 @@
+#ifndef SCRIPT_RUNNER_H
+#define SCRIPT_RUNNER_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <pqxx/pqxx>
+#include "sql_lexer.h"
+#include "sql_classifier.h"
+#include "result_json.h"
+
+// Runs a script of several statements in one transaction and reports every
+// statement's outcome, where a plain /query only returns the last result.
+//
+// The script is split with SqlLexer and all statements go out through one
+// pqxx::pipeline, so the whole script costs a single round trip. Between the
+// statements the pipeline reads clock_timestamp(), which advances during a
+// transaction, and the differences are the server-side time of each
+// statement. The first failing statement aborts the transaction: it reports
+// its error and the statements after it are reported as skipped.
+class ScriptRunner {
+public:
+    static constexpr size_t MAX_STATEMENTS = 1000;
+    // Rows returned per statement; the rest is dropped and flagged truncated.
+    static constexpr size_t MAX_ROWS = 1000;
+
+    struct Outcome {
+        enum class Status { Skipped, Success, Error };
+
+        std::string sql;
+        Status status = Status::Skipped;
+        pqxx::result result;
+        double duration_ms = 0;
+        std::string error;
+    };
+
+    // Splits a script into statements. Throws std::invalid_argument for
+    // scripts that cannot run as one transaction.
+    static std::vector<Outcome> parse(const std::string& script) {
+        std::vector<Outcome> outcomes;
+        for (std::string& sql : SqlLexer::splitStatements(script)) {
+            SqlClassifier::Kind kind = SqlClassifier::classify(sql);
+            if (kind == SqlClassifier::Kind::Transaction) {
+                throw std::invalid_argument("Scripts run in a single transaction; remove \"" + sql + "\"");
+            }
+            if (copiesThroughClient(sql)) {
+                throw std::invalid_argument("COPY FROM STDIN and TO STDOUT cannot run in a script; "
+                                            "use /import or /export");
+            }
+            Outcome outcome;
+            outcome.sql = std::move(sql);
+            outcomes.push_back(std::move(outcome));
+        }
+        if (outcomes.empty()) {
+            throw std::invalid_argument("The script has no statements");
+        }
+        if (outcomes.size() > MAX_STATEMENTS) {
+            throw std::invalid_argument("Scripts are limited to " + std::to_string(MAX_STATEMENTS) + " statements");
+        }
+        return outcomes;
+    }
+
+    // Runs the statements in txn after setup (e.g. SET LOCAL statement_timeout)
+    // and fills in their outcomes. Returns false if a statement failed; txn
+    // is then aborted and must not be committed.
+    static bool run(pqxx::transaction_base& txn, const std::string& setup, std::vector<Outcome>& outcomes) {
+        static const std::string clock = "SELECT extract(epoch FROM clock_timestamp()) * 1000";
+
+        pqxx::pipeline pipe(txn);
+        // Hold everything back so the script is issued in one go.
+        pipe.retain(static_cast<int>(outcomes.size() * 2 + 2));
+        pqxx::pipeline::query_id setup_id = pipe.insert(setup);
+        std::vector<pqxx::pipeline::query_id> clocks{pipe.insert(clock)};
+        std::vector<pqxx::pipeline::query_id> statements;
+        for (const Outcome& outcome : outcomes) {
+            statements.push_back(pipe.insert(outcome.sql));
+            clocks.push_back(pipe.insert(clock));
+        }
+        pipe.resume();
+
+        pipe.retrieve(setup_id);
+        double started = pipe.retrieve(clocks[0])[0][0].as<double>();
+        for (size_t i = 0; i < outcomes.size(); ++i) {
+            Outcome& outcome = outcomes[i];
+            try {
+                outcome.result = pipe.retrieve(statements[i]);
+            } catch (const std::exception& e) {
+                outcome.status = Outcome::Status::Error;
+                outcome.error = e.what();
+                return false;
+            }
+            double finished = pipe.retrieve(clocks[i + 1])[0][0].as<double>();
+            outcome.status = Outcome::Status::Success;
+            outcome.duration_ms = finished - started;
+            started = finished;
+        }
+        return true;
+    }
+
+    // The /query response of a script:
+    // {"statements":[{"statement":..,"status":"success","command":..,
+    //  "rows_affected":..,"duration_ms":..,"columns":[..],"types":[..],
+    //  "rows":[..],"truncated":false},..],"committed":true,
+    //  "duration_ms":..,"status":"success"}
+    // A failed script starts with "error", naming the statement, and has no
+    // "status".
+    static std::string document(const std::vector<Outcome>& outcomes, bool committed, double duration_ms) {
+        std::string out = "[";
+        std::string error;
+        for (size_t i = 0; i < outcomes.size(); ++i) {
+            const Outcome& outcome = outcomes[i];
+            if (i > 0) out += ',';
+            out += "{\"statement\":";
+            ResultJson::appendString(out, outcome.sql.data(), outcome.sql.size());
+            switch (outcome.status) {
+            case Outcome::Status::Skipped:
+                out += ",\"status\":\"skipped\"}";
+                continue;
+            case Outcome::Status::Error:
+                out += ",\"status\":\"error\",\"error\":";
+                ResultJson::appendString(out, outcome.error.data(), outcome.error.size());
+                out += '}';
+                error = "Statement " + std::to_string(i + 1) + ": " + outcome.error;
+                continue;
+            case Outcome::Status::Success:
+                break;
+            }
+            const pqxx::result& res = outcome.result;
+            const char* command = res.cmd_status();
+            out += ",\"status\":\"success\",\"command\":";
+            ResultJson::appendString(out, command, std::strlen(command));
+            out += ",\"rows_affected\":";
+            out += std::to_string(res.affected_rows());
+            out += ",\"duration_ms\":";
+            appendMilliseconds(out, outcome.duration_ms);
+            out += ",\"columns\":";
+            ResultJson::appendColumns(out, res);
+            out += ",\"types\":";
+            ResultJson::appendTypes(out, res);
+            out += ",\"rows\":[";
+            ResultJson::appendRows(out, res, ResultJson::encodingsFor(res), false, MAX_ROWS);
+            out += "],\"truncated\":";
+            out += static_cast<size_t>(res.size()) > MAX_ROWS ? "true" : "false";
+            out += '}';
+        }
+        out += ']';
+
+        // A failure leads, as in every other /query error response.
+        std::string document = "{";
+        if (!error.empty()) {
+            document += "\"error\":";
+            ResultJson::appendString(document, error.data(), error.size());
+            document += ',';
+        }
+        document += "\"statements\":";
+        document += out;
+        document += ",\"committed\":";
+        document += committed ? "true" : "false";
+        document += ",\"duration_ms\":";
+        appendMilliseconds(document, duration_ms);
+        if (error.empty()) {
+            document += ",\"status\":\"success\"";
+        }
+        document += '}';
+        return document;
+    }
+
+private:
+    // COPY FROM STDIN / TO STDOUT would hand the connection to the client.
+    static bool copiesThroughClient(const std::string& sql) {
+        std::vector<SqlToken> tokens = SqlLexer::tokenize(sql);
+        if (tokens.empty() || !SqlLexer::isWord(sql, tokens[0], "copy")) {
+            return false;
+        }
+        for (const SqlToken& token : tokens) {
+            if (SqlLexer::isWord(sql, token, "stdin") || SqlLexer::isWord(sql, token, "stdout")) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void appendMilliseconds(std::string& out, double ms) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.3f", ms);
+        out += buffer;
+    }
+};
+
+#endif // SCRIPT_RUNNER_H
@@ -0,0 +1,258 @@
+#ifndef SQL_CLASSIFIER_H
+#define SQL_CLASSIFIER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_set>
+#include "sql_lexer.h"
+
+// Tells from the text alone what a SQL string may do, so read-only work can
+// run in a read-only transaction on a read replica. The classification is
+// conservative: whatever is not recognized as a read counts as a write. That
+// includes queries calling any function outside a list of side-effect free
+// built-ins, since a read-only transaction does not stop functions like
+// pg_terminate_backend or pg_advisory_lock from acting, and on a replica
+// they would act on the wrong server.
+class SqlClassifier {
+public:
+    // Ordered by how much a statement may change; a text with several
+    // statements takes the highest kind among them.
+    enum class Kind {
+        Empty,        // nothing but whitespace and comments
+        Read,         // SELECT/VALUES/TABLE, WITH without data-modifying CTEs, SHOW, EXPLAIN without ANALYZE
+        Session,      // SET, RESET, PREPARE, DECLARE, LISTEN and other session state
+        Transaction,  // BEGIN, COMMIT, ROLLBACK, SAVEPOINT
+        Write,        // DML, locking reads, COPY, CALL, DO, maintenance
+        Ddl           // CREATE, ALTER, DROP, COMMENT, GRANT, SELECT INTO ...
+    };
+
+    static Kind classify(const std::string& sql) {
+        std::vector<SqlToken> tokens = SqlLexer::tokenize(sql);
+        Kind kind = Kind::Empty;
+        forEachStatement(sql, tokens, [&](size_t begin, size_t end) {
+            kind = std::max(kind, classifyStatement(sql, tokens, begin, end));
+        });
+        return kind;
+    }
+
+    static bool isReadOnly(const std::string& sql) {
+        return classify(sql) == Kind::Read;
+    }
+
+    // DDL, or a DO block or procedure call, which may run DDL inside.
+    static bool mayChangeSchema(const std::string& sql) {
+        std::vector<SqlToken> tokens = SqlLexer::tokenize(sql);
+        bool changes = false;
+        forEachStatement(sql, tokens, [&](size_t begin, size_t end) {
+            changes = changes || SqlLexer::isWord(sql, tokens[begin], "do") ||
+                      SqlLexer::isWord(sql, tokens[begin], "call") ||
+                      classifyStatement(sql, tokens, begin, end) == Kind::Ddl;
+        });
+        return changes;
+    }
+
+private:
+    // Calls visit(begin, end) for the token range of every non-empty
+    // statement.
+    template <typename Visit>
+    static void forEachStatement(const std::string& sql, const std::vector<SqlToken>& tokens, Visit visit) {
+        size_t start = 0;
+        for (size_t i = 0; i <= tokens.size(); ++i) {
+            if (i == tokens.size() || SqlLexer::isPunctuation(sql, tokens[i], ';')) {
+                if (i > start) {
+                    visit(start, i);
+                }
+                start = i + 1;
+            }
+        }
+    }
+
+    // Classifies tokens [begin, end) holding a single statement.
+    static Kind classifyStatement(const std::string& sql,
+                                  const std::vector<SqlToken>& tokens,
+                                  size_t begin,
+                                  size_t end) {
+        auto is = [&](size_t i, const char* keyword) {
+            return i < end && SqlLexer::isWord(sql, tokens[i], keyword);
+        };
+        auto isAny = [&](size_t i, std::initializer_list<const char*> keywords) {
+            return std::any_of(keywords.begin(), keywords.end(), [&](const char* k) { return is(i, k); });
+        };
+
+        // Parenthesized queries: (SELECT ...) UNION ...
+        while (begin < end && SqlLexer::isPunctuation(sql, tokens[begin], '(')) {
+            ++begin;
+        }
+
+        if (isAny(begin, {"select", "values", "table", "with"})) {
+            return classifyQuery(sql, tokens, begin, end);
+        }
+        if (is(begin, "show")) {
+            return Kind::Read;
+        }
+        if (is(begin, "explain")) {
+            // EXPLAIN only plans the statement unless ANALYZE runs it.
+            size_t i = begin + 1;
+            bool analyze = false;
+            if (i < end && SqlLexer::isPunctuation(sql, tokens[i], '(')) {
+                for (++i; i < end && !SqlLexer::isPunctuation(sql, tokens[i], ')'); ++i) {
+                    if (is(i, "analyze") || is(i, "analyse")) {
+                        analyze = !isAny(i + 1, {"false", "off"}) &&
+                                  !(i + 1 < end && SqlLexer::text(sql, tokens[i + 1]) == "0");
+                    }
+                }
+                ++i;
+            } else {
+                for (; isAny(i, {"analyze", "analyse", "verbose"}); ++i) {
+                    analyze = analyze || !is(i, "verbose");
+                }
+            }
+            return analyze ? std::max(Kind::Read, classifyStatement(sql, tokens, i, end)) : Kind::Read;
+        }
+        if (isAny(begin, {"create", "alter", "drop", "comment", "grant", "revoke", "security", "import",
+                          "reassign"})) {
+            return Kind::Ddl;
+        }
+        if (isAny(begin, {"begin", "start", "commit", "end", "rollback", "abort", "savepoint", "release"})) {
+            return Kind::Transaction;
+        }
+        if (isAny(begin, {"set", "reset", "discard", "prepare", "deallocate", "declare", "fetch", "move",
+                          "close", "listen", "unlisten", "load"})) {
+            return Kind::Session;
+        }
+        // INSERT, UPDATE, DELETE, MERGE, COPY, TRUNCATE, CALL, DO, LOCK,
+        // EXECUTE, NOTIFY, VACUUM, ANALYZE, REFRESH and anything unknown.
+        return Kind::Write;
+    }
+
+    // Names that may be followed by "(" in a read: keywords and type names
+    // taking a parenthesized list, and built-in functions without side
+    // effects. Anything else followed by "(" is a call that may write.
+    static bool isSafeBeforeParenthesis(const std::string& name) {
+        static const std::unordered_set<std::string> names = {
+            // Keywords and type modifiers.
+            "select", "from", "join", "lateral", "where", "and", "or", "not", "in", "exists", "any", "all",
+            "some", "as", "on", "using", "values", "row", "array", "over", "filter", "within", "partition",
+            "by", "when", "then", "else", "case", "between", "is", "like", "ilike", "similar", "union",
+            "intersect", "except", "with", "recursive", "materialized", "having", "group", "grouping", "sets",
+            "cube", "rollup", "rows", "range", "groups", "limit", "offset", "fetch", "window", "distinct",
+            "only", "tablesample", "cast", "treat", "extract", "overlay", "position", "substring", "trim",
+            "coalesce", "nullif", "greatest", "least", "interval", "numeric", "decimal", "varchar", "char",
+            "character", "varying", "bit", "timestamp", "time", "float", "nchar", "collate", "escape",
+            // Aggregates and window functions.
+            "count", "sum", "avg", "min", "max", "array_agg", "string_agg", "bool_and", "bool_or", "every",
+            "json_agg", "jsonb_agg", "json_object_agg", "jsonb_object_agg", "stddev", "stddev_pop",
+            "stddev_samp", "variance", "var_pop", "var_samp", "corr", "covar_pop", "covar_samp",
+            "percentile_cont", "percentile_disc", "mode", "bit_and", "bit_or", "row_number", "rank",
+            "dense_rank", "percent_rank", "cume_dist", "ntile", "lag", "lead", "first_value", "last_value",
+            "nth_value",
+            // Strings.
+            "lower", "upper", "initcap", "length", "char_length", "character_length", "octet_length",
+            "substr", "ltrim", "rtrim", "btrim", "replace", "translate", "concat", "concat_ws", "left",
+            "right", "lpad", "rpad", "strpos", "split_part", "starts_with", "reverse", "repeat", "format",
+            "quote_ident", "quote_literal", "quote_nullable", "regexp_replace", "regexp_match",
+            "regexp_matches", "regexp_split_to_array", "regexp_split_to_table", "md5", "encode", "decode",
+            "to_char", "to_number", "to_date", "to_timestamp", "ascii", "chr",
+            // Numbers.
+            "abs", "round", "ceil", "ceiling", "floor", "trunc", "mod", "power", "sqrt", "cbrt", "exp",
+            "ln", "log", "log10", "sign", "div", "width_bucket",
+            // Dates and times.
+            "now", "date_trunc", "date_part", "age", "make_date", "make_time", "make_timestamp",
+            "make_timestamptz", "make_interval", "justify_days", "justify_hours", "justify_interval",
+            "isfinite", "clock_timestamp", "statement_timestamp", "transaction_timestamp",
+            // JSON.
+            "to_json", "to_jsonb", "row_to_json", "array_to_json", "json_build_object",
+            "jsonb_build_object", "json_build_array", "jsonb_build_array", "json_object", "jsonb_object",
+            "json_array_elements", "jsonb_array_elements", "json_array_elements_text",
+            "jsonb_array_elements_text", "json_each", "jsonb_each", "json_each_text", "jsonb_each_text",
+            "json_object_keys", "jsonb_object_keys", "json_extract_path", "jsonb_extract_path",
+            "json_extract_path_text", "jsonb_extract_path_text", "json_array_length",
+            "jsonb_array_length", "json_typeof", "jsonb_typeof", "jsonb_set", "jsonb_insert",
+            "jsonb_strip_nulls", "jsonb_pretty", "jsonb_path_query", "jsonb_path_exists",
+            // Arrays and set-returning functions.
+            "unnest", "array_length", "array_lower", "array_upper", "array_to_string", "string_to_array",
+            "cardinality", "array_position", "array_positions", "array_append", "array_prepend",
+            "array_cat", "array_remove", "array_replace", "generate_series", "generate_subscripts",
+            // Catalog and session information.
+            "current_database", "current_schema", "current_schemas", "current_user", "session_user",
+            "current_setting", "version", "format_type", "pg_typeof", "col_description",
+            "obj_description", "pg_get_viewdef", "pg_get_indexdef", "pg_get_constraintdef",
+            "pg_get_expr", "pg_table_size", "pg_relation_size", "pg_total_relation_size",
+            "pg_indexes_size", "pg_database_size", "pg_size_pretty", "has_table_privilege",
+            "has_schema_privilege", "has_column_privilege", "to_regclass", "to_regtype"};
+        return names.count(name) > 0;
+    }
+
+    // SELECT, VALUES, TABLE and WITH queries are reads unless they modify
+    // data in a CTE, lock rows (FOR UPDATE/SHARE), create a table (INTO), or
+    // call a function that is not known to be free of side effects.
+    static Kind classifyQuery(const std::string& sql,
+                              const std::vector<SqlToken>& tokens,
+                              size_t begin,
+                              size_t end) {
+        Kind kind = Kind::Read;
+        for (size_t i = begin; i < end; ++i) {
+            const SqlToken& token = tokens[i];
+            if (i + 1 < end && SqlLexer::isPunctuation(sql, tokens[i + 1], '(') && isCall(sql, tokens, begin, end, i)) {
+                kind = std::max(kind, Kind::Write);
+            }
+            if (token.type != SqlToken::Type::Word) {
+                continue;
+            }
+            if (SqlLexer::isWord(sql, token, "into")) {
+                // INSERT/MERGE INTO inside a CTE is a write; a bare INTO is SELECT INTO.
+                bool dml = i > begin && (SqlLexer::isWord(sql, tokens[i - 1], "insert") ||
+                                         SqlLexer::isWord(sql, tokens[i - 1], "merge"));
+                kind = std::max(kind, dml ? Kind::Write : Kind::Ddl);
+            } else if (SqlLexer::isWord(sql, token, "insert") || SqlLexer::isWord(sql, token, "update") ||
+                       SqlLexer::isWord(sql, token, "delete") || SqlLexer::isWord(sql, token, "merge") ||
+                       SqlLexer::isWord(sql, token, "share")) {
+                kind = std::max(kind, Kind::Write);
+            }
+        }
+        return kind;
+    }
+
+    // Whether name token i, which is followed by "(", calls a function that
+    // may have side effects. Column lists of aliases ("AS t(a, b)", "f(...)
+    // t(a, b)") and of CTEs ("t(a, b) AS (...)") are not calls; qualified
+    // names only count as safe in pg_catalog.
+    static bool isCall(const std::string& sql,
+                       const std::vector<SqlToken>& tokens,
+                       size_t begin,
+                       size_t end,
+                       size_t i) {
+        const SqlToken& token = tokens[i];
+        if (token.type != SqlToken::Type::Word && token.type != SqlToken::Type::QuotedIdentifier) {
+            return false;
+        }
+        if (i > begin && (SqlLexer::isWord(sql, tokens[i - 1], "as") || SqlLexer::isPunctuation(sql, tokens[i - 1], ')'))) {
+            return false;
+        }
+        int depth = 0;
+        size_t close = i + 1;
+        for (; close < end; ++close) {
+            if (SqlLexer::isPunctuation(sql, tokens[close], '(')) {
+                ++depth;
+            } else if (SqlLexer::isPunctuation(sql, tokens[close], ')') && --depth == 0) {
+                break;
+            }
+        }
+        if (close + 2 < end && SqlLexer::isWord(sql, tokens[close + 1], "as") &&
+            (SqlLexer::isPunctuation(sql, tokens[close + 2], '(') || SqlLexer::isWord(sql, tokens[close + 2], "not") ||
+             SqlLexer::isWord(sql, tokens[close + 2], "materialized"))) {
+            return false;
+        }
+        if (token.type == SqlToken::Type::QuotedIdentifier) {
+            return true;
+        }
+        if (i > begin + 1 && SqlLexer::isPunctuation(sql, tokens[i - 1], '.') &&
+            !SqlLexer::isWord(sql, tokens[i - 2], "pg_catalog")) {
+            return true;
+        }
+        return !isSafeBeforeParenthesis(SqlLexer::lowerText(sql, token));
+    }
+};
+
+#endif // SQL_CLASSIFIER_H
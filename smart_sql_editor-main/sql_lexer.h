@@ -0,0 +1,338 @@
+#ifndef SQL_LEXER_H
+#define SQL_LEXER_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cctype>
+
+// One token of a SQL text, as a range of the source.
+struct SqlToken {
+    enum class Type {
+        Word,              // keyword or unquoted identifier
+        QuotedIdentifier,  // "name", U&"name"
+        String,            // 'x', E'x', B'x', X'x', N'x', U&'x', $tag$x$tag$
+        Number,
+        Parameter,         // $1
+        Operator,          // + - * / < > = ~ ! @ # % ^ & | ` ? and runs of them
+        Punctuation        // ( ) [ ] , ; . :
+    };
+
+    Type type;
+    size_t begin;
+    size_t end;
+};
+
+// Splits SQL into tokens following PostgreSQL's lexical rules closely enough
+// to tell code from literals: comments (including nested /* */), quoted
+// identifiers, standard and escape strings, and dollar quoting. Unterminated
+// literals run to the end of the text; the server reports the error.
+class SqlLexer {
+public:
+    explicit SqlLexer(const std::string& sql) : sql_(sql) {}
+
+    // Reads the next token, skipping whitespace and comments. Returns false
+    // at the end of the text.
+    bool next(SqlToken& token) {
+        skipSpaceAndComments();
+        if (pos_ >= sql_.size()) {
+            return false;
+        }
+        token.begin = pos_;
+        char c = sql_[pos_];
+        char c1 = peek(1);
+
+        if ((c == 'e' || c == 'E') && c1 == '\'') {
+            ++pos_;
+            readQuoted('\'', true);
+            token.type = SqlToken::Type::String;
+        } else if ((c == 'b' || c == 'B' || c == 'x' || c == 'X' || c == 'n' || c == 'N') && c1 == '\'') {
+            ++pos_;
+            readQuoted('\'', false);
+            token.type = SqlToken::Type::String;
+        } else if ((c == 'u' || c == 'U') && c1 == '&' && (peek(2) == '\'' || peek(2) == '"')) {
+            pos_ += 2;
+            token.type = sql_[pos_] == '\'' ? SqlToken::Type::String : SqlToken::Type::QuotedIdentifier;
+            readQuoted(sql_[pos_], false);
+        } else if (isWordStart(c)) {
+            while (pos_ < sql_.size() && isWordChar(sql_[pos_])) ++pos_;
+            token.type = SqlToken::Type::Word;
+        } else if (c == '\'') {
+            readQuoted('\'', false);
+            token.type = SqlToken::Type::String;
+        } else if (c == '"') {
+            readQuoted('"', false);
+            token.type = SqlToken::Type::QuotedIdentifier;
+        } else if (c == '$' && std::isdigit(static_cast<unsigned char>(c1))) {
+            ++pos_;
+            while (pos_ < sql_.size() && std::isdigit(static_cast<unsigned char>(sql_[pos_]))) ++pos_;
+            token.type = SqlToken::Type::Parameter;
+        } else if (c == '$' && readDollarQuoted()) {
+            token.type = SqlToken::Type::String;
+        } else if (std::isdigit(static_cast<unsigned char>(c)) ||
+                   (c == '.' && std::isdigit(static_cast<unsigned char>(c1)))) {
+            readNumber();
+            token.type = SqlToken::Type::Number;
+        } else if (isOperatorChar(c)) {
+            // An operator never contains the start of a comment.
+            do {
+                ++pos_;
+            } while (pos_ < sql_.size() && isOperatorChar(sql_[pos_]) && !startsComment(pos_));
+            // As in the server, a trailing + or - belongs to the next token
+            // (x>=-1 is x >= -1) unless the operator has one of ~!@#%^&|`?.
+            bool keeps_sign = false;
+            for (size_t i = token.begin; i < pos_ && !keeps_sign; ++i) {
+                keeps_sign = std::strchr("~!@#%^&|`?", sql_[i]) != nullptr;
+            }
+            if (!keeps_sign) {
+                while (pos_ - token.begin > 1 && (sql_[pos_ - 1] == '+' || sql_[pos_ - 1] == '-')) --pos_;
+            }
+            token.type = SqlToken::Type::Operator;
+        } else {
+            ++pos_;
+            token.type = SqlToken::Type::Punctuation;
+        }
+        token.end = pos_;
+        return true;
+    }
+
+    static std::vector<SqlToken> tokenize(const std::string& sql) {
+        std::vector<SqlToken> tokens;
+        SqlLexer lexer(sql);
+        SqlToken token;
+        while (lexer.next(token)) {
+            tokens.push_back(token);
+        }
+        return tokens;
+    }
+
+    static std::string text(const std::string& sql, const SqlToken& token) {
+        return sql.substr(token.begin, token.end - token.begin);
+    }
+
+    // Keywords and unquoted identifiers fold to lower case, as the server
+    // folds them.
+    static std::string lowerText(const std::string& sql, const SqlToken& token) {
+        std::string word = text(sql, token);
+        if (token.type == SqlToken::Type::Word) {
+            for (char& c : word) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return word;
+    }
+
+    static bool isWord(const std::string& sql, const SqlToken& token, const char* keyword) {
+        size_t size = token.end - token.begin;
+        if (token.type != SqlToken::Type::Word || size != std::strlen(keyword)) {
+            return false;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            if (std::tolower(static_cast<unsigned char>(sql[token.begin + i])) != keyword[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool isPunctuation(const std::string& sql, const SqlToken& token, char c) {
+        return token.type == SqlToken::Type::Punctuation && sql[token.begin] == c;
+    }
+
+    // The statement with comments dropped, whitespace collapsed to single
+    // spaces, unquoted words lower-cased and trailing semicolons removed.
+    // Texts that normalize equally are the same statement to the server.
+    static std::string normalize(const std::string& sql) {
+        std::vector<SqlToken> tokens = tokenize(sql);
+        while (!tokens.empty() && isPunctuation(sql, tokens.back(), ';')) {
+            tokens.pop_back();
+        }
+        std::string out;
+        out.reserve(sql.size());
+        for (const SqlToken& token : tokens) {
+            if (!out.empty()) out += ' ';
+            out += lowerText(sql, token);
+        }
+        return out;
+    }
+
+    // normalize() with every literal and parameter replaced by ?, so
+    // statements that only differ in their constants share a fingerprint. A
+    // list of literals, as in IN (1, 2, 3), becomes a single ?.
+    static std::string fingerprint(const std::string& sql) {
+        std::vector<SqlToken> tokens = tokenize(sql);
+        while (!tokens.empty() && isPunctuation(sql, tokens.back(), ';')) {
+            tokens.pop_back();
+        }
+        std::string out;
+        out.reserve(sql.size());
+        for (const SqlToken& token : tokens) {
+            bool literal = token.type == SqlToken::Type::String || token.type == SqlToken::Type::Number ||
+                           token.type == SqlToken::Type::Parameter;
+            if (literal && out.size() >= 3 && out.compare(out.size() - 3, 3, "? ,") == 0) {
+                out.resize(out.size() - 2);
+                continue;
+            }
+            if (!out.empty()) out += ' ';
+            out += literal ? "?" : lowerText(sql, token);
+        }
+        return out;
+    }
+
+    // Quotes an identifier for use in SQL text.
+    static std::string quoteIdentifier(const std::string& identifier) {
+        std::string quoted = "\"";
+        for (char c : identifier) {
+            if (c == '"') {
+                quoted += "\""; // double any double quotes
+            }
+            quoted.push_back(c);
+        }
+        quoted += "\"";
+        return quoted;
+    }
+
+    // Splits a script at the semicolons between statements, as psql does.
+    // Each statement runs from its first token to its last, so comments
+    // around it are dropped and empty statements are skipped. Semicolons in
+    // the BEGIN ATOMIC ... END body of CREATE FUNCTION/PROCEDURE do not split.
+    static std::vector<std::string> splitStatements(const std::string& sql) {
+        std::vector<std::string> statements;
+        std::vector<SqlToken> tokens = tokenize(sql);
+        size_t start = 0;
+        int atomic_depth = 0;
+        bool routine = false;  // CREATE [OR REPLACE] FUNCTION/PROCEDURE
+        for (size_t i = 0; i <= tokens.size(); ++i) {
+            if (i == tokens.size() || (atomic_depth == 0 && isPunctuation(sql, tokens[i], ';'))) {
+                if (i > start) {
+                    size_t begin = tokens[start].begin;
+                    statements.push_back(sql.substr(begin, tokens[i - 1].end - begin));
+                }
+                start = i + 1;
+                atomic_depth = 0;
+                routine = false;
+                continue;
+            }
+            size_t position = i - start;
+            if (position <= 3 && (isWord(sql, tokens[i], "function") || isWord(sql, tokens[i], "procedure")) &&
+                isWord(sql, tokens[start], "create")) {
+                routine = true;
+            } else if (routine && isWord(sql, tokens[i], "begin") && i + 1 < tokens.size() &&
+                       isWord(sql, tokens[i + 1], "atomic")) {
+                ++atomic_depth;
+            } else if (atomic_depth > 0 && isWord(sql, tokens[i], "case")) {
+                ++atomic_depth;
+            } else if (atomic_depth > 0 && isWord(sql, tokens[i], "end")) {
+                --atomic_depth;
+            }
+        }
+        return statements;
+    }
+
+private:
+    char peek(size_t offset) const {
+        return pos_ + offset < sql_.size() ? sql_[pos_ + offset] : '\0';
+    }
+
+    static bool isWordStart(char c) {
+        return std::isalpha(static_cast<unsigned char>(c)) || c == '_' || static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    static bool isWordChar(char c) {
+        return isWordStart(c) || std::isdigit(static_cast<unsigned char>(c)) || c == '$';
+    }
+
+    static bool isOperatorChar(char c) {
+        return std::strchr("+-*/<>=~!@#%^&|`?", c) != nullptr && c != '\0';
+    }
+
+    bool startsComment(size_t at) const {
+        if (at + 1 >= sql_.size()) {
+            return false;
+        }
+        return (sql_[at] == '-' && sql_[at + 1] == '-') || (sql_[at] == '/' && sql_[at + 1] == '*');
+    }
+
+    void skipSpaceAndComments() {
+        while (pos_ < sql_.size()) {
+            char c = sql_[pos_];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++pos_;
+            } else if (c == '-' && peek(1) == '-') {
+                size_t end = sql_.find('\n', pos_);
+                pos_ = end == std::string::npos ? sql_.size() : end + 1;
+            } else if (c == '/' && peek(1) == '*') {
+                // Block comments nest.
+                int depth = 0;
+                do {
+                    if (sql_[pos_] == '/' && peek(1) == '*') {
+                        ++depth;
+                        pos_ += 2;
+                    } else if (sql_[pos_] == '*' && peek(1) == '/') {
+                        --depth;
+                        pos_ += 2;
+                    } else {
+                        ++pos_;
+                    }
+                } while (depth > 0 && pos_ < sql_.size());
+            } else {
+                return;
+            }
+        }
+    }
+
+    // Reads a literal opened by quote at pos_. A doubled quote stands for
+    // itself; in escape strings a backslash escapes the next character.
+    void readQuoted(char quote, bool backslash_escapes) {
+        ++pos_;
+        while (pos_ < sql_.size()) {
+            char c = sql_[pos_++];
+            if (backslash_escapes && c == '\\') {
+                ++pos_;
+            } else if (c == quote) {
+                if (pos_ < sql_.size() && sql_[pos_] == quote) {
+                    ++pos_;
+                } else {
+                    return;
+                }
+            }
+        }
+        pos_ = sql_.size();
+    }
+
+    // Reads $tag$...$tag$ if one starts at pos_.
+    bool readDollarQuoted() {
+        size_t tag_end = pos_ + 1;
+        if (tag_end < sql_.size() && isWordStart(sql_[tag_end])) {
+            while (tag_end < sql_.size() && isWordChar(sql_[tag_end]) && sql_[tag_end] != '$') ++tag_end;
+        }
+        if (tag_end >= sql_.size() || sql_[tag_end] != '$') {
+            return false;
+        }
+        std::string tag = sql_.substr(pos_, tag_end + 1 - pos_);
+        size_t close = sql_.find(tag, tag_end + 1);
+        pos_ = close == std::string::npos ? sql_.size() : close + tag.size();
+        return true;
+    }
+
+    void readNumber() {
+        while (pos_ < sql_.size() && (std::isdigit(static_cast<unsigned char>(sql_[pos_])) || sql_[pos_] == '_')) ++pos_;
+        if (pos_ < sql_.size() && sql_[pos_] == '.' && peek(1) != '.') {
+            ++pos_;
+            while (pos_ < sql_.size() && std::isdigit(static_cast<unsigned char>(sql_[pos_]))) ++pos_;
+        }
+        if (pos_ < sql_.size() && (sql_[pos_] == 'e' || sql_[pos_] == 'E')) {
+            size_t exponent = pos_ + 1;
+            if (exponent < sql_.size() && (sql_[exponent] == '+' || sql_[exponent] == '-')) ++exponent;
+            if (exponent < sql_.size() && std::isdigit(static_cast<unsigned char>(sql_[exponent]))) {
+                pos_ = exponent;
+                while (pos_ < sql_.size() && std::isdigit(static_cast<unsigned char>(sql_[pos_]))) ++pos_;
+            }
+        }
+    }
+
+    const std::string& sql_;
+    size_t pos_ = 0;
+};
+
+#endif // SQL_LEXER_H
@@ -0,0 +1,270 @@
+#ifndef STATIC_PAGE_H
+#define STATIC_PAGE_H
+
+#include <string>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <zlib.h>
+#include <brotli/encode.h>
+#include <openssl/evp.h>
+#include "crow_all.h"
+#include "gzip_encoder.h"
+
+// Which content coding a response uses, picked from Accept-Encoding: brotli,
+// then gzip, then none, skipping codings the client gives q=0.
+enum class ContentCoding { Identity, Gzip, Brotli };
+
+inline ContentCoding negotiateCoding(const std::string& accept_encoding, bool brotli = true) {
+    double br_q = -1, gzip_q = -1, any_q = -1;
+    size_t start = 0;
+    while (start < accept_encoding.size()) {
+        size_t end = accept_encoding.find(',', start);
+        if (end == std::string::npos) {
+            end = accept_encoding.size();
+        }
+        std::string item = accept_encoding.substr(start, end - start);
+        start = end + 1;
+
+        std::string coding;
+        double q = 1;
+        size_t semicolon = item.find(';');
+        for (char c : item.substr(0, semicolon)) {
+            if (!std::isspace(static_cast<unsigned char>(c))) {
+                coding.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+            }
+        }
+        if (semicolon != std::string::npos) {
+            size_t q_pos = item.find("q=", semicolon);
+            if (q_pos != std::string::npos) {
+                q = std::atof(item.c_str() + q_pos + 2);
+            }
+        }
+        if (coding == "br") {
+            br_q = q;
+        } else if (coding == "gzip" || coding == "x-gzip") {
+            gzip_q = q;
+        } else if (coding == "*") {
+            any_q = q;
+        }
+    }
+    if (br_q < 0) br_q = any_q;
+    if (gzip_q < 0) gzip_q = any_q;
+    if (brotli && br_q > 0 && br_q >= gzip_q) {
+        return ContentCoding::Brotli;
+    }
+    if (gzip_q > 0) {
+        return ContentCoding::Gzip;
+    }
+    return ContentCoding::Identity;
+}
+
+// A page that never changes while the process runs. It is compressed with
+// gzip and brotli once, at construction, and every representation gets a
+// strong ETag, so a request costs a header parse and a copy of the chosen
+// bytes, or just a 304 when the client's copy is current.
+class StaticPage {
+public:
+    // no-cache lets browsers keep the page but revalidate it on every load,
+    // so a new build is picked up at once and an unchanged page costs a 304.
+    StaticPage(std::string body, std::string content_type, std::string cache_control = "no-cache")
+        : content_type_(std::move(content_type)), cache_control_(std::move(cache_control)) {
+        std::string digest = digestHex(body);
+        identity_ = {std::move(body), "\"" + digest + "\""};
+        gzip_ = {GzipEncoder::compress(identity_.body), "\"" + digest + "-gz\""};
+        brotli_ = {compressBrotli(identity_.body), "\"" + digest + "-br\""};
+    }
+
+    StaticPage(const StaticPage&) = delete;
+    StaticPage& operator=(const StaticPage&) = delete;
+
+    // Fills res with the representation the client accepts, or a 304 when
+    // If-None-Match names it. Headers already on res are kept; res is not ended.
+    void respond(const crow::request& req, crow::response& res) const {
+        ContentCoding coding = negotiateCoding(req.get_header_value("Accept-Encoding"));
+        const Representation& page = coding == ContentCoding::Brotli ? brotli_
+                                     : coding == ContentCoding::Gzip ? gzip_
+                                                                     : identity_;
+        res.set_header("ETag", page.etag);
+        res.set_header("Cache-Control", cache_control_);
+        res.set_header("Vary", "Accept-Encoding");
+        if (matches(req.get_header_value("If-None-Match"), page.etag)) {
+            res.code = 304;
+            res.body.clear();
+            return;
+        }
+        res.code = 200;
+        res.set_header("Content-Type", content_type_);
+        if (coding != ContentCoding::Identity) {
+            res.set_header("Content-Encoding", coding == ContentCoding::Brotli ? "br" : "gzip");
+        }
+        res.body = page.body;
+    }
+
+    crow::response respond(const crow::request& req) const {
+        crow::response res;
+        respond(req, res);
+        return res;
+    }
+
+    static std::string compressBrotli(const std::string& data) {
+        std::string out(BrotliEncoderMaxCompressedSize(data.size()), '\0');
+        size_t size = out.size();
+        if (BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                                  data.size(), reinterpret_cast<const uint8_t*>(data.data()),
+                                  &size, reinterpret_cast<uint8_t*>(&out[0])) != BROTLI_TRUE) {
+            throw std::runtime_error("brotli compression failed");
+        }
+        out.resize(size);
+        return out;
+    }
+
+private:
+    struct Representation {
+        std::string body;
+        std::string etag;
+    };
+
+    // If-None-Match uses the weak comparison: W/ prefixes are ignored.
+    static bool matches(const std::string& if_none_match, const std::string& etag) {
+        size_t start = 0;
+        while (start < if_none_match.size()) {
+            size_t end = if_none_match.find(',', start);
+            if (end == std::string::npos) {
+                end = if_none_match.size();
+            }
+            size_t first = if_none_match.find_first_not_of(" \t", start);
+            size_t last = if_none_match.find_last_not_of(" \t", end - 1);
+            if (first != std::string::npos && first < end) {
+                std::string tag = if_none_match.substr(first, last - first + 1);
+                if (tag.compare(0, 2, "W/") == 0) {
+                    tag.erase(0, 2);
+                }
+                if (tag == "*" || tag == etag) {
+                    return true;
+                }
+            }
+            start = end + 1;
+        }
+        return false;
+    }
+
+    static std::string digestHex(const std::string& data) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_Digest(data.data(), data.size(), digest, &length, EVP_sha256(), nullptr) != 1) {
+            throw std::runtime_error("Failed to hash page");
+        }
+        static const char hex[] = "0123456789abcdef";
+        std::string out;
+        // 128 bits are plenty to tell versions of a page apart.
+        for (unsigned int i = 0; i < 16 && i < length; ++i) {
+            out.push_back(hex[digest[i] >> 4]);
+            out.push_back(hex[digest[i] & 0x0f]);
+        }
+        return out;
+    }
+
+    std::string content_type_;
+    std::string cache_control_;
+    Representation identity_;
+    Representation gzip_;
+    Representation brotli_;
+};
+
+// A page that differs per request only in one placeholder, like the editor
+// with its connection parameters. The text around the placeholder is
+// deflated once, each part as a run of deflate blocks that ends on a byte
+// boundary with no back references into other parts; a response deflates
+// just the replacement and joins the three runs into one gzip stream, with
+// the CRC combined from the parts'. The result embeds per-user data, so it
+// is neither cached nor given an ETag, and brotli, which cannot be spliced
+// this way, is not offered.
+class PageTemplate {
+public:
+    PageTemplate(const std::string& html, const std::string& placeholder, std::string content_type)
+        : content_type_(std::move(content_type)) {
+        size_t pos = html.find(placeholder);
+        if (pos == std::string::npos) {
+            throw std::invalid_argument("Placeholder not found in page template");
+        }
+        prefix_ = Part(html.substr(0, pos), false);
+        suffix_ = Part(html.substr(pos + placeholder.size()), true);
+    }
+
+    PageTemplate(const PageTemplate&) = delete;
+    PageTemplate& operator=(const PageTemplate&) = delete;
+
+    crow::response respond(const crow::request& req, const std::string& replacement) const {
+        crow::response res;
+        res.set_header("Content-Type", content_type_);
+        res.set_header("Cache-Control", "no-store");
+        res.set_header("Vary", "Accept-Encoding");
+        if (negotiateCoding(req.get_header_value("Accept-Encoding"), false) == ContentCoding::Identity) {
+            res.body = prefix_.text + replacement + suffix_.text;
+            return res;
+        }
+
+        Part middle(replacement, false);
+        std::string& out = res.body;
+        out.reserve(10 + prefix_.deflated.size() + middle.deflated.size() + suffix_.deflated.size() + 8);
+        // Gzip header: deflate, no flags, no mtime, Unix.
+        out.append("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+        out += prefix_.deflated;
+        out += middle.deflated;
+        out += suffix_.deflated;
+        uLong crc = crc32_combine(crc32_combine(prefix_.crc, middle.crc, static_cast<z_off_t>(middle.text.size())),
+                                  suffix_.crc, static_cast<z_off_t>(suffix_.text.size()));
+        uint32_t size = static_cast<uint32_t>(prefix_.text.size() + middle.text.size() + suffix_.text.size());
+        appendLittleEndian(out, static_cast<uint32_t>(crc));
+        appendLittleEndian(out, size);
+        res.set_header("Content-Encoding", "gzip");
+        return res;
+    }
+
+private:
+    struct Part {
+        Part() = default;
+
+        // Raw deflate blocks for text; the last part sets the final block.
+        Part(std::string text_, bool last) : text(std::move(text_)) {
+            z_stream zs{};
+            if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("Failed to initialize deflate");
+            }
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(text.data()));
+            zs.avail_in = static_cast<uInt>(text.size());
+            int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+            char buffer[16384];
+            int status;
+            do {
+                zs.next_out = reinterpret_cast<Bytef*>(buffer);
+                zs.avail_out = sizeof(buffer);
+                status = deflate(&zs, flush);
+                deflated.append(buffer, sizeof(buffer) - zs.avail_out);
+            } while (status == Z_OK && (zs.avail_out == 0 || (last && status != Z_STREAM_END)));
+            deflateEnd(&zs);
+            if (status == Z_STREAM_ERROR) {
+                throw std::runtime_error("deflate failed");
+            }
+            crc = crc32(0L, reinterpret_cast<const Bytef*>(text.data()), static_cast<uInt>(text.size()));
+        }
+
+        std::string text;
+        std::string deflated;
+        uLong crc = 0;
+    };
+
+    static void appendLittleEndian(std::string& out, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+        }
+    }
+
+    std::string content_type_;
+    Part prefix_;
+    Part suffix_;
+};
+
+#endif // STATIC_PAGE_H
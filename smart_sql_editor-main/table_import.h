@@ -0,0 +1,234 @@
+#ifndef TABLE_IMPORT_H
+#define TABLE_IMPORT_H
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <stdexcept>
+#include <pqxx/pqxx>
+
+// Loads an uploaded CSV or NDJSON document into a table with COPY ... FROM
+// STDIN. Records are converted to COPY's text format and sent one at a time,
+// so nothing beyond the upload itself and libpq's send buffer is held.
+// Columns are checked against the table's known columns before any row is
+// sent; errors from PostgreSQL (bad values, constraint violations) abort the
+// whole import and carry COPY's line number.
+class TableImport {
+public:
+    // CSV in PostgreSQL's CSV dialect: an unquoted empty field is NULL and a
+    // quoted one ("") is an empty string. With header set, the first record
+    // names the columns; otherwise records hold every table column in order.
+    // Returns the number of rows loaded.
+    static size_t copyCsv(pqxx::work& txn,
+                          const std::string& schema_name,
+                          const std::string& table_name,
+                          const std::string& data,
+                          bool header,
+                          const std::vector<std::string>& table_columns) {
+        CsvReader reader(data);
+        std::vector<std::string> fields;
+        std::vector<bool> nulls;
+
+        std::vector<std::string> columns = table_columns;
+        if (header) {
+            if (!reader.next(fields, nulls)) {
+                return 0;
+            }
+            columns = fields;
+            checkColumns(columns, table_columns);
+        }
+
+        pqxx::stream_to copy = pqxx::stream_to::raw_table(txn, tablePath(txn, schema_name, table_name),
+                                                          columnList(txn, columns));
+        size_t rows = 0;
+        std::string line;
+        while (reader.next(fields, nulls)) {
+            if (fields.size() != columns.size()) {
+                throw std::runtime_error("CSV record " + std::to_string(reader.record()) + " has " +
+                                         std::to_string(fields.size()) + " fields, expected " +
+                                         std::to_string(columns.size()));
+            }
+            line.clear();
+            for (size_t j = 0; j < fields.size(); ++j) {
+                if (j > 0) line += '\t';
+                if (nulls[j]) {
+                    line += "\\N";
+                } else {
+                    appendCopyText(line, fields[j].data(), fields[j].size());
+                }
+            }
+            copy.write_raw_line(line);
+            ++rows;
+        }
+        copy.complete();
+        return rows;
+    }
+
+    // One JSON object per line, keyed by column name. The lines are copied
+    // into a temporary jsonb table and inserted with jsonb_populate_record,
+    // so PostgreSQL converts every value to its column type. Only columns
+    // that appear in the document are inserted; other columns get their
+    // defaults, and rows without a key that other rows have get NULL.
+    static size_t copyNdjson(pqxx::work& txn,
+                             const std::string& schema_name,
+                             const std::string& table_name,
+                             const std::string& data,
+                             const std::vector<std::string>& table_columns) {
+        txn.exec("CREATE TEMP TABLE " + std::string(STAGING_TABLE) + " (doc jsonb) ON COMMIT DROP");
+        {
+            pqxx::stream_to copy = pqxx::stream_to::raw_table(txn, STAGING_TABLE, "doc");
+            std::string line;
+            for (size_t start = 0; start < data.size();) {
+                size_t end = data.find('\n', start);
+                if (end == std::string::npos) end = data.size();
+                size_t size = end - start;
+                if (size > 0 && data[start + size - 1] == '\r') --size;
+                if (size > 0) {
+                    line.clear();
+                    appendCopyText(line, data.data() + start, size);
+                    copy.write_raw_line(line);
+                }
+                start = end + 1;
+            }
+            copy.complete();
+        }
+
+        std::unordered_set<std::string> present;
+        for (const auto& row : txn.exec("SELECT DISTINCT jsonb_object_keys(doc) FROM " + std::string(STAGING_TABLE))) {
+            present.insert(row[0].c_str());
+        }
+        checkColumns(std::vector<std::string>(present.begin(), present.end()), table_columns);
+
+        // Keep the table's column order.
+        std::vector<std::string> columns;
+        for (const std::string& column : table_columns) {
+            if (present.count(column)) columns.push_back(column);
+        }
+        if (columns.empty()) {
+            // Either no rows at all, or only empty objects.
+            if (txn.query_value<size_t>("SELECT count(*) FROM " + std::string(STAGING_TABLE)) > 0) {
+                throw std::runtime_error("NDJSON rows have no columns");
+            }
+            return 0;
+        }
+
+        std::string select;
+        for (size_t j = 0; j < columns.size(); ++j) {
+            if (j > 0) select += ", ";
+            select += "r." + txn.quote_name(columns[j]);
+        }
+        std::string path = tablePath(txn, schema_name, table_name);
+        pqxx::result res = txn.exec(
+            "INSERT INTO " + path + " (" + columnList(txn, columns) + ") "
+            "SELECT " + select + " FROM " + STAGING_TABLE + ", "
+            "jsonb_populate_record(NULL::" + path + ", doc) AS r");
+        return static_cast<size_t>(res.affected_rows());
+    }
+
+private:
+    static constexpr const char* STAGING_TABLE = "sql_editor_import";
+
+    // Reads CSV records, including quoted fields that span lines.
+    class CsvReader {
+    public:
+        explicit CsvReader(const std::string& data) : data_(data) {
+            if (data_.compare(0, 3, "\xEF\xBB\xBF") == 0) pos_ = 3;  // UTF-8 BOM
+        }
+
+        bool next(std::vector<std::string>& fields, std::vector<bool>& nulls) {
+            // Blank lines hold no record.
+            while (pos_ < data_.size() && (data_[pos_] == '\n' || data_[pos_] == '\r')) ++pos_;
+            if (pos_ >= data_.size()) {
+                return false;
+            }
+            ++record_;
+            fields.clear();
+            nulls.clear();
+            for (;;) {
+                std::string field;
+                bool quoted = false;
+                if (pos_ < data_.size() && data_[pos_] == '"') {
+                    quoted = true;
+                    ++pos_;
+                    for (;;) {
+                        size_t quote = data_.find('"', pos_);
+                        if (quote == std::string::npos) {
+                            throw std::runtime_error("CSV record " + std::to_string(record_) + " has an unterminated quoted field");
+                        }
+                        field.append(data_, pos_, quote - pos_);
+                        pos_ = quote + 1;
+                        if (pos_ < data_.size() && data_[pos_] == '"') {
+                            field += '"';
+                            ++pos_;
+                        } else {
+                            break;
+                        }
+                    }
+                }
+                size_t end = data_.find_first_of(",\r\n", pos_);
+                if (end == std::string::npos) end = data_.size();
+                field.append(data_, pos_, end - pos_);
+                pos_ = end;
+
+                nulls.push_back(!quoted && field.empty());
+                fields.push_back(std::move(field));
+
+                if (pos_ < data_.size() && data_[pos_] == ',') {
+                    ++pos_;
+                    continue;
+                }
+                if (pos_ < data_.size() && data_[pos_] == '\r') ++pos_;
+                if (pos_ < data_.size() && data_[pos_] == '\n') ++pos_;
+                return true;
+            }
+        }
+
+        size_t record() const { return record_; }
+
+    private:
+        const std::string& data_;
+        size_t pos_ = 0;
+        size_t record_ = 0;
+    };
+
+    static void checkColumns(const std::vector<std::string>& columns, const std::vector<std::string>& table_columns) {
+        std::unordered_set<std::string> known(table_columns.begin(), table_columns.end());
+        std::unordered_set<std::string> seen;
+        for (const std::string& column : columns) {
+            if (!known.count(column)) {
+                throw std::runtime_error("Unknown column \"" + column + "\"");
+            }
+            if (!seen.insert(column).second) {
+                throw std::runtime_error("Column \"" + column + "\" appears more than once");
+            }
+        }
+    }
+
+    static std::string tablePath(pqxx::work& txn, const std::string& schema_name, const std::string& table_name) {
+        return txn.quote_name(schema_name) + "." + txn.quote_name(table_name);
+    }
+
+    static std::string columnList(pqxx::work& txn, const std::vector<std::string>& columns) {
+        std::string list;
+        for (size_t j = 0; j < columns.size(); ++j) {
+            if (j > 0) list += ", ";
+            list += txn.quote_name(columns[j]);
+        }
+        return list;
+    }
+
+    // Escapes a value for COPY's text format.
+    static void appendCopyText(std::string& out, const char* data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            switch (data[i]) {
+                case '\\': out += "\\\\"; break;
+                case '\t': out += "\\t"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                default: out += data[i];
+            }
+        }
+    }
+};
+
+#endif // TABLE_IMPORT_H
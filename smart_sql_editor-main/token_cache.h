@@ -0,0 +1,96 @@
+#ifndef TOKEN_CACHE_H
+#define TOKEN_CACHE_H
+
+#include <string>
+#include <array>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <openssl/evp.h>
+
+// Tokens that already passed signature and claim verification, so a request
+// with a known token costs a SHA-256 of the token and a hash lookup instead
+// of a decode and an HMAC. Entries are keyed by the token's digest, so the
+// cache never holds a usable token, and live until the token expires.
+//
+// The map is split into SHARDS, each with its own lock. A shard also orders
+// its entries by expiry: expired ones are dropped whenever the shard is
+// written, and a full shard evicts the entry closest to expiring.
+class VerifiedTokenCache {
+public:
+    using Clock = std::chrono::system_clock;
+    static constexpr size_t SHARDS = 16;
+    static constexpr size_t CAPACITY = 64 * 1024;
+
+    struct Entry {
+        std::string username;
+        Clock::time_point expires_at;
+    };
+
+    // The SHA-256 of a token, the key it is cached under.
+    static std::string digest(const std::string& token) {
+        unsigned char digest[EVP_MAX_MD_SIZE];
+        unsigned int length = 0;
+        if (EVP_Digest(token.data(), token.size(), digest, &length, EVP_sha256(), nullptr) != 1) {
+            throw std::runtime_error("Failed to hash token");
+        }
+        return std::string(reinterpret_cast<const char*>(digest), length);
+    }
+
+    // The entry for a token digest, unless it is unknown or has expired.
+    std::optional<Entry> find(const std::string& key) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.entries.find(key);
+        if (it == shard.entries.end() || it->second.expires_at <= Clock::now()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+
+    void insert(const std::string& key, Entry entry) {
+        Shard& shard = shardFor(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        Clock::time_point now = Clock::now();
+        while (!shard.by_expiry.empty() &&
+               (shard.by_expiry.begin()->first <= now || shard.entries.size() >= CAPACITY / SHARDS)) {
+            shard.entries.erase(shard.by_expiry.begin()->second);
+            shard.by_expiry.erase(shard.by_expiry.begin());
+        }
+        if (entry.expires_at <= now || shard.entries.count(key) > 0) {
+            return;
+        }
+        shard.by_expiry.emplace(entry.expires_at, key);
+        shard.entries.emplace(key, std::move(entry));
+    }
+
+private:
+    // Digests are uniformly distributed, so their leading bytes are a hash.
+    struct DigestHash {
+        size_t operator()(const std::string& key) const {
+            size_t hash = 0;
+            std::memcpy(&hash, key.data(), std::min(sizeof(hash), key.size()));
+            return hash;
+        }
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, Entry, DigestHash> entries;
+        std::multimap<Clock::time_point, std::string> by_expiry;
+    };
+
+    Shard& shardFor(const std::string& key) {
+        unsigned char byte = key.size() > sizeof(size_t) ? static_cast<unsigned char>(key[sizeof(size_t)]) : 0;
+        return shards_[byte % SHARDS];
+    }
+
+    std::array<Shard, SHARDS> shards_;
+};
+
+#endif // TOKEN_CACHE_H